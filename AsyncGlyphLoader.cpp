@@ -0,0 +1,115 @@
+#include "AsyncGlyphLoader.h"
+
+#include <algorithm>
+#include <utility>
+
+GlyphLoadRequest::GlyphLoadRequest(std::shared_ptr<State> state_) :
+  state(std::move(state_)) {
+}
+
+GlyphLoadRequest::~GlyphLoadRequest() {
+  // Moved-from handles have no state
+  if (state) cancel();
+}
+
+std::optional<Glyph> GlyphLoadRequest::next() {
+  std::unique_lock lock(state->mutex);
+  state->cv.wait(lock, [&] {
+    return state->cancelled || state->error || !state->ready.empty() ||
+           state->pending == 0;
+  });
+  if (state->error) {
+    std::rethrow_exception(std::exchange(state->error, nullptr));
+  }
+  if (state->cancelled || state->ready.empty()) return std::nullopt;
+
+  auto glyph = std::move(state->ready.front());
+  state->ready.pop_front();
+  return glyph;
+}
+
+void GlyphLoadRequest::cancel() {
+  {
+    std::lock_guard lock(state->mutex);
+    state->cancelled = true;
+  }
+  state->cv.notify_all();
+}
+
+bool GlyphLoadRequest::isCancelled() const {
+  return state->cancelled;
+}
+
+AsyncGlyphLoader::AsyncGlyphLoader(const FontParser& parser_,
+                                   const unsigned numThreads) :
+  parser(parser_) {
+  for (unsigned i = 0; i < std::max(1u, numThreads); ++i) {
+    workers.emplace_back([this] { workerLoop(); });
+  }
+}
+
+AsyncGlyphLoader::~AsyncGlyphLoader() {
+  {
+    std::lock_guard lock(queueMutex);
+    stopping = true;
+    // Wake up everyone still waiting for the glyphs that will never load
+    while (!tasks.empty()) {
+      const auto state = tasks.top().state;
+      tasks.pop();
+      {
+        std::lock_guard stateLock(state->mutex);
+        state->cancelled = true;
+      }
+      state->cv.notify_all();
+    }
+  }
+  queueCv.notify_all();
+  // jthread joins the workers on destruction
+  workers.clear();
+}
+
+GlyphLoadRequest AsyncGlyphLoader::request(
+    const std::vector<uint16_t>& glyphCodes,
+    const LoadPriority priority) {
+  auto state = std::make_shared<GlyphLoadRequest::State>();
+  state->pending = glyphCodes.size();
+  {
+    std::lock_guard lock(queueMutex);
+    for (const auto glyphCode : glyphCodes) {
+      tasks.push(Task{priority, nextSequence++, glyphCode, state});
+    }
+  }
+  queueCv.notify_all();
+  return GlyphLoadRequest(state);
+}
+
+void AsyncGlyphLoader::workerLoop() {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock lock(queueMutex);
+      queueCv.wait(lock, [&] { return stopping || !tasks.empty(); });
+      if (stopping) return;
+      task = tasks.top();
+      tasks.pop();
+    }
+
+    auto& state = *task.state;
+    // Cancelled requests only need their pending count settled
+    if (!state.cancelled) {
+      try {
+        auto glyph = parser.getGlyphByCode(task.glyphCode);
+        std::lock_guard lock(state.mutex);
+        state.ready.emplace_back(std::move(glyph));
+      } catch (...) {
+        std::lock_guard lock(state.mutex);
+        state.error = std::current_exception();
+      }
+    }
+    {
+      std::lock_guard lock(state.mutex);
+      --state.pending;
+    }
+    state.cv.notify_all();
+  }
+}
@@ -0,0 +1,117 @@
+#pragma once
+#ifndef ASYNCGLYPHLOADER_H
+#define ASYNCGLYPHLOADER_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "FontParser.h"
+#include "Glyph.h"
+
+enum class LoadPriority {
+  // Glyphs that will probably be needed later
+  Prefetch = 0,
+  // Glyphs someone is waiting for, decoded before any prefetch work
+  Interactive = 1,
+};
+
+/**
+ * Handle of glyphs requested from AsyncGlyphLoader.
+ * Glyphs are handed out in the order they finish decoding, so the caller can
+ * rasterize the first ones while the rest are still being decoded.
+ * Dropping the handle cancels the glyphs that are not decoded yet.
+ */
+class GlyphLoadRequest {
+public:
+  GlyphLoadRequest(GlyphLoadRequest&&) noexcept = default;
+  GlyphLoadRequest& operator=(GlyphLoadRequest&&) noexcept = default;
+  ~GlyphLoadRequest();
+  /**
+   * Wait for the next decoded glyph.
+   * Rethrows the exception if decoding a glyph failed.
+   * @return Decoded glyph, or nullopt once every glyph was handed out or
+   * the request was cancelled
+   */
+  std::optional<Glyph> next();
+  /**
+   * Cancel the glyphs that are not decoded yet.
+   */
+  void cancel();
+  [[nodiscard]] bool isCancelled() const;
+
+private:
+  friend class AsyncGlyphLoader;
+
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Glyph> ready;
+    std::size_t pending = 0;
+    std::atomic<bool> cancelled = false;
+    std::exception_ptr error;
+  };
+
+  explicit GlyphLoadRequest(std::shared_ptr<State> state_);
+
+  std::shared_ptr<State> state;
+};
+
+/**
+ * Decodes glyphs on a pool of background threads.
+ */
+class AsyncGlyphLoader {
+public:
+  /**
+   * @param parser_ Font parser, must outlive the loader
+   * @param numThreads Number of worker threads
+   */
+  explicit AsyncGlyphLoader(const FontParser& parser_,
+                            unsigned numThreads =
+                                std::thread::hardware_concurrency());
+  ~AsyncGlyphLoader();
+  AsyncGlyphLoader(const AsyncGlyphLoader&) = delete;
+  AsyncGlyphLoader& operator=(const AsyncGlyphLoader&) = delete;
+  /**
+   * Queue glyphs for decoding.
+   * @param glyphCodes Glyph codes to decode
+   * @param priority Interactive requests are decoded before prefetch ones
+   * @return Handle to receive the decoded glyphs
+   */
+  GlyphLoadRequest request(const std::vector<uint16_t>& glyphCodes,
+                           LoadPriority priority = LoadPriority::Interactive);
+
+private:
+  struct Task {
+    LoadPriority priority;
+    // Keeps tasks of the same priority in the order they were requested
+    uint64_t sequence;
+    uint16_t glyphCode;
+    std::shared_ptr<GlyphLoadRequest::State> state;
+  };
+
+  struct TaskOrder {
+    bool operator()(const Task& a, const Task& b) const {
+      if (a.priority != b.priority) return a.priority < b.priority;
+      return a.sequence > b.sequence;
+    }
+  };
+
+  const FontParser& parser;
+  std::mutex queueMutex;
+  std::condition_variable queueCv;
+  std::priority_queue<Task, std::vector<Task>, TaskOrder> tasks;
+  uint64_t nextSequence = 0;
+  bool stopping = false;
+  std::vector<std::jthread> workers;
+
+  void workerLoop();
+};
+
+#endif //ASYNCGLYPHLOADER_H
@@ -0,0 +1,133 @@
+#include "CanvasPool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+// Rebuild cost of a canvas in nanoseconds per byte, faulting in and
+// clearing fresh pages
+constexpr double CANVAS_BYTE_COST = 0.25;
+}
+
+CanvasPool::Lease::Lease(CanvasPool& pool_,
+                         std::unique_ptr<FrameBufferCanvas> canvas_) :
+  pool(&pool_), canvas(std::move(canvas_)) {
+}
+
+CanvasPool::Lease& CanvasPool::Lease::operator=(Lease&& other) noexcept {
+  if (this != &other) {
+    if (canvas) pool->release(std::move(canvas));
+    pool = other.pool;
+    canvas = std::move(other.canvas);
+  }
+  return *this;
+}
+
+CanvasPool::Lease::~Lease() {
+  if (canvas) pool->release(std::move(canvas));
+}
+
+CanvasPool::CanvasPool(const std::size_t maxIdle_, MemoryBudget* budget_) :
+  maxIdle(maxIdle_), budget(budget_) {
+  if (budget) budget->attach(*this);
+}
+
+CanvasPool::~CanvasPool() {
+  if (budget) budget->detach(*this);
+}
+
+CanvasPool::Lease CanvasPool::acquire(const int width, const int height) {
+  const auto pixels = static_cast<std::size_t>(width) * height;
+  std::unique_ptr<FrameBufferCanvas> canvas;
+  {
+    std::lock_guard lock(mutex);
+    // Smallest one that fits, else the largest so the least is reallocated
+    auto best = idle.end();
+    for (auto it = idle.begin(); it != idle.end(); ++it) {
+      const auto capacity = it->canvas->getCapacity();
+      if (best == idle.end()) {
+        best = it;
+        continue;
+      }
+      const auto bestCapacity = best->canvas->getCapacity();
+      const bool fits = capacity >= pixels;
+      const bool bestFits = bestCapacity >= pixels;
+      if (fits ? !bestFits || capacity < bestCapacity
+               : !bestFits && capacity > bestCapacity) {
+        best = it;
+      }
+    }
+    if (best == idle.end()) {
+      ++stats.created;
+    } else {
+      canvas = std::move(best->canvas);
+      if (budget) budget->release(*this, best->id);
+      // Order doesn't matter, swap the last one into the hole
+      *best = std::move(idle.back());
+      idle.pop_back();
+      ++stats.reused;
+      if (canvas->getCapacity() < pixels) ++stats.grown;
+    }
+  }
+  // Clearing and allocating happen outside the lock
+  if (canvas) {
+    canvas->reset(width, height);
+  } else {
+    canvas = std::make_unique<FrameBufferCanvas>(width, height);
+  }
+  return Lease{*this, std::move(canvas)};
+}
+
+void CanvasPool::release(std::unique_ptr<FrameBufferCanvas> canvas) {
+  const auto bytes = budget ? canvas->getMemoryReport().total().bytes : 0;
+  uint64_t id;
+  {
+    std::lock_guard lock(mutex);
+    if (idle.size() >= maxIdle) return;
+    id = nextId++;
+    idle.push_back({std::move(canvas), id});
+  }
+  if (!budget) return;
+  // The budget may evict from this pool, so it is charged without the lock
+  budget->charge(*this, id, bytes, CANVAS_BYTE_COST * bytes);
+  // A racing acquire may have taken the canvas before it was charged
+  std::lock_guard lock(mutex);
+  if (std::ranges::none_of(idle, [&](const IdleCanvas& c) {
+    return c.id == id;
+  })) {
+    budget->release(*this, id);
+  }
+}
+
+void CanvasPool::evictEntry(const uint64_t key) {
+  std::unique_ptr<FrameBufferCanvas> evicted;
+  {
+    std::lock_guard lock(mutex);
+    const auto it = std::ranges::find(idle, key, &IdleCanvas::id);
+    if (it == idle.end()) return;
+    evicted = std::move(it->canvas);
+    *it = std::move(idle.back());
+    idle.pop_back();
+  }
+  // The framebuffer is freed outside the lock
+}
+
+std::size_t CanvasPool::idleCount() const {
+  std::lock_guard lock(mutex);
+  return idle.size();
+}
+
+CanvasPool::Stats CanvasPool::getStats() const {
+  std::lock_guard lock(mutex);
+  return stats;
+}
+
+MemoryReport CanvasPool::getMemoryReport() const {
+  std::lock_guard lock(mutex);
+  MemoryUsage usage;
+  for (const auto& c : idle) usage += c.canvas->getMemoryReport().total();
+  MemoryReport report;
+  report.add("canvasPool.idle", usage);
+  report.add("canvasPool.slots", ::getMemoryUsage(idle));
+  return report;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef CANVASPOOL_H
+#define CANVASPOOL_H
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "FrameBufferCanvas.h"
+#include "MemoryBudget.h"
+#include "utils/Memory.h"
+
+/**
+ * Keeps idle canvases for reuse, so a steady stream of render jobs stops
+ * allocating and zero-filling a framebuffer per job. Canvases are handed out
+ * reset to the requested size and come back when their lease is dropped.
+ * With a memory budget the idle canvases are charged to it, and are the
+ * first to go under pressure since they are cheap to rebuild. Thread-safe.
+ */
+class CanvasPool : MemoryBudget::Client {
+public:
+  struct Stats {
+    // Canvases allocated because no idle one was left
+    uint64_t created = 0;
+    // Leases served by an idle canvas
+    uint64_t reused = 0;
+    // Reused canvases whose buffer had to grow
+    uint64_t grown = 0;
+  };
+
+  /**
+   * Canvas borrowed from the pool, returned to it on destruction.
+   */
+  class Lease {
+  public:
+    Lease(Lease&& other) noexcept = default;
+    Lease& operator=(Lease&& other) noexcept;
+    ~Lease();
+    FrameBufferCanvas& operator*() const { return *canvas; }
+    FrameBufferCanvas* operator->() const { return canvas.get(); }
+
+  private:
+    friend class CanvasPool;
+
+    Lease(CanvasPool& pool_, std::unique_ptr<FrameBufferCanvas> canvas_);
+
+    CanvasPool* pool;
+    std::unique_ptr<FrameBufferCanvas> canvas;
+  };
+
+  /**
+   * @param maxIdle_ Idle canvases kept at most, extra ones are freed
+   * @param budget_ Budget shared with other caches, or nullptr. It must
+   * outlive the pool.
+   */
+  explicit CanvasPool(std::size_t maxIdle_ = 16,
+                      MemoryBudget* budget_ = nullptr);
+  ~CanvasPool() override;
+  CanvasPool(const CanvasPool&) = delete;
+  CanvasPool& operator=(const CanvasPool&) = delete;
+  /**
+   * Borrow a black canvas of the given size. The idle canvas with the
+   * smallest buffer that fits is preferred, if none fits the largest one
+   * grows. The pool must outlive the lease.
+   * @param width Canvas width
+   * @param height Canvas height
+   * @return Lease of the canvas
+   */
+  Lease acquire(int width, int height);
+  [[nodiscard]] std::size_t idleCount() const;
+  [[nodiscard]] Stats getStats() const;
+  /**
+   * Report the memory held by the idle canvases.
+   * @return Bytes and allocations of their framebuffers
+   */
+  [[nodiscard]] MemoryReport getMemoryReport() const;
+
+private:
+  struct IdleCanvas {
+    std::unique_ptr<FrameBufferCanvas> canvas;
+    // Key it is charged to the budget with, new every time it goes idle
+    uint64_t id;
+  };
+
+  std::size_t maxIdle;
+  MemoryBudget* budget;
+  mutable std::mutex mutex;
+  std::vector<IdleCanvas> idle;
+  uint64_t nextId = 0;
+  Stats stats;
+
+  void release(std::unique_ptr<FrameBufferCanvas> canvas);
+  void evictEntry(uint64_t key) override;
+};
+
+#endif //CANVASPOOL_H
@@ -0,0 +1,222 @@
+#include "Compositor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "utils/Cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PETITE_X86_SIMD 1
+#endif
+
+namespace {
+constexpr int LINEAR_MAX = (1 << LINEAR_BITS) - 1;
+// Channels in the largest block (32 pixels, AVX2)
+constexpr int MAX_BLOCK_CHANNELS = 32 * 3;
+
+/**
+ * Scale coverage so that (diff << 3) * alpha >> 16 == diff * coverage / 255.
+ * 255 maps to 8192 so full coverage reproduces the blended value exactly.
+ */
+int16_t toAlpha(const uint8_t coverage) {
+  return static_cast<int16_t>((coverage * 257 + 4) >> 3);
+}
+
+int blendChannel(const int s, const int d, const BlendMode mode) {
+  switch (mode) {
+    case BlendMode::Multiply:
+      return (s << 4) * d >> 16;
+    case BlendMode::Screen:
+      return s + d - ((s << 4) * d >> 16);
+    default:
+      return s;
+  }
+}
+
+// Same arithmetic as the SIMD kernels so every path gives identical pixels
+int mixChannel(const int s, const int d, const int16_t alpha,
+               const BlendMode mode) {
+  const int b = blendChannel(s, d, mode);
+  return d + (((b - d) << 3) * alpha >> 16);
+}
+
+#ifndef PETITE_X86_SIMD
+/**
+ * Blend linear channels in place: d = d + (mode(s, d) - d) * alpha.
+ * @param d Destination channels, replaced by the result
+ * @param a Alpha per channel
+ * @param s Source channels
+ * @param count Number of channels
+ * @param mode Blend mode
+ */
+void blendScalar(int16_t* d, const int16_t* a, const int16_t* s,
+                 const int count, const BlendMode mode) {
+  for (int i = 0; i < count; ++i) {
+    d[i] = static_cast<int16_t>(mixChannel(s[i], d[i], a[i], mode));
+  }
+}
+#else
+void blendSse2(int16_t* d, const int16_t* a, const int16_t* s,
+               const int count, const BlendMode mode) {
+  for (int i = 0; i < count; i += 8) {
+    const auto vd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+    const auto va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    const auto vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    auto vb = vs;
+    if (mode != BlendMode::SrcOver) {
+      const auto product = _mm_mulhi_epu16(_mm_slli_epi16(vs, 4), vd);
+      vb = mode == BlendMode::Multiply
+             ? product
+             : _mm_sub_epi16(_mm_add_epi16(vs, vd), product);
+    }
+    const auto diff = _mm_slli_epi16(_mm_sub_epi16(vb, vd), 3);
+    const auto out = _mm_add_epi16(vd, _mm_mulhi_epi16(diff, va));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), out);
+  }
+}
+
+__attribute__((target("avx2"))) void blendAvx2(
+    int16_t* d, const int16_t* a, const int16_t* s, const int count,
+    const BlendMode mode) {
+  for (int i = 0; i < count; i += 16) {
+    const auto vd = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(d + i));
+    const auto va = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(a + i));
+    const auto vs = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(s + i));
+    auto vb = vs;
+    if (mode != BlendMode::SrcOver) {
+      const auto product = _mm256_mulhi_epu16(_mm256_slli_epi16(vs, 4), vd);
+      vb = mode == BlendMode::Multiply
+             ? product
+             : _mm256_sub_epi16(_mm256_add_epi16(vs, vd), product);
+    }
+    const auto diff = _mm256_slli_epi16(_mm256_sub_epi16(vb, vd), 3);
+    const auto out = _mm256_add_epi16(vd, _mm256_mulhi_epi16(diff, va));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), out);
+  }
+}
+#endif
+
+struct Kernel {
+  void (*blend)(int16_t*, const int16_t*, const int16_t*, int, BlendMode);
+  // Pixels per block
+  int blockSize;
+};
+
+Kernel selectKernel() {
+#ifdef PETITE_X86_SIMD
+  if (getCpuFeatures().avx2) return {blendAvx2, 32};
+  return {blendSse2, 16};
+#else
+  return {blendScalar, 16};
+#endif
+}
+
+bool isAll(const uint8_t* coverage, const int n, const uint8_t value) {
+  return std::all_of(coverage, coverage + n,
+                     [&](const uint8_t c) { return c == value; });
+}
+}
+
+const GammaTables& getGammaTables() {
+  static const GammaTables tables = [] {
+    GammaTables t{};
+    for (int i = 0; i < 256; ++i) {
+      const double c = i / 255.0;
+      const double linear = c <= 0.04045
+                              ? c / 12.92
+                              : std::pow((c + 0.055) / 1.055, 2.4);
+      t.toLinear[i] = static_cast<uint16_t>(std::lround(linear * LINEAR_MAX));
+    }
+    for (int i = 0; i <= LINEAR_MAX; ++i) {
+      const double l = static_cast<double>(i) / LINEAR_MAX;
+      const double c = l <= 0.0031308
+                         ? l * 12.92
+                         : 1.055 * std::pow(l, 1 / 2.4) - 0.055;
+      t.toSrgb[i] = static_cast<uint8_t>(std::lround(c * 255));
+    }
+    return t;
+  }();
+  return tables;
+}
+
+void compositeRow(RGB* dst, const uint8_t* coverage, const int n,
+                  const RGB color, const BlendMode mode) {
+  static const Kernel kernel = selectKernel();
+  const auto& gamma = getGammaTables();
+
+  // Source channels repeat every 3 values, which divides every block size
+  alignas(32) int16_t src[MAX_BLOCK_CHANNELS];
+  const uint8_t channels[] = {color.r, color.g, color.b};
+  for (int i = 0; i < MAX_BLOCK_CHANNELS; ++i) {
+    src[i] = static_cast<int16_t>(gamma.toLinear[channels[i % 3]]);
+  }
+
+  alignas(32) int16_t lin[MAX_BLOCK_CHANNELS];
+  alignas(32) int16_t alpha[MAX_BLOCK_CHANNELS];
+  const int block = kernel.blockSize;
+  int x = 0;
+  for (; x + block <= n; x += block) {
+    const auto* cov = coverage + x;
+    if (isAll(cov, block, 0)) continue;
+    if (mode == BlendMode::SrcOver && isAll(cov, block, 255)) {
+      std::fill(dst + x, dst + x + block, color);
+      continue;
+    }
+    auto* bytes = reinterpret_cast<uint8_t*>(dst + x);
+    for (int i = 0; i < block * 3; ++i) {
+      lin[i] = static_cast<int16_t>(gamma.toLinear[bytes[i]]);
+      alpha[i] = toAlpha(cov[i / 3]);
+    }
+    kernel.blend(lin, alpha, src, block * 3, mode);
+    for (int i = 0; i < block * 3; ++i) bytes[i] = gamma.toSrgb[lin[i]];
+  }
+
+  // Remaining pixels
+  for (; x < n; ++x) {
+    if (coverage[x] == 0) continue;
+    auto* bytes = reinterpret_cast<uint8_t*>(dst + x);
+    const auto a = toAlpha(coverage[x]);
+    for (int c = 0; c < 3; ++c) {
+      bytes[c] = gamma.toSrgb[mixChannel(src[c], gamma.toLinear[bytes[c]], a,
+                                         mode)];
+    }
+  }
+}
+
+void fillRow(RGB* dst, const int n, const RGB color, const BlendMode mode) {
+  if (mode == BlendMode::SrcOver) {
+    std::fill(dst, dst + n, color);
+    return;
+  }
+  const auto& gamma = getGammaTables();
+  const int src[] = {gamma.toLinear[color.r], gamma.toLinear[color.g],
+                     gamma.toLinear[color.b]};
+  const auto a = toAlpha(255);
+  for (int x = 0; x < n; ++x) {
+    auto* bytes = reinterpret_cast<uint8_t*>(dst + x);
+    for (int c = 0; c < 3; ++c) {
+      bytes[c] = gamma.toSrgb[mixChannel(src[c], gamma.toLinear[bytes[c]], a,
+                                         mode)];
+    }
+  }
+}
+
+void compositeRgbaRow(RGB* dst, const uint8_t* rgba, const int n,
+                      const BlendMode mode) {
+  const auto& gamma = getGammaTables();
+  for (int x = 0; x < n; ++x) {
+    const auto* src = rgba + x * 4;
+    if (src[3] == 0) continue;
+    auto* bytes = reinterpret_cast<uint8_t*>(dst + x);
+    const auto a = toAlpha(src[3]);
+    for (int c = 0; c < 3; ++c) {
+      bytes[c] = gamma.toSrgb[mixChannel(gamma.toLinear[src[c]],
+                                         gamma.toLinear[bytes[c]], a, mode)];
+    }
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+#include <cstdint>
+#include <vector>
+
+#include "utils/Color.h"
+
+enum class BlendMode {
+  // Source color over the destination
+  SrcOver,
+  // Source times destination, darkens
+  Multiply,
+  // Inverse of multiplying the inverses, lightens
+  Screen,
+};
+
+/**
+ * 8-bit coverage of a rectangular area placed on the canvas.
+ */
+struct CoverageMask {
+  int left = 0;
+  int top = 0;
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> data;
+};
+
+// Linear-light values are stored with this many bits
+constexpr int LINEAR_BITS = 12;
+
+struct GammaTables {
+  // sRGB byte to linear-light
+  uint16_t toLinear[256];
+  // Linear-light to sRGB byte
+  uint8_t toSrgb[1 << LINEAR_BITS];
+};
+
+/**
+ * Get the sRGB <-> linear-light lookup tables, built on first use.
+ * @return Gamma tables
+ */
+const GammaTables& getGammaTables();
+
+/**
+ * Composite a row of coverage values onto pixels with the source color.
+ * The blend happens in linear light: each channel is decoded through the
+ * gamma table, mixed with the blend mode's result by coverage and encoded
+ * back. Blocks of 16 (SSE2) or 32 (AVX2) pixels are blended at a time, and
+ * blocks without coverage are skipped.
+ * @param dst Destination pixels
+ * @param coverage Coverage per pixel, 255 is fully covered
+ * @param n Number of pixels
+ * @param color Source color
+ * @param mode Blend mode
+ */
+void compositeRow(RGB* dst, const uint8_t* coverage, int n, RGB color,
+                  BlendMode mode);
+
+/**
+ * Composite fully covered pixels with the source color, the same as
+ * compositeRow with a coverage of 255. Source-over becomes a plain fill.
+ * @param dst Destination pixels
+ * @param n Number of pixels
+ * @param color Source color
+ * @param mode Blend mode
+ */
+void fillRow(RGB* dst, int n, RGB color, BlendMode mode);
+
+/**
+ * Composite a row of straight-alpha RGBA pixels onto pixels, each with its
+ * own color. Blends in linear light like compositeRow, one pixel at a time.
+ * @param dst Destination pixels
+ * @param rgba Source pixels, 4 bytes each
+ * @param n Number of pixels
+ * @param mode Blend mode
+ */
+void compositeRgbaRow(RGB* dst, const uint8_t* rgba, int n, BlendMode mode);
+
+#endif //COMPOSITOR_H
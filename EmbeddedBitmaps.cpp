@@ -0,0 +1,291 @@
+#include "EmbeddedBitmaps.h"
+
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "ImageReader.h"
+#include "utils/ByteReader.h"
+
+namespace {
+// Size of a BitmapSize record of the location table
+constexpr std::size_t BITMAP_SIZE_RECORD = 48;
+
+BitmapMetrics readSmallMetrics(ByteReader& reader) {
+  BitmapMetrics m;
+  m.height = reader.readUint8();
+  m.width = reader.readUint8();
+  m.bearingX = reader.readInt8();
+  m.bearingY = reader.readInt8();
+  m.advance = reader.readUint8();
+  return m;
+}
+
+BitmapMetrics readBigMetrics(ByteReader& reader) {
+  auto m = readSmallMetrics(reader);
+  // Skip the vertical metrics
+  reader.skipBytes(3);
+  return m;
+}
+
+/**
+ * Expand packed 1, 2, 4 or 8-bit pixels to 8-bit coverage.
+ * @param data Packed pixels, most significant bits first
+ * @param metrics Bitmap size
+ * @param bitDepth Bits per pixel
+ * @param byteAligned Whether every row starts on a byte boundary
+ * @return Coverage, width x height bytes
+ */
+std::vector<uint8_t> expandPixels(const std::span<const uint8_t> data,
+                                  const BitmapMetrics& metrics,
+                                  const int bitDepth, const bool byteAligned) {
+  const std::size_t rowBits = static_cast<std::size_t>(metrics.width) *
+                              bitDepth;
+  const std::size_t rowStride = byteAligned ? (rowBits + 7) / 8 * 8 : rowBits;
+  if (metrics.height > 0 &&
+      (metrics.height - 1) * rowStride + rowBits > data.size() * 8) {
+    throw std::runtime_error("EBDT: truncated bitmap");
+  }
+  const int maxValue = (1 << bitDepth) - 1;
+  std::vector<uint8_t> pixels(static_cast<std::size_t>(metrics.width) *
+                              metrics.height);
+  auto* out = pixels.data();
+  for (std::size_t y = 0; y < metrics.height; ++y) {
+    for (std::size_t x = 0; x < metrics.width; ++x) {
+      const std::size_t bit = y * rowStride + x * bitDepth;
+      const int v = data[bit / 8] >> (8 - bitDepth - bit % 8) & maxValue;
+      *out++ = static_cast<uint8_t>(v * 255 / maxValue);
+    }
+  }
+  return pixels;
+}
+
+/**
+ * Binary search a sorted array of big-endian glyph codes.
+ * @param reader Reader placed at the first element
+ * @param count Number of elements
+ * @param elementSize Bytes between elements, the code comes first
+ * @param glyphCode Glyph code to find
+ * @return Index of the glyph, nullopt if missing
+ */
+std::optional<uint32_t> findGlyph(ByteReader& reader, const uint32_t count,
+                                  const std::size_t elementSize,
+                                  const uint16_t glyphCode) {
+  const auto base = reader.tell();
+  uint32_t low = 0;
+  uint32_t high = count;
+  while (low < high) {
+    const auto mid = low + (high - low) / 2;
+    reader.jumpTo(base + mid * elementSize);
+    const auto code = reader.readUint16();
+    if (code == glyphCode) return mid;
+    if (code < glyphCode) low = mid + 1;
+    else high = mid;
+  }
+  return std::nullopt;
+}
+}
+
+EmbeddedBitmaps::EmbeddedBitmaps(const std::span<const uint8_t> font_,
+                                 const uint32_t locationOffset,
+                                 const uint32_t dataOffset) : font(font_) {
+  ByteReader reader(font.data(), font.size());
+  reader.jumpTo(locationOffset + 4); // skip version
+  const auto numSizes = reader.readUint32();
+  for (uint32_t i = 0; i < numSizes; ++i) {
+    reader.jumpTo(locationOffset + 8 + i * BITMAP_SIZE_RECORD);
+    const auto arrayOffset = locationOffset + reader.readUint32();
+    reader.skipBytes(4); // indexTablesSize
+    const auto numSubTables = reader.readUint32();
+    // Skip colorRef, the line metrics and the glyph range
+    reader.skipBytes(4 + 24 + 4);
+    BitmapStrike strike;
+    strike.ppemX = reader.readUint8();
+    strike.ppemY = reader.readUint8();
+    strike.bitDepth = reader.readUint8();
+
+    for (uint32_t j = 0; j < numSubTables; ++j) {
+      reader.jumpTo(arrayOffset + j * 8);
+      BitmapIndexSubTable sub;
+      sub.firstGlyph = reader.readUint16();
+      sub.lastGlyph = reader.readUint16();
+      reader.jumpTo(arrayOffset + reader.readUint32());
+      sub.indexFormat = reader.readUint16();
+      sub.imageFormat = reader.readUint16();
+      sub.imageDataOffset = dataOffset + reader.readUint32();
+      sub.formatDataOffset = static_cast<uint32_t>(reader.tell());
+      if (sub.indexFormat == 2 || sub.indexFormat == 5) {
+        sub.imageSize = reader.readUint32();
+        sub.metrics = readBigMetrics(reader);
+      }
+      if (sub.firstGlyph <= sub.lastGlyph) strike.subTables.push_back(sub);
+    }
+    strikes.push_back(std::move(strike));
+  }
+}
+
+const BitmapStrike* EmbeddedBitmaps::findStrike(const float pixelsPerEm) const {
+  const float size = std::round(pixelsPerEm);
+  if (std::fabs(pixelsPerEm - size) > 0.01f) return nullptr;
+  for (const auto& strike : strikes) {
+    if (strike.ppemY == size) return &strike;
+  }
+  return nullptr;
+}
+
+std::optional<GlyphBitmap> EmbeddedBitmaps::getGlyphBitmap(
+    const BitmapStrike& strike, const uint16_t glyphCode) const {
+  const BitmapIndexSubTable* sub = nullptr;
+  for (const auto& s : strike.subTables) {
+    if (glyphCode >= s.firstGlyph && glyphCode <= s.lastGlyph) {
+      sub = &s;
+      break;
+    }
+  }
+  if (!sub) return std::nullopt;
+
+  // Locate the image in the data table
+  ByteReader reader(font.data(), font.size());
+  reader.jumpTo(sub->formatDataOffset);
+  const uint32_t index = glyphCode - sub->firstGlyph;
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  switch (sub->indexFormat) {
+  case 1: {
+    reader.skipBytes(index * 4);
+    offset = reader.readUint32();
+    length = reader.readUint32() - offset;
+    break;
+  }
+  case 3: {
+    reader.skipBytes(index * 2);
+    offset = reader.readUint16();
+    length = reader.readUint16() - offset;
+    break;
+  }
+  case 2:
+    offset = index * sub->imageSize;
+    length = sub->imageSize;
+    break;
+  case 4: {
+    const auto numGlyphs = reader.readUint32();
+    // Pairs of glyph code and offset, with one more pair for the end
+    const auto found = findGlyph(reader, numGlyphs, 4, glyphCode);
+    if (!found) return std::nullopt;
+    // The reader stopped after the glyph code of the pair
+    offset = reader.readUint16();
+    reader.skipBytes(2);
+    length = reader.readUint16() - offset;
+    break;
+  }
+  case 5: {
+    reader.skipBytes(4 + 8); // imageSize and metrics, already read
+    const auto numGlyphs = reader.readUint32();
+    const auto found = findGlyph(reader, numGlyphs, 2, glyphCode);
+    if (!found) return std::nullopt;
+    offset = *found * sub->imageSize;
+    length = sub->imageSize;
+    break;
+  }
+  default:
+    return std::nullopt;
+  }
+  // A zero length marks a glyph without an image
+  if (length == 0 || length > font.size()) return std::nullopt;
+
+  reader.jumpTo(sub->imageDataOffset + offset);
+  const auto end = reader.tell() + length;
+  GlyphBitmap bitmap;
+  bool byteAligned = false;
+  bool png = false;
+  switch (sub->imageFormat) {
+  case 1:
+    byteAligned = true;
+    [[fallthrough]];
+  case 2:
+    bitmap.metrics = readSmallMetrics(reader);
+    break;
+  case 5:
+    bitmap.metrics = sub->metrics;
+    break;
+  case 6:
+    byteAligned = true;
+    [[fallthrough]];
+  case 7:
+    bitmap.metrics = readBigMetrics(reader);
+    break;
+  case 17:
+    bitmap.metrics = readSmallMetrics(reader);
+    png = true;
+    break;
+  case 18:
+    bitmap.metrics = readBigMetrics(reader);
+    png = true;
+    break;
+  case 19:
+    bitmap.metrics = sub->metrics;
+    png = true;
+    break;
+  default:
+    // Formats 8 and 9 are made of other glyphs' bitmaps
+    return std::nullopt;
+  }
+
+  if (png) {
+    auto image = decodePng(reader.readBytes(reader.readUint32()));
+    if (image.width != bitmap.metrics.width ||
+        image.height != bitmap.metrics.height) {
+      throw std::runtime_error("CBDT: image size differs from the metrics");
+    }
+    bitmap.channels = 4;
+    bitmap.pixels = std::move(image.rgba);
+  } else {
+    const auto depth = strike.bitDepth;
+    if (depth != 1 && depth != 2 && depth != 4 && depth != 8) {
+      return std::nullopt;
+    }
+    if (end < reader.tell()) throw std::runtime_error("EBDT: truncated image");
+    bitmap.pixels = expandPixels(reader.readBytes(end - reader.tell()),
+                                 bitmap.metrics, strike.bitDepth,
+                                 byteAligned);
+  }
+  return bitmap;
+}
+
+std::shared_ptr<const GlyphBitmap> EmbeddedBitmaps::getCachedGlyphBitmap(
+    const BitmapStrike& strike, const uint16_t glyphCode) const {
+  const auto key = static_cast<uint32_t>(&strike - strikes.data()) << 16 |
+                   glyphCode;
+  {
+    std::shared_lock lock(cache->mutex);
+    const auto it = cache->bitmaps.find(key);
+    if (it != cache->bitmaps.end()) return it->second;
+  }
+  // Decode outside of the lock, the first insertion wins
+  std::shared_ptr<const GlyphBitmap> bitmap;
+  if (auto decoded = getGlyphBitmap(strike, glyphCode)) {
+    bitmap = std::make_shared<const GlyphBitmap>(std::move(*decoded));
+  }
+  std::unique_lock lock(cache->mutex);
+  return cache->bitmaps.try_emplace(key, std::move(bitmap)).first->second;
+}
+
+bool EmbeddedBitmaps::isEmpty() const {
+  return strikes.empty();
+}
+
+MemoryUsage EmbeddedBitmaps::getMemoryUsage() const {
+  auto usage = ::getMemoryUsage(strikes);
+  for (const auto& s : strikes) usage += ::getMemoryUsage(s.subTables);
+  std::shared_lock lock(cache->mutex);
+  usage += ::getMemoryUsage(cache->bitmaps);
+  for (const auto& [key, bitmap] : cache->bitmaps) {
+    if (!bitmap) continue;
+    // make_shared puts the bitmap and the reference counts in one block
+    usage += MemoryUsage{allocationSize(sizeof(GlyphBitmap) +
+                                        2 * sizeof(void*)), 1};
+    usage += ::getMemoryUsage(bitmap->pixels);
+  }
+  return usage;
+}
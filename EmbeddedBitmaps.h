@@ -0,0 +1,120 @@
+#pragma once
+#ifndef EMBEDDEDBITMAPS_H
+#define EMBEDDEDBITMAPS_H
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/Memory.h"
+
+// Pre-rendered glyph images of the EBLC/EBDT (monochrome and grayscale) and
+// CBLC/CBDT (color PNG) tables. Both pairs share the same layout: the
+// location table lists strikes, one per pixel size, each split in index
+// subtables that map glyph ranges to images in the data table.
+// https://learn.microsoft.com/en-us/typography/opentype/spec/eblc
+
+/**
+ * Placement of a bitmap in pixels, relative to the pen on the baseline.
+ */
+struct BitmapMetrics {
+  uint8_t height = 0;
+  uint8_t width = 0;
+  // Left edge of the bitmap from the pen
+  int8_t bearingX = 0;
+  // Top edge of the bitmap above the baseline
+  int8_t bearingY = 0;
+  uint8_t advance = 0;
+};
+
+struct GlyphBitmap {
+  BitmapMetrics metrics;
+  // 1 for coverage, 4 for straight-alpha RGBA
+  int channels = 1;
+  std::vector<uint8_t> pixels;
+};
+
+/**
+ * Glyph range of a strike whose images share one location format.
+ */
+struct BitmapIndexSubTable {
+  uint16_t firstGlyph;
+  uint16_t lastGlyph;
+  uint16_t indexFormat;
+  uint16_t imageFormat;
+  // File offset of the first image
+  uint32_t imageDataOffset;
+  // File offset of the format-specific data after the subtable header
+  uint32_t formatDataOffset;
+  // Size of every image, formats 2 and 5
+  uint32_t imageSize = 0;
+  // Shared metrics, formats 2 and 5
+  BitmapMetrics metrics;
+};
+
+struct BitmapStrike {
+  uint8_t ppemX;
+  uint8_t ppemY;
+  // Bits per pixel, 32 for color strikes
+  uint8_t bitDepth;
+  std::vector<BitmapIndexSubTable> subTables;
+};
+
+class EmbeddedBitmaps {
+public:
+  EmbeddedBitmaps() = default;
+  /**
+   * Index the strikes of a location table. Only the small headers are read,
+   * images are decoded on request.
+   * @param font_ Font data, must outlive this object
+   * @param locationOffset File offset of the EBLC or CBLC table
+   * @param dataOffset File offset of the EBDT or CBDT table
+   */
+  EmbeddedBitmaps(std::span<const uint8_t> font_, uint32_t locationOffset,
+                  uint32_t dataOffset);
+  /**
+   * Find the strike drawn at a pixel size. Bitmaps are never scaled, so only
+   * a whole pixel size that a strike was made for matches.
+   * @param pixelsPerEm Pixels per em of the rendering
+   * @return Strike, nullptr if there is none for this size
+   */
+  [[nodiscard]] const BitmapStrike* findStrike(float pixelsPerEm) const;
+  /**
+   * Decode the image of a glyph in a strike.
+   * @param strike Strike from findStrike
+   * @param glyphCode Glyph code
+   * @return Bitmap, nullopt if the strike has no image for the glyph or
+   * stores it in an unsupported format
+   */
+  [[nodiscard]] std::optional<GlyphBitmap> getGlyphBitmap(
+      const BitmapStrike& strike, uint16_t glyphCode) const;
+  /**
+   * Get the image of a glyph in a strike, decoding it on first use. Glyphs
+   * without an image are remembered as well. Safe to call from several
+   * threads.
+   * @param strike Strike from findStrike
+   * @param glyphCode Glyph code
+   * @return Shared bitmap, nullptr like getGlyphBitmap's nullopt
+   */
+  [[nodiscard]] std::shared_ptr<const GlyphBitmap> getCachedGlyphBitmap(
+      const BitmapStrike& strike, uint16_t glyphCode) const;
+  [[nodiscard]] bool isEmpty() const;
+  [[nodiscard]] MemoryUsage getMemoryUsage() const;
+
+private:
+  struct BitmapCache {
+    std::shared_mutex mutex;
+    // Keyed by strike index << 16 | glyph code
+    std::unordered_map<uint32_t, std::shared_ptr<const GlyphBitmap>> bitmaps;
+  };
+
+  std::span<const uint8_t> font;
+  std::vector<BitmapStrike> strikes;
+  // Behind a pointer so the object stays movable
+  std::unique_ptr<BitmapCache> cache = std::make_unique<BitmapCache>();
+};
+
+#endif //EMBEDDEDBITMAPS_H
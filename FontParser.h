@@ -1,12 +1,19 @@
 #pragma once
 #ifndef FONTPARSER_H
 #define FONTPARSER_H
-#include <fstream>
 #include <map>
+#include <memory>
+#include <shared_mutex>
+#include <span>
 #include <unordered_map>
+#include <vector>
 #include <glm/glm.hpp>
 
+#include "EmbeddedBitmaps.h"
 #include "Glyph.h"
+#include "MemoryBudget.h"
+#include "utils/ByteReader.h"
+#include "utils/MappedFile.h"
 
 
 #endif  // FONTPARSER_H
@@ -30,50 +37,183 @@ struct FontMetric {
 class FontParser {
 public:
   explicit FontParser(const std::string& path);
+  ~FontParser();
+  /**
+   * Charge the outline cache to a memory budget shared with other caches,
+   * which then evicts outlines when it is over its limit. Glyphs already
+   * cached are charged right away. Not safe to call while other threads
+   * use the parser.
+   * @param budget_ Budget, or nullptr to detach. It must outlive the parser
+   * or be detached first.
+   */
+  void setMemoryBudget(MemoryBudget* budget_);
+  /**
+   * Give the glyphs of the outline cache a simplified outline, drawn instead
+   * of the full one at small sizes, see Glyph::getLevelOfDetail. Off by
+   * default. Glyphs already cached are dropped, so every cached glyph
+   * follows the setting. Not safe to call while other threads use the
+   * parser.
+   * @param enabled Whether to simplify
+   */
+  void setLevelOfDetail(bool enabled);
   /**
    * Get general metrics for font.
    * @return FontMetric that has ascent and descent of font
    */
-  FontMetric getFontMetric();
+  [[nodiscard]] FontMetric getFontMetric() const;
   /**
    * Get glyphs and required rendering width from Unicode codepoints.
    * @param cps Vector of Unicode codepoints
    * @param scale Scaling value of glyph size
    * @return Pair of Glyphs and necessary width for rendering
    */
-  std::pair<std::vector<Glyph>, int> getGlyphs(std::vector<uint32_t> cps,
-                                               float scale);
+  std::pair<std::vector<Glyph>, int> getGlyphs(
+      const std::vector<uint32_t>& cps, float scale) const;
   /**
-   * Get glyph by Unicode.
+   * Get glyph by Unicode. Throws std::invalid_argument if the font has no
+   * glyph for the codepoint.
    * @param cp Unicode codepoint
    * @return Glyph
    */
-  Glyph getGlyph(uint32_t cp);
+  [[nodiscard]] Glyph getGlyph(uint32_t cp) const;
+  /**
+   * Get glyph by glyph code.
+   *
+   * @param glyphCode Glyph code
+   * @return Glyph
+   */
+  [[nodiscard]] Glyph getGlyphByCode(uint16_t glyphCode) const;
+  /**
+   * Get a glyph from the outline cache, decoding it on first use. With
+   * setLevelOfDetail, cached glyphs carry a simplified outline, built when
+   * first drawn up to LOD_MAX_PIXELS_PER_EM, that canvases draw instead if
+   * it saves enough points.
+   * Safe to call from several threads, the returned glyph stays valid after
+   * the parser is destroyed.
+   * @param glyphCode Glyph code
+   * @return Shared glyph
+   */
+  [[nodiscard]] std::shared_ptr<const Glyph> getCachedGlyph(
+      uint16_t glyphCode) const;
+  /**
+   * Decode a set of glyphs into the outline cache in one sweep over the
+   * glyf table. Duplicates, cached glyphs and invalid codes are skipped.
+   * The glyphs and the components of compound glyphs are read in file
+   * order after asking the kernel to read their byte ranges ahead, so a
+   * cold page costs a few sequential reads instead of a seek per glyph.
+   * Opt-in: for a font that fits the kernel's own read-ahead this is no
+   * faster than decoding lazily, it pays off on large fonts on slow storage.
+   * Safe to call from several threads.
+   * @param glyphCodes Glyphs about to be rendered, in any order
+   * @return Number of glyphs decoded
+   */
+  std::size_t prefetchGlyphs(std::span<const uint16_t> glyphCodes) const;
+  /**
+   * Get the glyph code of a Unicode codepoint without decoding the glyph.
+   * @param cp Unicode codepoint
+   * @return Glyph code, 0 (the missing glyph) if the font has none
+   */
+  [[nodiscard]] uint16_t getGlyphCode(uint32_t cp) const;
+  /**
+   * Get horizontal metrics of a glyph.
+   * @param glyphCode Glyph code
+   * @return Metric, all zero if the glyph has none
+   */
+  [[nodiscard]] Metric getMetric(uint16_t glyphCode) const;
+  /**
+   * Get the size of the em square.
+   * @return Font units per em, from the head table
+   */
+  [[nodiscard]] uint16_t getUnitsPerEm() const;
+  /**
+   * Get the embedded bitmap strikes, from CBLC/CBDT if the font has color
+   * bitmaps, else from EBLC/EBDT.
+   * @return Strikes, empty if the font has none
+   */
+  [[nodiscard]] const EmbeddedBitmaps& getEmbeddedBitmaps() const;
+  /**
+   * Get the number of glyphs in the font.
+   * @return Number of glyphs, valid glyph codes are below this
+   */
+  [[nodiscard]] uint16_t getNumOfGlyphs() const;
+  /**
+   * Report the memory used by the parser's structures.
+   * Computed from sizes only, so it is cheap to call periodically.
+   * @return Bytes and allocations per structure
+   */
+  [[nodiscard]] MemoryReport getMemoryReport() const;
 
 private:
-  std::ifstream ifs;
+  // Immutable after construction, shared by all readers
+  MappedFile file;
   std::map<std::string, Tag> directory;
   std::unordered_map<uint32_t, uint16_t> unicodeToGlyphCode;
   std::unordered_map<uint16_t, uint32_t> glyphCodeToOffset;
+  // Bytes of outline data of each glyph, indexed by glyph code
+  std::vector<uint32_t> glyphLengths;
   std::unordered_map<uint16_t, Metric> glyphMetric;
+  uint16_t unitsPerEm = 0;
+  EmbeddedBitmaps bitmaps;
+  // Decoded outlines, filled lazily by getCachedGlyph
+  mutable std::shared_mutex glyphCacheMutex;
+  mutable std::unordered_map<uint16_t, std::shared_ptr<const Glyph>>
+  glyphCache;
+  // Heap owned by the cached glyphs, updated on insertion and eviction
+  mutable MemoryUsage glyphCacheUsage;
+  MemoryBudget* budget = nullptr;
+  bool levelOfDetail = false;
+
+  /**
+   * Evicts from the outline cache for the budget, the cache itself is
+   * filled by const methods.
+   */
+  class BudgetClient : public MemoryBudget::Client {
+  public:
+    explicit BudgetClient(const FontParser& parser_) : parser(parser_) {
+    }
 
-  // stream helper methods
-  void skipBytes(unsigned bytes);
-  void jumpTo(unsigned byteOffset);
-  /**
-   * Read data from stream.
-   * @tparam T Target type
-   * @return Read value
-   */
-  template <class T>
-  T readBeOrThrow();
-  uint8_t readUint8();
-  uint16_t readUint16();
-  uint32_t readUint32();
-  int8_t readInt8();
-  int16_t readInt16();
-  int32_t readInt32();
-  float readF2Dot14();
+  private:
+    const FontParser& parser;
+
+    void evictEntry(const uint64_t key) override {
+      parser.evictCachedGlyph(static_cast<uint16_t>(key));
+    }
+  };
+
+  mutable BudgetClient budgetClient{*this};
+
+  /**
+   * Create a read cursor at the beginning of the font data.
+   * Cursors are cheap and independent, so every call gets its own.
+   * @return Reader
+   */
+  [[nodiscard]] ByteReader makeReader() const;
+  /**
+   * Decode a glyph for the outline cache, with simplification enabled.
+   * @param glyphCode Glyph code
+   * @return Shared glyph
+   */
+  [[nodiscard]] std::shared_ptr<const Glyph> decodeCachedGlyph(
+      uint16_t glyphCode) const;
+  /**
+   * Add a decoded glyph to the outline cache unless a racing thread added
+   * it first. glyphCacheMutex must be held exclusively.
+   * @param glyphCode Glyph code
+   * @param glyph Decoded glyph, replaced by the cached one if it was first
+   * @return Whether the glyph was added
+   */
+  bool insertCachedGlyph(uint16_t glyphCode,
+                         std::shared_ptr<const Glyph>& glyph) const;
+  /**
+   * Charge a cached glyph to the budget, if there is one. glyphCacheMutex
+   * must not be held, the budget may evict from this cache.
+   */
+  void chargeCachedGlyph(uint16_t glyphCode, const Glyph& glyph) const;
+  /**
+   * Drop a glyph from the outline cache, renderers holding it keep it.
+   * @param glyphCode Glyph code
+   */
+  void evictCachedGlyph(uint16_t glyphCode) const;
 
   // Initializer methods
   /**
@@ -93,59 +233,70 @@ private:
    * https://developer.apple.com/fonts/TrueType-Reference-Manual/RM06/Chap6cmap.html
    */
   void loadUnicodeToGlyphCodeMap();
+  /**
+   * Index the embedded bitmap strikes if the font has any.
+   */
+  void loadEmbeddedBitmaps();
 
   // Glyph related methods
   /**
-   * Read glyph header data.
+   * Read glyph header data and leave the reader after it.
+   * @param reader Read cursor
    * @param glyphCode Glyph code
    * @return GlyphHeader data
    */
-  GlyphHeader readGlyphHeader(uint16_t glyphCode);
-  /**
-   * Get glyph by glyph code.
-   *
-   * @param glyphCode Glyph code
-   * @return Glyph
-   */
-  Glyph getGlyphByCode(uint16_t glyphCode);
+  GlyphHeader readGlyphHeader(ByteReader& reader, uint16_t glyphCode) const;
   /**
-   * Get glyph components for the compound glyph.
+   * Append the glyph components of a component of a compound glyph.
    * A compound glyph can have multiple components,
    * which can be either simple glyph structure or another compound glyph.
    * @param glyphCode Glyph code
    * @param affineMat 3x3 matrix for affine transformation
-   * @return Vector of the glyph components
+   * @param components Vector the components are moved into
    */
-  std::vector<GlyphComponent> getCompoundSubComponents(
+  void appendCompoundSubComponents(
       uint16_t glyphCode,
-      const glm::mat3& affineMat);
+      const glm::mat3& affineMat,
+      std::vector<GlyphComponent>& components) const;
   /**
    * Get a single glyph component.
+   * @param reader Read cursor placed after the glyph header
+   * @param glyphCode Glyph the component is read from
    * @param numOfContours number of contours of the target component
    * @param boundingRect bounding rectangle of the target component
    * @param affineMat 3x3 matrix for affine transformation
    * @return Glyph component
    */
   GlyphComponent getGlyphComponent(
+      ByteReader& reader,
+      uint16_t glyphCode,
       short numOfContours,
       ::BoundingRect boundingRect,
       const glm::mat3& affineMat = glm::mat3(
-          1.0f));
-  /**
-   * Get coordinates for a glyph.
-   * @param n Number of vertices
-   * @param flags Flags
-   * @param isX is for X coordinate
-   * @return vector of coordinates
-   */
-  std::vector<int> getGlyphCoordinates(const uint16_t& n,
-                                       const std::vector<uint8_t>& flags,
-                                       bool isX);
+          1.0f)) const;
   /**
    * Get compound glyph.
    * ARGS_ARE_XY_VALUES, ROUND_XY_TO_GRID, WE_HAVE_INSTRUCTIONS, OVERLAP_COMPOUND
    * are not supported.
+   * @param reader Read cursor placed after the glyph header
+   * @param glyphCode Glyph code of the compound glyph
    * @return Glyph
    */
-  Glyph getCompoundGlyph();
+  Glyph getCompoundGlyph(ByteReader& reader, uint16_t glyphCode) const;
+  /**
+   * Read the components of a compound glyph without building a Glyph.
+   * @param reader Read cursor placed after the glyph header
+   * @param glyphCode Glyph code of the compound glyph
+   * @param components Vector the components are moved into
+   * @return Metric of the glyph, or of the component with USE_MY_METRICS
+   */
+  Metric readCompoundComponents(ByteReader& reader, uint16_t glyphCode,
+                                std::vector<GlyphComponent>& components) const;
+  /**
+   * Read the glyph codes a compound glyph refers to, without decoding them.
+   * @param reader Read cursor placed after the glyph header
+   * @param codes Receives the component glyph codes
+   */
+  static void readComponentCodes(ByteReader& reader,
+                                 std::vector<uint16_t>& codes);
 };
@@ -1,23 +1,70 @@
 #include "FrameBufferCanvas.h"
-#include <stb_image_write.h>
 
 #include <algorithm>
-#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <memory>
 #include <span>
-#include <unordered_map>
 #include <glm/glm.hpp>
 
 #include "GlyphComponent.h"
+#include "Stroker.h"
 #include "utils/Debug.h"
 
 
 FrameBufferCanvas::FrameBufferCanvas(const int width_,
                                      const int height_) :
-  width(width_), height(height_) {
-  framebuffer = std::make_unique<RGB[]>(width * height);
+  width(width_), height(height_),
+  capacity(static_cast<std::size_t>(width_) * height_),
+  clipRect{0, 0, width_, height_} {
+  // Value-initialized, so the pixels start out black
+  framebuffer = std::make_unique<RGB[]>(capacity);
   transformMat = glm::mat3(1, 0, 0, 0, -1, 0, 0, 0, 1);
-  for (int i = 0; i < width * height; ++i) framebuffer[i] = BLACK;
+}
+
+void FrameBufferCanvas::reset(const int width_, const int height_) {
+  const auto pixels = static_cast<std::size_t>(width_) * height_;
+  if (pixels > capacity) {
+    framebuffer = std::make_unique<RGB[]>(pixels);
+    capacity = pixels;
+    dirtyRect = PixelRect{};
+    invalidate();
+  } else {
+    // Cleared with the old layout, the rest of the buffer is black already
+    clear();
+  }
+  width = width_;
+  height = height_;
+  scale = 1;
+  transformMat = glm::mat3(1, 0, 0, 0, -1, 0, 0, 0, 1);
+  clipRect = PixelRect{0, 0, width, height};
+}
+
+void FrameBufferCanvas::clear() {
+  invalidate();
+  const auto& r = dirtyRect;
+  if (r.isEmpty()) return;
+  if (r.left == 0 && r.right == width) {
+    // Whole rows are one contiguous block
+    std::memset(framebuffer.get() + static_cast<std::size_t>(r.top) * width,
+                0, static_cast<std::size_t>(r.bottom - r.top) * width *
+                   sizeof(RGB));
+  } else {
+    for (int y = r.top; y < r.bottom; ++y) {
+      std::memset(framebuffer.get() + static_cast<std::size_t>(y) * width +
+                  r.left, 0, static_cast<std::size_t>(r.right - r.left) *
+                             sizeof(RGB));
+    }
+  }
+  dirtyRect = PixelRect{};
+}
+
+std::size_t FrameBufferCanvas::getCapacity() const {
+  return capacity;
+}
+
+void FrameBufferCanvas::markDirty(const PixelRect& rect) {
+  dirtyRect = dirtyRect.unite(rect);
 }
 
 void FrameBufferCanvas::set(const int x,
@@ -28,6 +75,7 @@ void FrameBufferCanvas::set(const int x,
   const std::size_t i = static_cast<std::size_t>(y) * static_cast<std::size_t>(
                           width) + static_cast<std::size_t>(x);
   framebuffer[i] = color;
+  markDirty(PixelRect{x, y, x + 1, y + 1});
 }
 
 void FrameBufferCanvas::drawLine(int ax, int ay, int bx, int by,
@@ -110,299 +158,449 @@ void FrameBufferCanvas::renderGlyphOutline(const Glyph& glyph,
                                            const RGB color,
                                            const int startX,
                                            const int thickness) {
+  // Stroke in font units so the fill goes through the same transform
+  const Stroker stroker(
+      StrokeStyle{static_cast<float>(thickness) / scale, LineJoin::Miter},
+      FLATTEN_TOLERANCE / scale);
+  renderGlyphByNonZero(stroker.stroke(glyph), color, startX);
+
+  transformMat[2][0] = startX;
   for (const auto& c : glyph.getComponents()) {
     const auto rectSize = thickness * 2;
     uint16_t contourStartPt = 0;
+    std::size_t contour = 0;
     const auto n = c.getNumOfVertices();
     const auto coordinates = c.getCoordinates();
     const auto endPtsOfContours = c.getEndPtsOfContours();
-    const auto ptsOnCurve = c.getPtsOnCurve();
-
-    transformMat[2][0] = startX;
 
-    // Cache of point vectors of vertices
-    std::unordered_map<int, glm::vec2> points;
     for (int i = 0; i < n; ++i) {
-      // Convert coordinate system from bottom-up to top-down
-      points[i] = transformVec2(scale * transformMat, coordinates[i]);
-    }
-
-    auto prevPt = glm::vec2(0.f);
-    for (int i = 0; i < n; ++i) {
-      const auto isEndPt = endPtsOfContours.contains(i);
+      const auto isEndPt = contour < endPtsOfContours.size() &&
+                           endPtsOfContours[contour] == i;
       const auto nextIdx = isEndPt ? contourStartPt : (i + 1) % n;
-      const auto isOnCurve = ptsOnCurve.contains(i);
-      const auto isNextOnCurve = ptsOnCurve.contains(nextIdx);
+      const auto isOnCurve = c.isOnCurve(i);
       // Convert coordinate system from bottom-up to top-down
-      auto currentPt = points[i];
-      auto nextPt = points[nextIdx];
-
-      if (isOnCurve) {
-        if (isNextOnCurve) {
-          drawLine(currentPt, nextPt, thickness, color);
-        }
-        prevPt = currentPt;
-      } else {
-        // Control point
-        if (!isNextOnCurve) {
-          // Calculate the implicit next "on-curve" from the middle point of next control point
-          nextPt = (currentPt + nextPt);
-          nextPt /= 2;
-        }
-        drawBezier(prevPt, currentPt, nextPt, thickness, color);
-        // Draw implicit next on-curve point
-        drawRect(nextPt, rectSize, rectSize, BLUE);
-        prevPt = nextPt;
+      const auto currentPt = transformVec2(scale * transformMat,
+                                           coordinates[i]);
+      if (!isOnCurve && !c.isOnCurve(nextIdx)) {
+        // Mark the implicit on-curve point between two control points
+        const auto nextPt = transformVec2(scale * transformMat,
+                                          coordinates[nextIdx]);
+        drawRect((currentPt + nextPt) / 2.0f, rectSize, rectSize, BLUE);
       }
       drawRect(currentPt, rectSize, rectSize, isOnCurve ? RED : GREEN);
-      if (isEndPt) contourStartPt = i + 1;
+      if (isEndPt) {
+        contourStartPt = i + 1;
+        ++contour;
+      }
     }
   }
 }
 
+template <FillRule Rule, class Coverage, class Target>
+void FrameBufferCanvas::rasterizeGlyph(const Glyph& glyph, const float startX,
+                                       const float offsetY,
+                                       const Target& target,
+                                       RasterScratch& scratch) const {
+  // Skip glyphs entirely outside the canvas
+  const auto area = getGlyphPixelRect(glyph, startX, offsetY);
+  if (area.isEmpty()) return;
+  buildGlyphEdges(glyph.getLevelOfDetail(scale),
+                  getGlyphTransform(startX, offsetY),
+                  FLATTEN_TOLERANCE / Coverage::SAMPLES, scratch);
+  if (engine == RasterEngine::SparseStrips) {
+    // A single glyph has too few strips to be worth threads
+    rasterizeTiles<Rule, Coverage>(std::span(&scratch.edges, 1), area,
+                                   target);
+  } else {
+    rasterizeEdges<Rule, Coverage>(scratch.edges, area, target, scratch);
+  }
+}
+
+void FrameBufferCanvas::batchGlyph(const Glyph& glyph, const float startX,
+                                   const float offsetY, const int samples,
+                                   std::vector<std::vector<Edge>>& shapes,
+                                   PixelRect& area) const {
+  const auto rect = getGlyphPixelRect(glyph, startX, offsetY);
+  if (rect.isEmpty()) return;
+  shapes.push_back(buildGlyphEdges(glyph.getLevelOfDetail(scale),
+                                   getGlyphTransform(startX, offsetY),
+                                   FLATTEN_TOLERANCE / samples));
+  area = area.unite(rect);
+}
+
 void FrameBufferCanvas::renderGlyphByEvenOdd(const Glyph& glyph,
                                              const RGB color,
                                              const int startX) {
-  const auto start = std::chrono::high_resolution_clock::now();
+  markDirty(getGlyphPixelRect(glyph, startX));
+  rasterizeGlyph<FillRule::EvenOdd, Aliased>(
+      glyph, startX, 0, RgbTarget{framebuffer.get(), width, color},
+      rasterScratch);
+}
 
-  // Loop for each glyph components
-  for (const auto& c : glyph.getComponents()) {
-    const auto n = c.getNumOfVertices();
-    const auto coordinates = c.getCoordinates();
-    const auto endPtsOfContours = c.getEndPtsOfContours();
-    const auto ptsOnCurve = c.getPtsOnCurve();
+void FrameBufferCanvas::setGlyphBaseline(const int baseline) {
+  transformMat[2][1] += baseline;
+}
 
-    transformMat[2][0] = startX;
+namespace {
+const Glyph& asGlyph(const Glyph& glyph) {
+  return glyph;
+}
 
-    // Cache of point vectors of vertices
-    std::unordered_map<int, glm::vec2> points;
-    for (int i = 0; i < n; ++i) {
-      // Convert coordinate system from bottom-up to top-down
-      points[i] = transformVec2(scale * transformMat, coordinates[i]);
+const Glyph& asGlyph(const std::shared_ptr<const Glyph>& glyph) {
+  return *glyph;
+}
+}
+
+void FrameBufferCanvas::renderGlyphs(const std::vector<Glyph>& glyphs) {
+  renderGlyphLine(glyphs);
+}
+
+void FrameBufferCanvas::renderGlyphs(
+    const std::span<const std::shared_ptr<const Glyph>> glyphs) {
+  renderGlyphLine(glyphs);
+}
+
+template <class Glyphs>
+void FrameBufferCanvas::renderGlyphLine(const Glyphs& glyphs) {
+  if (engine == RasterEngine::SparseStrips) {
+    std::vector<std::vector<Edge>> shapes;
+    PixelRect area;
+    int xPos = 0;
+    for (const auto& g : glyphs) {
+      const auto& glyph = asGlyph(g);
+      batchGlyph(glyph, xPos, 0, Aliased::SAMPLES, shapes, area);
+      xPos += glyph.getMetric().advanceWidth;
     }
+    markDirty(area);
+    rasterizeTiles<FillRule::NonZero, Aliased>(
+        shapes, area, RgbTarget{framebuffer.get(), width, RGB{255}},
+        numThreads);
+    return;
+  }
+  int xPos = 0;
+  for (const auto& g : glyphs) {
+    const auto& glyph = asGlyph(g);
+    renderGlyphByNonZero(glyph, RGB{255}, xPos);
+    xPos += glyph.getMetric().advanceWidth;
+  }
+}
 
-    // Loop for each scanline
-    auto rayStart = glm::vec2(0, 0);
-    auto rayEnd = glm::vec2(width, 0);
-    for (int y = 0; y < height; ++y) {
-      rayStart.y = rayEnd.y = static_cast<float>(y);
-      std::vector<int> intersections;
-      uint16_t contourStartPt = 0;
-      auto prevPt = glm::vec2(0.f);
-      // Loop for each vertex
-      for (int i = 0; i < n; ++i) {
-        const auto isEndPt = endPtsOfContours.contains(i);
-        const auto nextIdx = isEndPt ? contourStartPt : (i + 1) % n;
-        const auto isOnCurve = ptsOnCurve.contains(i);
-        const auto isNextOnCurve = ptsOnCurve.contains(nextIdx);
-        auto currentPt = points[i];
-        auto nextPt = points[nextIdx];
-
-        if (isOnCurve) {
-          if (isNextOnCurve) {
-            // on curve - on curve: Straight line
-            const auto s = segmentsIntersect(
-                currentPt, nextPt, rayStart, rayEnd);
-            const auto minY = static_cast<int>(std::min(currentPt.y, nextPt.y));
-            if (s && minY < y) {
-              intersections.emplace_back(static_cast<int>(s.value().x));
-            }
-          }
-          prevPt = currentPt;
-        } else {
-          // not on curve: Control point
-          if (!isNextOnCurve) {
-            // Calculate the implicit next "on-curve" from the middle point of next control point
-            nextPt = (currentPt + nextPt);
-            nextPt /= 2;
-          }
-          const auto ss = segmentQuadBezierIntersect(
-              prevPt,
-              currentPt,
-              nextPt,
-              rayStart,
-              rayEnd
-              );
-          const auto minY = getBezierMinY(prevPt, currentPt, nextPt);
-
-          if (ss.size() == 2 &&
-              !isBezierConvexUpwards(prevPt, currentPt, nextPt)) {
-            if (y == static_cast<int>(prevPt.x) || y == static_cast<int>(nextPt.
-                  x)) {
-              if (static_cast<int>(ss[0].x) == static_cast<int>(prevPt.x)) {
-                intersections.emplace_back(static_cast<int>(ss[1].x));
-              } else {
-                intersections.emplace_back(static_cast<int>(ss[0].x));
-              }
-            }
-          } else if (minY < y) {
-            for (const auto s : ss) {
-              intersections.emplace_back(static_cast<int>(s.x));
-            }
-          }
-          prevPt = nextPt;
+void FrameBufferCanvas::renderGlyphsIncremental(
+    const std::vector<Glyph>& glyphs,
+    const RGB color,
+    const RGB background) {
+  renderGlyphsIncremental(glyphs, color,
+                          [background](FrameBufferCanvas& canvas,
+                                       const PixelRect& rect) {
+                            canvas.fillRect(rect, background);
+                          });
+}
+
+void FrameBufferCanvas::renderGlyphsIncremental(
+    const std::vector<Glyph>& glyphs,
+    const RGB color,
+    const ClearDamage& clearDamage) {
+  std::vector<GlyphCell> cells;
+  int xPos = 0;
+  for (const auto& glyph : glyphs) {
+    cells.emplace_back(glyph.getGlyphCode(), xPos, color,
+                       getGlyphPixelRect(glyph, xPos));
+    xPos += glyph.getMetric().advanceWidth;
+  }
+
+  // Collect the areas of the cells that changed since the previous frame
+  std::vector<PixelRect> damage;
+  if (!hasPrevFrame) {
+    damage.emplace_back(0, 0, width, height);
+  } else {
+    for (std::size_t i = 0; i < std::max(cells.size(), prevCells.size()); ++i) {
+      const bool hasPrev = i < prevCells.size();
+      const bool hasCurrent = i < cells.size();
+      if (hasPrev && hasCurrent && prevCells[i] == cells[i]) continue;
+      auto rect = PixelRect{};
+      if (hasPrev) rect = rect.unite(prevCells[i].rect);
+      if (hasCurrent) rect = rect.unite(cells[i].rect);
+      if (!rect.isEmpty()) damage.emplace_back(rect);
+    }
+  }
+
+  // Merge overlapping rects so that no pixel is redrawn twice
+  for (bool merged = true; merged;) {
+    merged = false;
+    for (std::size_t i = 0; i < damage.size() && !merged; ++i) {
+      for (std::size_t j = i + 1; j < damage.size(); ++j) {
+        if (damage[i].intersects(damage[j])) {
+          damage[i] = damage[i].unite(damage[j]);
+          damage.erase(damage.begin() + static_cast<long>(j));
+          merged = true;
+          break;
         }
-        if (isEndPt) contourStartPt = i + 1;
       }
+    }
+  }
 
-      std::sort(intersections.begin(), intersections.end());
-      int cnt = 0;
-      int prevX = 0;
-      for (const auto x : intersections) {
-        if (cnt % 2 == 1) {
-          drawLine(prevX, y, x, y, 1, color);
-        }
-        cnt++;
-        prevX = x;
+  for (const auto& rect : damage) {
+    clipRect = rect;
+    clearDamage(*this, rect);
+    for (std::size_t i = 0; i < glyphs.size(); ++i) {
+      if (cells[i].rect.intersects(rect)) {
+        renderGlyphByNonZero(glyphs[i], color, cells[i].startX);
       }
     }
   }
-  const auto end = std::chrono::high_resolution_clock::now();
-  const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-      end - start);
-  std::wcout << "Evenodd glyph rendering tooks: " << duration.count() <<
-      " ms\n";
+  clipRect = PixelRect{0, 0, width, height};
+
+  prevCells = std::move(cells);
+  hasPrevFrame = true;
 }
 
-void FrameBufferCanvas::setGlyphBaseline(const int baseline) {
-  transformMat[2][1] += baseline;
+void FrameBufferCanvas::invalidate() {
+  prevCells.clear();
+  hasPrevFrame = false;
 }
 
-void FrameBufferCanvas::renderGlyphs(const std::vector<Glyph>& glyphs) {
-  int xPos = 0;
-  for (const auto& glyph : glyphs) {
-    renderGlyphByNonZero(glyph, RGB{255}, xPos);
-    xPos += glyph.getMetric().advanceWidth;
+PixelRect FrameBufferCanvas::getGlyphPixelRect(const Glyph& glyph,
+                                               const float startX,
+                                               const float offsetY) const {
+  if (glyph.getComponents().empty()) return PixelRect{};
+  const auto rect = transformBoundingRect(getGlyphTransform(startX, offsetY),
+                                          glyph.getBoundingRect());
+  return PixelRect{rect.xMin, rect.yMin, rect.xMax, rect.yMax}.
+      intersect(clipRect);
+}
+
+glm::mat3 FrameBufferCanvas::getGlyphTransform(const float startX,
+                                               const float offsetY) const {
+  auto mat = transformMat;
+  mat[2][0] = startX;
+  // y is flipped, so moving the glyph up moves it towards the top row
+  mat[2][1] -= offsetY;
+  return scale * mat;
+}
+
+void FrameBufferCanvas::fillRect(const PixelRect& rect, const RGB color) {
+  const auto r = rect.intersect(PixelRect{0, 0, width, height});
+  markDirty(r);
+  for (int y = r.top; y < r.bottom; ++y) {
+    const auto row = framebuffer.get() + static_cast<std::size_t>(y) * width;
+    std::fill(row + r.left, row + r.right, color);
   }
 }
 
 void FrameBufferCanvas::renderGlyphByNonZero(const Glyph& glyph,
                                              const RGB color,
                                              const int startX) {
-  const auto start = std::chrono::high_resolution_clock::now();
+  markDirty(getGlyphPixelRect(glyph, startX));
+  rasterizeGlyph<FillRule::NonZero, Aliased>(
+      glyph, startX, 0, RgbTarget{framebuffer.get(), width, color},
+      rasterScratch);
+}
 
-  // Loop for each glyph components
-  for (const auto& c : glyph.getComponents()) {
-    const auto n = c.getNumOfVertices();
-    const auto coordinates = c.getCoordinates();
-    const auto endPtsOfContours = c.getEndPtsOfContours();
-    const auto ptsOnCurve = c.getPtsOnCurve();
-    const auto rect = c.getBoundingRect();
+void FrameBufferCanvas::renderGlyphComposited(const Glyph& glyph,
+                                              const RGB color,
+                                              const int startX,
+                                              const BlendMode mode) {
+  markDirty(getGlyphPixelRect(glyph, startX));
+  rasterizeGlyph<FillRule::NonZero, Supersampled<SUPERSAMPLE>>(
+      glyph, startX, 0, RgbTarget{framebuffer.get(), width, color, mode},
+      rasterScratch);
+}
 
-    transformMat[2][0] = startX;
+void FrameBufferCanvas::renderGlyphRun(const FontParser& font,
+                                       const GlyphRun& run) {
+  renderGlyphRun(font, run, nullptr);
+}
 
-    // Cache of point vectors of vertices
-    std::unordered_map<int, glm::vec2> points;
-    for (int i = 0; i < n; ++i) {
-      // Convert coordinate system from bottom-up to top-down
-      points[i] = transformVec2(scale * transformMat, coordinates[i]);
-    }
-    auto rayStart = glm::vec2(0, 0);
-    auto rayEnd = glm::vec2(width, 0);
-
-    // Transform the coordinate of the bounding rect
-    const auto top = transformVec2(
-        scale * transformMat, glm::vec2(0, rect.yMax)).y;
-    const auto bottom = transformVec2(
-        scale * transformMat, glm::vec2(0, rect.yMin)).y;
-    for (int y = top; y < bottom; ++y) {
-      rayStart.y = rayEnd.y = static_cast<float>(y);
-      std::vector<Intersection> intersections;
-      uint16_t contourStartPt = 0;
-      auto prevPt = glm::vec2{0, 0};
-      // Loop for each vertex
-      for (int i = 0; i < n; ++i) {
-        const auto isEndPt = endPtsOfContours.contains(i);
-        const auto nextIdx = isEndPt ? contourStartPt : (i + 1) % n;
-        const auto isOnCurve = ptsOnCurve.contains(i);
-        const auto isNextOnCurve = ptsOnCurve.contains(nextIdx);
-        auto currentPt = points[i];
-        auto nextPt = points[nextIdx];
-
-        if (isOnCurve) {
-          if (isNextOnCurve) {
-            // on curve - on curve: Straight line
-            const auto s = segmentsIntersect(
-                currentPt, nextPt, rayStart, rayEnd);
-            const auto minY = static_cast<int>(std::min(currentPt.y, nextPt.y));
-            if (s && minY < y) {
-              intersections.emplace_back(
-                  static_cast<int>(s.value().x),
-                  currentPt.y > nextPt.y
-                  );
-            }
-          }
-          prevPt = currentPt;
-        } else {
-          // not on curve: Control point
-          if (!isNextOnCurve) {
-            // Calculate the implicit next "on-curve" from the middle point of next control point
-            nextPt = (currentPt + nextPt);
-            nextPt /= 2;
-          }
-          // bezier line
-          const auto ss = segmentQuadBezierIntersect(
-              prevPt,
-              currentPt,
-              nextPt,
-              rayStart,
-              rayEnd
-              );
-
-          const auto minY = getBezierMinY(prevPt, currentPt, nextPt);
-          if (minY < y) {
-            if (ss.size() == 1) {
-              intersections.emplace_back(static_cast<int>(ss[0].x),
-                                         prevPt.y > nextPt.y);
-            } else if (ss.size() == 2) {
-              auto nearestX = [&](const glm::vec2& pt) -> int {
-                return static_cast<int>((std::fabs(pt.x - ss[0].x) <
-                                         std::fabs(pt.x - ss[1].x))
-                                          ? ss[0].x
-                                          : ss[1].x);
-              };
-              const int closeXtoCur = nearestX(prevPt);
-              const int closeXtoNxt = nearestX(nextPt);
-              const auto convexUpwards = isBezierConvexUpwards(
-                  prevPt, currentPt, nextPt);
-              intersections.emplace_back(closeXtoCur, convexUpwards);
-              intersections.emplace_back(closeXtoNxt, !convexUpwards);
-            }
-          }
-          prevPt = nextPt;
-        }
-        if (isEndPt) contourStartPt = i + 1;
+void FrameBufferCanvas::renderGlyphRun(const FontParser& font,
+                                       const GlyphRun& run,
+                                       GlyphRasterCache& cache) {
+  renderGlyphRun(font, run, &cache);
+}
+
+void FrameBufferCanvas::renderGlyphRun(const FontParser& font,
+                                       const GlyphRun& run,
+                                       GlyphRasterCache* cache) {
+  const RgbTarget target{framebuffer.get(), width, run.color, run.mode};
+  // Outlines waiting for one draw of the sparse strip engine
+  std::vector<std::vector<Edge>> batch;
+  PixelRect batchArea;
+  const auto flush = [&] {
+    markDirty(batchArea);
+    rasterizeTiles<FillRule::NonZero, Supersampled<SUPERSAMPLE>>(
+        batch, batchArea, target, numThreads);
+    batch.clear();
+    batchArea = PixelRect{};
+  };
+  const auto& bitmaps = font.getEmbeddedBitmaps();
+  const auto* strike = bitmaps.isEmpty()
+                         ? nullptr
+                         : bitmaps.findStrike(scale * font.getUnitsPerEm());
+  for (const auto& g : run.glyphs) {
+    if (strike) {
+      if (const auto bitmap = bitmaps.getCachedGlyphBitmap(*strike,
+                                                           g.glyphCode)) {
+        // Keep the draw order of overlapping glyphs
+        if (!batch.empty()) flush();
+        blitGlyphBitmap(*bitmap, g.x, g.y, run.color, run.mode);
+        continue;
       }
+    }
+    if (cache) {
+      const auto pen = transformVec2(getGlyphTransform(g.x, g.y),
+                                     glm::vec2(0, 0));
+      const auto steps = static_cast<int>(
+        std::floor(pen.x * SUBPIXEL_STEPS + 0.5f));
+      const int penX = steps >= 0
+                         ? steps / SUBPIXEL_STEPS
+                         : (steps - SUBPIXEL_STEPS + 1) / SUBPIXEL_STEPS;
+      const auto& mask = cache->getMask(font, g.glyphCode, scale,
+                                        steps - penX * SUBPIXEL_STEPS);
+      compositeRleMask(mask, penX, static_cast<int>(std::lround(pen.y)),
+                       run.color, run.mode);
+      continue;
+    }
+    const auto glyph = font.getCachedGlyph(g.glyphCode);
+    if (engine == RasterEngine::SparseStrips) {
+      batchGlyph(*glyph, g.x, g.y, SUPERSAMPLE, batch, batchArea);
+      continue;
+    }
+    markDirty(getGlyphPixelRect(*glyph, g.x, g.y));
+    rasterizeGlyph<FillRule::NonZero, Supersampled<SUPERSAMPLE>>(
+        *glyph, g.x, g.y, target, rasterScratch);
+  }
+  if (!batch.empty()) flush();
+}
+
+void FrameBufferCanvas::blitGlyphBitmap(const GlyphBitmap& bitmap,
+                                        const float startX,
+                                        const float offsetY,
+                                        const RGB color,
+                                        const BlendMode mode) {
+  const auto pen = transformVec2(getGlyphTransform(startX, offsetY),
+                                 glm::vec2(0, 0));
+  const auto& m = bitmap.metrics;
+  const int left = static_cast<int>(std::lround(pen.x)) + m.bearingX;
+  const int top = static_cast<int>(std::lround(pen.y)) - m.bearingY;
+  if (bitmap.channels == 1) {
+    compositeCoverage(bitmap.pixels.data(), left, top, m.width, m.height,
+                      color, mode);
+    return;
+  }
+  const auto r = PixelRect{left, top, left + m.width, top + m.height}.
+      intersect(clipRect);
+  if (r.isEmpty()) return;
+  markDirty(r);
+  for (int y = r.top; y < r.bottom; ++y) {
+    const auto* src = bitmap.pixels.data() +
+                      (static_cast<std::size_t>(y - top) * m.width +
+                       (r.left - left)) * 4;
+    auto* row = framebuffer.get() + static_cast<std::size_t>(y) * width;
+    compositeRgbaRow(row + r.left, src, r.right - r.left, mode);
+  }
+}
 
-      std::sort(intersections.begin(), intersections.end(),
-                [](const Intersection& a, const Intersection& b) {
-                  return a.x < b.x;
-                });
-      int prevCount = 0;
-      int prevX = 0;
-      int count = 0;
-      for (const auto& [x, isUpward] : intersections) {
-        isUpward ? ++count : --count;
-        if (prevCount > 0 && count >= 0) {
-          drawLine(prevX, y, x, y, 1, color);
+CoverageMask FrameBufferCanvas::renderGlyphMask(const Glyph& glyph,
+                                                const int startX) const {
+  const auto rect = getGlyphPixelRect(glyph, startX);
+  CoverageMask mask{rect.left, rect.top, rect.right - rect.left,
+                    rect.bottom - rect.top, {}};
+  mask.data.resize(static_cast<std::size_t>(mask.width) * mask.height);
+  // Const, so it can't borrow the canvas buffers
+  RasterScratch scratch;
+  rasterizeGlyph<FillRule::NonZero, Supersampled<SUPERSAMPLE>>(
+      glyph, startX, 0, MaskTarget{mask}, scratch);
+  return mask;
+}
+
+void FrameBufferCanvas::compositeMask(const CoverageMask& mask,
+                                      const RGB color,
+                                      const BlendMode mode) {
+  compositeCoverage(mask.data.data(), mask.left, mask.top, mask.width,
+                    mask.height, color, mode);
+}
+
+void FrameBufferCanvas::compositeCoverage(const uint8_t* coverage,
+                                          const int left, const int top,
+                                          const int w, const int h,
+                                          const RGB color,
+                                          const BlendMode mode) {
+  const auto r = PixelRect{left, top, left + w, top + h}.intersect(clipRect);
+  if (r.isEmpty()) return;
+  markDirty(r);
+  for (int y = r.top; y < r.bottom; ++y) {
+    const auto* src = coverage + static_cast<std::size_t>(y - top) * w +
+                      (r.left - left);
+    auto* row = framebuffer.get() + static_cast<std::size_t>(y) * width;
+    compositeRow(row + r.left, src, r.right - r.left, color, mode);
+  }
+}
+
+void FrameBufferCanvas::compositeRleMask(const RleMask& mask, const int penX,
+                                         const int penY, const RGB color,
+                                         const BlendMode mode) {
+  const int left = penX + mask.left;
+  const int top = penY + mask.top;
+  if (mask.isDense()) {
+    compositeCoverage(mask.coverage.data(), left, top, mask.width,
+                      mask.height, color, mode);
+    return;
+  }
+
+  markDirty(PixelRect{left, top, left + mask.width, top + mask.height}.
+      intersect(clipRect));
+  const int bottom = std::min(clipRect.bottom, top + mask.height);
+  const auto* span = mask.spans.data();
+  const auto* coverage = mask.coverage.data();
+  for (int y = top; y < bottom; ++y) {
+    const auto* rowEnd = span + mask.rowSpans[y - top];
+    if (y < clipRect.top) {
+      // Rows above the clip only advance the cursors
+      for (; span != rowEnd; ++span) {
+        if (!span->solid) coverage += span->length;
+      }
+      continue;
+    }
+    auto* row = framebuffer.get() + static_cast<std::size_t>(y) * width;
+    for (; span != rowEnd; ++span) {
+      const int x = left + span->x;
+      const int x0 = std::max(clipRect.left, x);
+      const int x1 = std::min(clipRect.right, x + span->length);
+      if (x0 < x1) {
+        if (span->solid) {
+          fillRow(row + x0, x1 - x0, color, mode);
+        } else {
+          compositeRow(row + x0, coverage + (x0 - x), x1 - x0, color, mode);
         }
-        prevCount = count;
-        prevX = x;
       }
+      if (!span->solid) coverage += span->length;
     }
   }
+}
+
+MemoryReport FrameBufferCanvas::getMemoryReport() const {
+  MemoryReport report;
+  report.add("canvas.framebuffer",
+             MemoryUsage{allocationSize(capacity * sizeof(RGB)), 1});
+  report.add("canvas.prevCells", ::getMemoryUsage(prevCells));
+  return report;
+}
 
-  const auto end = std::chrono::high_resolution_clock::now();
-  const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-      end - start);
-  std::wcout << "NonZero glyph rendering tooks: " << duration.count() <<
-      " ms\n";
+void FrameBufferCanvas::writePngFile(const char* fileName,
+                                     const PngOptions& options) const {
+  writePng(fileName, getImageView(), options);
 }
 
-void FrameBufferCanvas::writePngFile(const char* fileName) const {
-  // TrueType uses bottom-to-top coordinate so we need to vertically flip the image
-  stbi_write_png(fileName, width, height, 3,
-                 framebuffer.get(), 0);
+ImageView FrameBufferCanvas::getImageView() const {
+  return ImageView{reinterpret_cast<const uint8_t*>(framebuffer.get()), width,
+                   height, 3};
+}
+
+int FrameBufferCanvas::getWidth() const {
+  return width;
+}
+
+int FrameBufferCanvas::getHeight() const {
+  return height;
 }
 
 void FrameBufferCanvas::drawBezier(const glm::vec2& startPt,
@@ -410,10 +608,9 @@ void FrameBufferCanvas::drawBezier(const glm::vec2& startPt,
                                    const glm::vec2& endPt,
                                    const int thickness,
                                    const RGB color) {
-  // approximate curve length
-  const float approxLen = glm::length(controlPt - startPt) + glm::length(
-                              endPt - controlPt);
-  const int res = std::max(1, static_cast<int>(std::ceil(approxLen)));
+  // Subdivide just enough to stay within the tolerance of the real curve
+  const int res = getQuadBezierSubdivisions(startPt, controlPt, endPt,
+                                            FLATTEN_TOLERANCE);
 
   glm::vec2 last = startPt;
   for (int i = 1; i <= res; ++i) {
@@ -426,4 +623,13 @@ void FrameBufferCanvas::drawBezier(const glm::vec2& startPt,
 
 void FrameBufferCanvas::setScale(float s) {
   scale = s;
-}
\ No newline at end of file
+}
+void FrameBufferCanvas::setRasterEngine(const RasterEngine engine_,
+                                        const unsigned numThreads_) {
+  engine = engine_;
+  numThreads = std::max(1u, numThreads_);
+}
+
+RasterEngine FrameBufferCanvas::getRasterEngine() const {
+  return engine;
+}
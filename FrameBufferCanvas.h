@@ -1,46 +1,77 @@
 #pragma once
 #ifndef FRAMEBUFFERCANVAS_H
 #define FRAMEBUFFERCANVAS_H
-#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <functional>
 #include <memory>
+#include <span>
 #include <glm/glm.hpp>
 
+#include "Compositor.h"
+#include "FontParser.h"
 #include "Glyph.h"
+#include "GlyphRasterCache.h"
+#include "ImageWriter.h"
+#include "Rasterizer.h"
+#include "TileRasterizer.h"
+#include "utils/Color.h"
 
-struct RGB {
-  unsigned char r, g, b;
-  RGB() = default;
+// A glyph placed on the canvas, used to detect changes between frames
+struct GlyphCell {
+  uint16_t glyphCode;
+  int startX;
+  RGB color;
+  PixelRect rect;
 
-  constexpr RGB(const unsigned char r_, const unsigned char g_,
-                const unsigned char b_) : r(r_), g(g_), b(b_) {
-  }
-
-  constexpr explicit RGB(const unsigned char greyscale) : r(greyscale),
-    g(greyscale), b(greyscale) {
-  }
-
-  bool operator==(const RGB& a) const {
-    return r == a.r && g == a.g && b == a.b;
-  }
+  bool operator==(const GlyphCell& c) const = default;
 };
 
-struct Intersection {
-  int x;
-  bool isUpward;
+/**
+ * A glyph of a run in font units from the pen origin: x from the left edge
+ * like startX, y upwards from the baseline. Fractional positions are kept,
+ * so glyphs can sit between pixels.
+ */
+struct RunGlyph {
+  uint16_t glyphCode;
+  float x;
+  float y;
 };
 
-constexpr auto WHITE = RGB{255};
-constexpr auto BLACK = RGB{0};
-constexpr auto RED = RGB{255, 70, 70};
-constexpr auto GREEN = RGB{70, 255, 70};
-constexpr auto BLUE = RGB{70, 70, 255};
+// Pre-positioned glyphs drawn with one color, e.g. the output of a shaper
+struct GlyphRun {
+  std::span<const RunGlyph> glyphs;
+  RGB color = WHITE;
+  BlendMode mode = BlendMode::SrcOver;
+};
 
 constexpr auto WIDTH = 1500;
 constexpr auto HEIGHT = 1500;
+// Maximum distance in pixels between a flattened curve and the real curve
+constexpr auto FLATTEN_TOLERANCE = 0.25f;
+// Anti-aliased glyphs are sampled SUPERSAMPLE x SUPERSAMPLE times per pixel
+constexpr auto SUPERSAMPLE = 4;
 
 class FrameBufferCanvas {
 public:
   explicit FrameBufferCanvas(int width_ = WIDTH, int height_ = HEIGHT);
+  /**
+   * Clear the canvas and change its size, as if it was newly constructed.
+   * Only the area drawn since the last clear is wiped, with memset. The
+   * pixel buffer is reallocated only when the new size needs more pixels
+   * than it holds.
+   * @param width_ New width
+   * @param height_ New height
+   */
+  void reset(int width_, int height_);
+  /**
+   * Clear the pixels drawn since the last clear back to black, keeping the
+   * size and transform. The next incremental render redraws everything.
+   */
+  void clear();
+  /**
+   * Get the number of pixels the buffer holds without reallocating.
+   * @return Capacity in pixels
+   */
+  [[nodiscard]] std::size_t getCapacity() const;
   /**
    * Set one pixel with the given color.
    * @param x Target x position
@@ -105,16 +136,55 @@ public:
    */
   void setGlyphBaseline(int baseline);
   /**
-   * Render glyphs by using non-zero rule.
+   * Render glyphs by using non-zero rule. With the sparse strip engine all
+   * of them are rasterized in one parallel draw.
    * @param glyphs Vector of glyphs to render
    */
   void renderGlyphs(const std::vector<Glyph>& glyphs);
+  /**
+   * Render shared glyphs, such as those of the parser's outline cache, like
+   * renderGlyphs.
+   * @param glyphs Glyphs to render
+   */
+  void renderGlyphs(std::span<const std::shared_ptr<const Glyph>> glyphs);
+  /**
+   * Render glyphs like renderGlyphs, but only re-rasterize the glyph cells
+   * that changed since the previous call. The damaged area (old and new
+   * cells) is cleared and every glyph overlapping it is redrawn clipped to it.
+   * @param glyphs Vector of glyphs to render
+   * @param color Fill color
+   * @param background Color the damaged area is cleared to
+   */
+  void renderGlyphsIncremental(const std::vector<Glyph>& glyphs,
+                               RGB color = WHITE, RGB background = BLACK);
+  /**
+   * Restores the background of a damaged rect before the glyphs over it are
+   * redrawn. Draws on the canvas are clipped to the rect meanwhile.
+   */
+  using ClearDamage = std::function<void(FrameBufferCanvas&,
+                                         const PixelRect&)>;
+  /**
+   * Render glyphs incrementally over a background that isn't a plain color,
+   * for example an overlay composited over an image.
+   * @param glyphs Vector of glyphs to render
+   * @param color Fill color
+   * @param clearDamage Called for every damaged rect before redrawing it
+   */
+  void renderGlyphsIncremental(const std::vector<Glyph>& glyphs, RGB color,
+                               const ClearDamage& clearDamage);
+  /**
+   * Forget the previous frame so the next incremental render redraws
+   * everything.
+   */
+  void invalidate();
   /**
    * Render an outline of the target glyph.
+   * The outline is stroked into polygons and filled once by the non-zero
+   * rasterizer, then the on-curve, control and implicit points are marked.
    * @param glyph Glyph
    * @param color Fill color
    * @param startX
-   * @param thickness
+   * @param thickness Line thickness in pixels
    */
   void renderGlyphOutline(const Glyph& glyph, RGB color, int startX,
                           int thickness);
@@ -132,19 +202,212 @@ public:
    * @param startX
    */
   void renderGlyphByNonZero(const Glyph& glyph, RGB color, int startX);
+  /**
+   * Render a target glyph anti-aliased by non-zero rule and composite it
+   * onto the current pixels with the blend mode.
+   * @param glyph Glyph
+   * @param color Source color
+   * @param startX
+   * @param mode Blend mode
+   */
+  void renderGlyphComposited(const Glyph& glyph, RGB color, int startX,
+                             BlendMode mode = BlendMode::SrcOver);
+  /**
+   * Render a run of pre-positioned glyphs anti-aliased by non-zero rule.
+   * Outlines are read from the parser's glyph cache, no glyph is copied.
+   * When the font has a bitmap strike for the exact pixel size, its images
+   * are blitted instead and the outlines are not touched; glyphs missing
+   * from the strike fall back to their outline. Bitmaps snap to whole
+   * pixels. Color bitmaps keep their own colors.
+   * @param font Font parser the glyph codes belong to
+   * @param run Glyphs, color and blend mode
+   */
+  void renderGlyphRun(const FontParser& font, const GlyphRun& run);
+  /**
+   * Render a run like renderGlyphRun, but blit the glyphs from a raster
+   * cache so each glyph is rasterized once per size and subpixel position.
+   * Pens snap to 1 / SUBPIXEL_STEPS pixels horizontally and to whole pixels
+   * vertically.
+   * @param font Font parser the glyph codes belong to
+   * @param run Glyphs, color and blend mode
+   * @param cache Raster cache, filled on misses
+   */
+  void renderGlyphRun(const FontParser& font, const GlyphRun& run,
+                      GlyphRasterCache& cache);
+  /**
+   * Composite a coverage mask onto the current pixels with the blend mode.
+   * @param mask Coverage mask placed in canvas coordinates
+   * @param color Source color
+   * @param mode Blend mode
+   */
+  void compositeMask(const CoverageMask& mask, RGB color,
+                     BlendMode mode = BlendMode::SrcOver);
+  /**
+   * Composite a run-length encoded mask onto the current pixels. Solid spans
+   * are filled, edge spans composited with their coverage.
+   * @param mask Mask placed relative to the pen
+   * @param penX Pen x position in pixels
+   * @param penY Pen y position in pixels
+   * @param color Source color
+   * @param mode Blend mode
+   */
+  void compositeRleMask(const RleMask& mask, int penX, int penY, RGB color,
+                        BlendMode mode = BlendMode::SrcOver);
+  /**
+   * Render the anti-aliased coverage of a target glyph by non-zero rule.
+   * @param glyph Glyph
+   * @param startX
+   * @return Coverage over the glyph's pixel rect, clipped to clipRect
+   */
+  [[nodiscard]] CoverageMask renderGlyphMask(const Glyph& glyph,
+                                             int startX) const;
   /**
    * Export the framebuffer to a png file.
    * @param fileName File name of the png file
+   * @param options Compression level and parallelism of the encoder
+   */
+  void writePngFile(const char* fileName,
+                    const PngOptions& options = {}) const;
+  /**
+   * Get the framebuffer as an image, valid as long as the canvas is.
+   * @return View of the RGB pixels
+   */
+  [[nodiscard]] ImageView getImageView() const;
+  [[nodiscard]] int getWidth() const;
+  [[nodiscard]] int getHeight() const;
+  /**
+   * Report the memory used by the canvas.
+   * @return Bytes and allocations per structure
+   */
+  [[nodiscard]] MemoryReport getMemoryReport() const;
+  /**
+   * Set the scale from font units to pixels. Glyphs that carry a simplified
+   * outline, like the ones of an outline cache with level of detail enabled,
+   * are drawn from it at small scales, see FontParser::setLevelOfDetail.
+   * @param s Pixels per font unit
    */
-  void writePngFile(const char* fileName) const;
   void setScale(float s);
+  /**
+   * Choose the rasterizer for outlines. Both produce the same pixels. The
+   * sparse strip engine draws whole lines and uncached glyph runs at once,
+   * split over threads, which pays off for large scenes.
+   * @param engine_ Rasterizer
+   * @param numThreads_ Threads a batched draw may use
+   */
+  void setRasterEngine(RasterEngine engine_, unsigned numThreads_ = 1);
+  [[nodiscard]] RasterEngine getRasterEngine() const;
 
 private:
   int width;
   int height;
-  float scale;
+  float scale = 1;
   std::unique_ptr<RGB[]> framebuffer;
+  // Pixels allocated, at least width * height. Everything outside the dirty
+  // rect is black.
+  std::size_t capacity;
+  // Bounds of every pixel written since the last clear
+  PixelRect dirtyRect;
   glm::mat3 transformMat{};
+  // Rasterizers never write outside of this rect
+  PixelRect clipRect;
+  std::vector<GlyphCell> prevCells;
+  bool hasPrevFrame = false;
+  RasterEngine engine = RasterEngine::Scanline;
+  unsigned numThreads = 1;
+  // Reused by every glyph drawn on the canvas
+  RasterScratch rasterScratch;
+
+  /**
+   * Get the pixel rect covered by a glyph placed at startX.
+   * @param glyph Glyph
+   * @param startX
+   * @param offsetY Vertical offset from the baseline in font units, upwards
+   * @return Pixel rect clipped to the canvas, empty if the glyph is culled
+   */
+  [[nodiscard]] PixelRect getGlyphPixelRect(const Glyph& glyph, float startX,
+                                            float offsetY = 0) const;
+  /**
+   * Get the transform from font units to canvas pixels.
+   * @param startX Horizontal position of the glyph in font units
+   * @param offsetY Vertical offset from the baseline in font units, upwards
+   * @return Transform matrix
+   */
+  [[nodiscard]] glm::mat3 getGlyphTransform(float startX,
+                                            float offsetY = 0) const;
+  /**
+   * Rasterize a glyph into the target, limited to clipRect.
+   * @tparam Rule Fill rule
+   * @tparam Coverage Aliased or Supersampled<S>
+   * @param glyph Glyph
+   * @param startX
+   * @param offsetY Vertical offset from the baseline in font units, upwards
+   * @param target Destination pixels
+   * @param scratch Buffers to reuse
+   */
+  template <FillRule Rule, class Coverage, class Target>
+  void rasterizeGlyph(const Glyph& glyph, float startX, float offsetY,
+                      const Target& target, RasterScratch& scratch) const;
+  /**
+   * Render a line of glyphs placed by their advance widths.
+   * @tparam Glyphs Range of Glyph or of std::shared_ptr<const Glyph>
+   * @param glyphs Glyphs to render
+   */
+  template <class Glyphs>
+  void renderGlyphLine(const Glyphs& glyphs);
+  /**
+   * Flatten a glyph into a batch drawn at once by the sparse strip engine.
+   * @param glyph Glyph
+   * @param startX
+   * @param offsetY Vertical offset from the baseline in font units, upwards
+   * @param samples Samples per pixel along each axis
+   * @param shapes Receives the edges of the glyph unless it is culled
+   * @param area Grown to cover the glyph
+   */
+  void batchGlyph(const Glyph& glyph, float startX, float offsetY,
+                  int samples, std::vector<std::vector<Edge>>& shapes,
+                  PixelRect& area) const;
+  /**
+   * Composite an embedded bitmap with its origin at the pen position,
+   * rounded to whole pixels.
+   * @param bitmap Glyph bitmap
+   * @param startX
+   * @param offsetY Vertical offset from the baseline in font units, upwards
+   * @param color Color of coverage bitmaps
+   * @param mode Blend mode
+   */
+  void blitGlyphBitmap(const GlyphBitmap& bitmap, float startX,
+                       float offsetY, RGB color, BlendMode mode);
+  /**
+   * Composite dense 8-bit coverage onto the current pixels, clipped.
+   * @param coverage Rows of coverage, w bytes each
+   * @param left Left edge in canvas pixels
+   * @param top Top edge in canvas pixels
+   * @param w Width in pixels
+   * @param h Height in pixels
+   * @param color Source color
+   * @param mode Blend mode
+   */
+  void compositeCoverage(const uint8_t* coverage, int left, int top, int w,
+                         int h, RGB color, BlendMode mode);
+  /**
+   * Render a run, from the raster cache if there is one.
+   * @param font Font parser the glyph codes belong to
+   * @param run Glyphs, color and blend mode
+   * @param cache Raster cache, or nullptr to rasterize every glyph
+   */
+  void renderGlyphRun(const FontParser& font, const GlyphRun& run,
+                      GlyphRasterCache* cache);
+  /**
+   * Grow the dirty rect to cover pixels about to be written.
+   * @param rect Written pixels, already clipped to the canvas
+   */
+  void markDirty(const PixelRect& rect);
+  /**
+   * Fill a rectangle with the color.
+   * @param rect Target rect
+   * @param color Fill color
+   */
+  void fillRect(const PixelRect& rect, RGB color);
 };
 
 
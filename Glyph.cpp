@@ -1,14 +1,28 @@
 #include "Glyph.h"
 
+#include <algorithm>
 #include <utility>
 
+namespace {
+// A simplified outline is kept when it has at most this share of the points
+constexpr double LOD_MAX_POINTS = 0.875;
+
+std::size_t countPoints(const Glyph& glyph) {
+  std::size_t points = 0;
+  for (const auto& c : glyph.getComponents()) points += c.getNumOfVertices();
+  return points;
+}
+}
+
 Glyph::Glyph(std::vector<GlyphComponent> components_,
-             const Metric metric_) :
+             const Metric metric_,
+             const uint16_t glyphCode_) :
   components(std::move(components_)),
-  metric(metric_) {
+  metric(metric_),
+  glyphCode(glyphCode_) {
 }
 
-const std::vector<GlyphComponent>& Glyph::getComponents() const {
+std::span<const GlyphComponent> Glyph::getComponents() const {
   return components;
 }
 
@@ -16,6 +30,68 @@ const Metric& Glyph::getMetric() const {
   return metric;
 }
 
-Glyph Glyph::EmptyGlyph(const Metric metric_) {
-  return Glyph({}, metric_);
+uint16_t Glyph::getGlyphCode() const {
+  return glyphCode;
+}
+
+BoundingRect Glyph::getBoundingRect() const {
+  if (components.empty()) return BoundingRect{};
+  auto rect = components.front().getBoundingRect();
+  for (const auto& c : components) {
+    const auto r = c.getBoundingRect();
+    rect.xMin = std::min(rect.xMin, r.xMin);
+    rect.xMax = std::max(rect.xMax, r.xMax);
+    rect.yMin = std::min(rect.yMin, r.yMin);
+    rect.yMax = std::max(rect.yMax, r.yMax);
+  }
+  return rect;
+}
+
+MemoryUsage Glyph::getMemoryUsage() const {
+  auto usage = ::getMemoryUsage(components);
+  for (const auto& c : components) usage += c.getMemoryUsage();
+  if (levelOfDetail) {
+    // make_shared puts the state and the reference counts in one block
+    usage += MemoryUsage{allocationSize(sizeof(LevelOfDetail) +
+                                        2 * sizeof(void*)), 1};
+    // Counted whether it was built or not, so the estimate doesn't change
+    // while the glyph is cached. A simplified outline is never larger than
+    // the full one.
+    usage += MemoryUsage{allocationSize(sizeof(Glyph)), 1};
+    usage += ::getMemoryUsage(components);
+    for (const auto& c : components) usage += c.getMemoryUsage();
+  }
+  return usage;
+}
+
+Glyph Glyph::simplify(const float tolerance) const {
+  std::vector<GlyphComponent> simplifiedComponents;
+  simplifiedComponents.reserve(components.size());
+  for (const auto& c : components) {
+    simplifiedComponents.push_back(c.simplify(tolerance));
+  }
+  return Glyph(std::move(simplifiedComponents), metric, glyphCode);
+}
+
+void Glyph::enableLevelOfDetail(const float tolerance) {
+  levelOfDetail = std::make_shared<LevelOfDetail>();
+  levelOfDetail->tolerance = tolerance;
+  levelOfDetail->maxScale = LOD_MAX_ERROR / tolerance;
+}
+
+const Glyph& Glyph::getLevelOfDetail(const float scale) const {
+  if (!levelOfDetail || scale > levelOfDetail->maxScale) return *this;
+  auto& lod = *levelOfDetail;
+  std::call_once(lod.built, [&] {
+    auto simplified = simplify(lod.tolerance);
+    if (const auto points = countPoints(*this);
+        points > 0 && countPoints(simplified) <= points * LOD_MAX_POINTS) {
+      lod.simplified = std::make_unique<const Glyph>(std::move(simplified));
+    }
+  });
+  return lod.simplified ? *lod.simplified : *this;
+}
+
+Glyph Glyph::EmptyGlyph(const Metric metric_, const uint16_t glyphCode_) {
+  return Glyph({}, metric_, glyphCode_);
 }
\ No newline at end of file
@@ -1,8 +1,18 @@
 #pragma once
 #ifndef GLYPH_H
 #define GLYPH_H
+#include <memory>
+#include <mutex>
+
 #include "GlyphComponent.h"
 
+// Largest deviation in pixels of a simplified outline drawn instead of the
+// full one: no point of either outline is further than this from the other.
+constexpr float LOD_MAX_ERROR = 0.125f;
+// Sizes up to which simplified outlines are drawn, in pixels per em. The
+// glyph cache simplifies with the tolerance that gives LOD_MAX_ERROR there.
+constexpr float LOD_MAX_PIXELS_PER_EM = 16;
+
 struct Metric {
   uint16_t advanceWidth;
   int16_t leftSideBearing;
@@ -11,14 +21,60 @@ struct Metric {
 class Glyph {
 public:
   Glyph() = default;
-  explicit Glyph(std::vector<GlyphComponent> components_, Metric metric_);
-  [[nodiscard]] const std::vector<GlyphComponent>& getComponents() const;
+  explicit Glyph(std::vector<GlyphComponent> components_, Metric metric_,
+                 uint16_t glyphCode_ = 0);
+  [[nodiscard]] std::span<const GlyphComponent> getComponents() const;
   [[nodiscard]] const Metric& getMetric() const;
-  static Glyph EmptyGlyph(Metric metric_);
+  [[nodiscard]] uint16_t getGlyphCode() const;
+  /**
+   * Get the bounding rectangle that covers all components.
+   * @return Bounding rect in font units, all zero for an empty glyph
+   */
+  [[nodiscard]] BoundingRect getBoundingRect() const;
+  /**
+   * Estimate the heap memory owned by the glyph and its components.
+   * @return Bytes and allocations
+   */
+  [[nodiscard]] MemoryUsage getMemoryUsage() const;
+  /**
+   * Build a copy with every component simplified, see
+   * GlyphComponent::simplify.
+   * @param tolerance Maximum allowed deviation in font units
+   * @return Simplified glyph without a level of detail of its own
+   */
+  [[nodiscard]] Glyph simplify(float tolerance) const;
+  /**
+   * Draw a simplified outline at small sizes. It is built on the first
+   * getLevelOfDetail call at such a size, and shared by the copies of this
+   * glyph.
+   * @param tolerance Tolerance to simplify with, in font units
+   */
+  void enableLevelOfDetail(float tolerance);
+  /**
+   * Get the outline to rasterize at a scale: the simplified one if it
+   * deviates by at most LOD_MAX_ERROR pixels there and saves enough points,
+   * else this glyph. Safe to call from several threads.
+   * @param scale Pixels per font unit
+   * @return Glyph to rasterize, valid as long as this one
+   */
+  [[nodiscard]] const Glyph& getLevelOfDetail(float scale) const;
+  static Glyph EmptyGlyph(Metric metric_, uint16_t glyphCode_ = 0);
 
 private:
+  struct LevelOfDetail {
+    float tolerance;
+    // Largest scale the simplified outline is drawn at
+    float maxScale;
+    std::once_flag built;
+    // Null if simplifying didn't save enough points
+    std::unique_ptr<const Glyph> simplified;
+  };
+
   std::vector<GlyphComponent> components;
   Metric metric;
+  uint16_t glyphCode = 0;
+  // Simplified outline for small sizes, shared by copies
+  std::shared_ptr<LevelOfDetail> levelOfDetail;
 };
 
 
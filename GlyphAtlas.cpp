@@ -0,0 +1,178 @@
+#include "GlyphAtlas.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "GlyphRasterCache.h"
+
+SkylinePacker::SkylinePacker(const int width_, const int height_) :
+  width(width_), height(height_), skyline{{0, 0, width_}} {
+}
+
+std::optional<int> SkylinePacker::fitAt(const std::size_t segment,
+                                        const int w, const int h) const {
+  const int x = skyline[segment].x;
+  if (x + w > width) return std::nullopt;
+  // The rectangle rests on the highest segment below it
+  int y = 0;
+  int remaining = w;
+  for (auto i = segment; remaining > 0; ++i) {
+    y = std::max(y, skyline[i].y);
+    remaining -= skyline[i].width;
+  }
+  if (y + h > height) return std::nullopt;
+  return y;
+}
+
+std::optional<PixelRect> SkylinePacker::insert(const int w, const int h) {
+  if (w <= 0 || h <= 0) return PixelRect{};
+  std::size_t best = 0;
+  int bestBottom = INT32_MAX;
+  int bestWidth = INT32_MAX;
+  std::optional<PixelRect> rect;
+  for (std::size_t i = 0; i < skyline.size(); ++i) {
+    const auto y = fitAt(i, w, h);
+    if (!y) continue;
+    // Lowest bottom edge first, then the narrowest segment to keep wide
+    // ones for wide glyphs
+    const int bottom = *y + h;
+    if (bottom < bestBottom ||
+        (bottom == bestBottom && skyline[i].width < bestWidth)) {
+      best = i;
+      bestBottom = bottom;
+      bestWidth = skyline[i].width;
+      rect = PixelRect{skyline[i].x, *y, skyline[i].x + w, bottom};
+    }
+  }
+  if (!rect) return std::nullopt;
+
+  // Raise the skyline under the rectangle
+  skyline.insert(skyline.begin() + static_cast<long>(best),
+                 Segment{rect->left, rect->bottom, w});
+  for (auto i = best + 1; i < skyline.size();) {
+    auto& s = skyline[i];
+    const int overlap = rect->right - s.x;
+    if (overlap <= 0) break;
+    if (overlap < s.width) {
+      s.x += overlap;
+      s.width -= overlap;
+      break;
+    }
+    skyline.erase(skyline.begin() + static_cast<long>(i));
+  }
+  // Merge neighbours at the same height
+  for (std::size_t i = 0; i + 1 < skyline.size();) {
+    if (skyline[i].y == skyline[i + 1].y) {
+      skyline[i].width += skyline[i + 1].width;
+      skyline.erase(skyline.begin() + static_cast<long>(i) + 1);
+    } else {
+      ++i;
+    }
+  }
+  return rect;
+}
+
+GlyphAtlas bakeGlyphAtlas(const FontParser& font,
+                          const std::span<const uint16_t> glyphCodes,
+                          const std::span<const float> pixelSizes,
+                          const AtlasOptions& options) {
+  if (options.pageWidth <= 0 || options.pageHeight <= 0 ||
+      options.padding < 0) {
+    throw std::invalid_argument("atlas: invalid page size or padding");
+  }
+  const auto numGlyphs = glyphCodes.size();
+  const auto numJobs = numGlyphs * pixelSizes.size();
+  GlyphAtlas atlas{options.pageWidth, options.pageHeight, {}, {}};
+  atlas.glyphs.resize(numJobs);
+  std::vector<CoverageMask> masks(numJobs);
+
+  // Rasterize in parallel, each job writes only its own slot
+  std::atomic<std::size_t> nextJob = 0;
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  {
+    const auto numThreads = std::clamp<std::size_t>(options.numThreads, 1,
+                                                     std::max<std::size_t>(
+                                                       numJobs, 1));
+    std::vector<std::jthread> threads;
+    for (std::size_t t = 0; t < numThreads; ++t) {
+      threads.emplace_back([&] {
+        try {
+          for (std::size_t i; (i = nextJob++) < numJobs;) {
+            const auto size = pixelSizes[i / numGlyphs];
+            const auto code = glyphCodes[i % numGlyphs];
+            const float scale = size / font.getUnitsPerEm();
+            rasterizeGlyphMask(*font.getCachedGlyph(code), scale, 0,
+                               masks[i]);
+            const auto metric = font.getMetric(code);
+            atlas.glyphs[i] = AtlasGlyph{
+                code, size, -1, PixelRect{}, masks[i].left, -masks[i].top,
+                metric.advanceWidth * scale, metric};
+          }
+        } catch (...) {
+          std::lock_guard lock(errorMutex);
+          if (!error) error = std::current_exception();
+          // Let the other threads run out of jobs
+          nextJob = numJobs;
+        }
+      });
+    }
+  }
+  if (error) std::rethrow_exception(error);
+
+  // Pack tallest first, ties in job order so the layout is deterministic
+  std::vector<std::size_t> order(numJobs);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](const std::size_t a, const std::size_t b) {
+                     return masks[a].height > masks[b].height;
+                   });
+  std::vector<SkylinePacker> packers;
+  const auto pageSize = static_cast<std::size_t>(options.pageWidth) *
+                        options.pageHeight;
+  for (const auto i : order) {
+    const auto& mask = masks[i];
+    if (mask.width == 0 || mask.height == 0) continue;
+    const int w = mask.width + options.padding;
+    const int h = mask.height + options.padding;
+    if (w > options.pageWidth || h > options.pageHeight) {
+      throw std::runtime_error("atlas: glyph " +
+                               std::to_string(atlas.glyphs[i].glyphCode) +
+                               " does not fit in a page");
+    }
+    // First page with room, shorter glyphs still fill gaps of earlier pages
+    std::optional<PixelRect> placed;
+    std::size_t page = 0;
+    for (; page < packers.size() && !placed; ++page) {
+      placed = packers[page].insert(w, h);
+    }
+    if (!placed) {
+      packers.emplace_back(options.pageWidth, options.pageHeight);
+      atlas.pages.emplace_back(pageSize, 0);
+      placed = packers.back().insert(w, h);
+      ++page;
+    }
+    auto& glyph = atlas.glyphs[i];
+    glyph.page = static_cast<int>(page) - 1;
+    glyph.rect = PixelRect{placed->left, placed->top,
+                           placed->left + mask.width,
+                           placed->top + mask.height};
+    auto* pixels = atlas.pages[glyph.page].data() +
+                   static_cast<std::size_t>(glyph.rect.top) *
+                   options.pageWidth + glyph.rect.left;
+    for (int y = 0; y < mask.height; ++y) {
+      std::memcpy(pixels + static_cast<std::size_t>(y) * options.pageWidth,
+                  mask.data.data() + static_cast<std::size_t>(y) * mask.width,
+                  mask.width);
+    }
+    // The page holds the coverage now
+    masks[i].data = {};
+  }
+  return atlas;
+}
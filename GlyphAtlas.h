@@ -0,0 +1,107 @@
+#pragma once
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "FontParser.h"
+#include "utils/Geometry.h"
+
+/**
+ * Packs rectangles into a fixed-size page with the skyline bottom-left
+ * heuristic: the top edge of the packed area is kept as a list of segments,
+ * and each rectangle goes where its bottom edge ends up lowest.
+ */
+class SkylinePacker {
+public:
+  SkylinePacker(int width_, int height_);
+  /**
+   * Find room for a rectangle and mark it as used.
+   * @param w Width
+   * @param h Height
+   * @return Placed rect, nullopt if the page is too full
+   */
+  std::optional<PixelRect> insert(int w, int h);
+
+private:
+  // Horizontal segment of the skyline, the page is used above y
+  struct Segment {
+    int x;
+    int y;
+    int width;
+  };
+
+  int width;
+  int height;
+  // Sorted by x, covering the whole page width
+  std::vector<Segment> skyline;
+
+  /**
+   * Get the y a rectangle would be placed at on the segment.
+   * @return y, nullopt if the rectangle does not fit there
+   */
+  [[nodiscard]] std::optional<int> fitAt(std::size_t segment, int w,
+                                         int h) const;
+};
+
+/**
+ * A glyph placed on an atlas page. Placement values are in pixels at the
+ * glyph's size, y grows downwards like on the canvas.
+ */
+struct AtlasGlyph {
+  uint16_t glyphCode;
+  float pixelSize;
+  // Page index and rect of the coverage, -1 and empty for glyphs without
+  // outline
+  int page;
+  PixelRect rect;
+  // Left edge of the rect from the pen
+  int bearingX;
+  // Top edge of the rect above the baseline
+  int bearingY;
+  // Horizontal advance in pixels, from the glyph's Metric
+  float advance;
+  // Metric in font units as stored in hmtx
+  Metric metric;
+};
+
+struct AtlasOptions {
+  // Sizes of the pages in pixels
+  int pageWidth = 1024;
+  int pageHeight = 1024;
+  // Empty pixels between glyphs, so filtered sampling doesn't bleed
+  int padding = 1;
+  // Number of rasterizing threads
+  unsigned numThreads = std::thread::hardware_concurrency();
+};
+
+/**
+ * 8-bit coverage pages and the placement of every glyph on them.
+ */
+struct GlyphAtlas {
+  int pageWidth = 0;
+  int pageHeight = 0;
+  // pageWidth x pageHeight coverage per page
+  std::vector<std::vector<uint8_t>> pages;
+  std::vector<AtlasGlyph> glyphs;
+};
+
+/**
+ * Rasterize glyphs at several sizes and pack them into atlas pages.
+ * Glyphs are rasterized on a pool of threads, then packed tallest first so
+ * the pages fill evenly. The result doesn't depend on the thread count.
+ * @param font Font parser the glyph codes belong to
+ * @param glyphCodes Glyphs to bake
+ * @param pixelSizes Sizes in pixels per em
+ * @param options Page size, padding and parallelism
+ * @return Pages and glyph placements, ordered by size then by glyph code
+ */
+GlyphAtlas bakeGlyphAtlas(const FontParser& font,
+                          std::span<const uint16_t> glyphCodes,
+                          std::span<const float> pixelSizes,
+                          const AtlasOptions& options = {});
+
+#endif //GLYPHATLAS_H
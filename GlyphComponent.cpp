@@ -1,45 +1,433 @@
 #include "GlyphComponent.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <optional>
 #include <utility>
 #include <vector>
 
+namespace {
+/**
+ * Line or quadratic curve of a contour.
+ */
+struct OutlineSegment {
+  glm::vec2 from;
+  // Unused for a line
+  glm::vec2 control;
+  glm::vec2 to;
+  bool curved;
+
+  [[nodiscard]] glm::vec2 at(const float t) const {
+    return curved ? quadBezierLerp(from, control, to, t) : lerp(from, to, t);
+  }
+
+  /**
+   * Append points at even steps of t after from, up to and including to.
+   * Consecutive points are at most spacing apart along the segment and the
+   * polyline through them stays within flatness of it.
+   * @param spacing Longest distance between points
+   * @param flatness Largest deviation of the polyline
+   * @param points Receives the points
+   */
+  void sample(const float spacing, const float flatness,
+              std::vector<glm::vec2>& points) const {
+    float steps;
+    if (curved) {
+      // The speed is at most twice the longer leg of the control polygon,
+      // and a chord over dt strays by at most |from - 2 control + to| dt^2/4
+      const float speed = 2 * std::max(glm::length(control - from),
+                                       glm::length(to - control));
+      const float bend = glm::length(from - 2.0f * control + to);
+      steps = std::max(speed / spacing, std::sqrt(bend / (4 * flatness)));
+    } else {
+      steps = glm::length(to - from) / spacing;
+    }
+    const int n = std::max(1, static_cast<int>(std::ceil(steps)));
+    for (int k = 1; k <= n; ++k) {
+      points.push_back(at(static_cast<float>(k) / static_cast<float>(n)));
+    }
+  }
+};
+
+// The error of a merge is measured at points this fraction of the tolerance
+// apart along the curves, ...
+constexpr float SAMPLE_SPACING = 0.25f;
+// ... joined by a polyline that is within this fraction of the curve
+constexpr float SAMPLE_FLATNESS = 0.125f;
+// Most original segments merged into one, bounds the cost of the checks
+constexpr std::size_t MAX_MERGED = 8;
+
+float getSquaredDistanceToSegment(const glm::vec2& p, const glm::vec2& a,
+                                  const glm::vec2& b) {
+  const auto ab = b - a;
+  const float len2 = glm::dot(ab, ab);
+  const float t = len2 > 0
+                    ? std::clamp(glm::dot(p - a, ab) / len2, 0.0f, 1.0f)
+                    : 0.0f;
+  const auto d = p - (a + ab * t);
+  return glm::dot(d, d);
+}
+
+/**
+ * Check that points stay within a distance of a polyline running the same
+ * way. Each point is matched to the nearest segment reached by walking
+ * forward from the previous match, so the distance may be overestimated but
+ * never underestimated.
+ * @param maxSquared Square of the distance
+ */
+bool isNear(const std::span<const glm::vec2> points,
+            const std::span<const glm::vec2> polyline,
+            const float maxSquared) {
+  std::size_t j = 0;
+  for (const auto& p : points) {
+    float best = getSquaredDistanceToSegment(p, polyline[j], polyline[j + 1]);
+    while (j + 2 < polyline.size()) {
+      const float next = getSquaredDistanceToSegment(p, polyline[j + 1],
+                                                     polyline[j + 2]);
+      if (next > best) break;
+      best = next;
+      ++j;
+    }
+    if (best > maxSquared) return false;
+  }
+  return true;
+}
+
+/**
+ * Merges consecutive segments of contours, reusing its buffers across them.
+ */
+class ContourSimplifier {
+public:
+  /**
+   * @param tolerance_ Maximum allowed deviation
+   * @param bounds Rect the merged curves have to stay in
+   * @param maxSegments Most segments of a contour, to size the buffers
+   */
+  ContourSimplifier(const float tolerance_, const BoundingRect& bounds,
+                    const std::size_t maxSegments) :
+    tolerance(tolerance_), spacing(tolerance_ * SAMPLE_SPACING),
+    flatness(tolerance_ * SAMPLE_FLATNESS),
+    // A point between two samples is at most half the spacing from one of
+    // them, and the polylines are off the curves by up to the flatness
+    maxSquared(std::pow(tolerance_ - spacing / 2 - flatness, 2.0f)),
+    boundsMin(bounds.xMin, bounds.yMin),
+    boundsMax(bounds.xMax, bounds.yMax) {
+    sampleStarts.reserve(maxSegments + 1);
+    merged.reserve(maxSegments);
+  }
+
+  /**
+   * Greedily merge the segments of a closed contour, each merged segment is
+   * checked against the original segments it replaces.
+   * @param segments Segments of the contour
+   * @return Merged segments, valid until the next call
+   */
+  const std::vector<OutlineSegment>& simplify(
+      const std::vector<OutlineSegment>& segments) {
+    samples.assign(1, segments.front().from);
+    sampleStarts.clear();
+    for (const auto& seg : segments) {
+      sampleStarts.push_back(samples.size() - 1);
+      seg.sample(spacing, flatness, samples);
+    }
+    sampleStarts.push_back(samples.size() - 1);
+    merged.clear();
+    // First original segment of merged.back()
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < segments.size(); ++i) {
+      auto seg = segments[i];
+      // A curve point strays from the chord point at the same t by at most
+      // half the distance of the control point from the chord's midpoint
+      if (seg.curved && glm::length(seg.control - (seg.from + seg.to) / 2.0f)
+          <= 2 * tolerance) {
+        seg = OutlineSegment{seg.from, seg.from, seg.to, false};
+      }
+      if (!merged.empty() && i - begin < MAX_MERGED) {
+        const auto joined = join(merged.back(), seg);
+        if (joined && isInReach(*joined, seg.from) &&
+            fits(*joined, begin, i + 1)) {
+          merged.back() = *joined;
+          continue;
+        }
+      }
+      merged.push_back(seg);
+      begin = i;
+    }
+    return merged;
+  }
+
+private:
+  float tolerance;
+  float spacing;
+  float flatness;
+  // Square of the largest distance allowed between sampled polylines
+  float maxSquared;
+  glm::vec2 boundsMin;
+  glm::vec2 boundsMax;
+  // Start point of the contour, then the points sampled along each segment
+  std::vector<glm::vec2> samples;
+  // Index in samples of the start point of each segment, then of the end
+  std::vector<std::size_t> sampleStarts;
+  std::vector<glm::vec2> replacement;
+  std::vector<OutlineSegment> merged;
+
+  /**
+   * Find a single segment from the start of a to the end of b that keeps
+   * their tangents at both ends: a line if both are straight, else the curve
+   * whose control point is where the end tangents meet.
+   */
+  [[nodiscard]] std::optional<OutlineSegment> join(
+      const OutlineSegment& a, const OutlineSegment& b) const {
+    if (a.from == b.to) return std::nullopt;
+    const auto d0 = (a.curved ? a.control : a.to) - a.from;
+    const auto d1 = b.to - (b.curved ? b.control : b.from);
+    const auto r = b.to - a.from;
+    const auto cross = [](const glm::vec2& u, const glm::vec2& v) {
+      return u.x * v.y - u.y * v.x;
+    };
+    const float det = cross(d0, d1);
+    const bool parallel = std::abs(det) <= eps * glm::length(d0) *
+                          glm::length(d1);
+    if ((!a.curved && !b.curved) || parallel) {
+      return OutlineSegment{a.from, a.from, b.to, false};
+    }
+    const float s = cross(r, d1) / det;
+    const float u = cross(d0, r) / det;
+    if (s <= 0 || u <= 0) return std::nullopt;
+    const auto control = a.from + s * d0;
+    // The curve stays in the hull of its points, so in the bounding rect
+    if (control.x < boundsMin.x || control.y < boundsMin.y ||
+        control.x > boundsMax.x || control.y > boundsMax.y) {
+      return std::nullopt;
+    }
+    return OutlineSegment{a.from, control, b.to, true};
+  }
+
+  /**
+   * Check that a point of the original outline is within the tolerance of
+   * the hull of a segment, which holds the segment. Rejects most merges
+   * without sampling them.
+   */
+  [[nodiscard]] bool isInReach(const OutlineSegment& candidate,
+                               const glm::vec2& p) const {
+    if (!candidate.curved) {
+      return getSquaredDistanceToSegment(p, candidate.from, candidate.to) <=
+             tolerance * tolerance;
+    }
+    const auto& a = candidate.from;
+    const auto& b = candidate.control;
+    const auto& c = candidate.to;
+    const auto side = [&](const glm::vec2& u, const glm::vec2& v) {
+      return (v.x - u.x) * (p.y - u.y) - (v.y - u.y) * (p.x - u.x);
+    };
+    const float s0 = side(a, b);
+    const float s1 = side(b, c);
+    const float s2 = side(c, a);
+    if ((s0 >= 0 && s1 >= 0 && s2 >= 0) || (s0 <= 0 && s1 <= 0 && s2 <= 0)) {
+      return true;
+    }
+    return std::min({getSquaredDistanceToSegment(p, a, b),
+                     getSquaredDistanceToSegment(p, b, c),
+                     getSquaredDistanceToSegment(p, c, a)}) <=
+           tolerance * tolerance;
+  }
+
+  /**
+   * Check that a segment replacing the original segments [begin, end) stays
+   * within the tolerance of them, measured both ways. Every point of either
+   * is checked, not just the sampled ones.
+   */
+  bool fits(const OutlineSegment& candidate, const std::size_t begin,
+            const std::size_t end) {
+    const std::span original(samples.data() + sampleStarts[begin],
+                             sampleStarts[end] - sampleStarts[begin] + 1);
+    replacement.assign(1, candidate.from);
+    candidate.sample(spacing, flatness, replacement);
+    return isNear(original, replacement, maxSquared) &&
+           isNear(replacement, original, maxSquared);
+  }
+};
+}
+
 GlyphComponent::GlyphComponent(uint16_t numOfVertices_,
-                               std::unordered_set<uint16_t> endPtsOfContours_,
-                               std::unordered_set<uint16_t> ptsOnCurve_,
+                               std::vector<uint16_t> endPtsOfContours_,
+                               std::vector<uint8_t> onCurveFlags_,
                                BoundingRect boundingRect_,
                                std::vector<glm::vec2> coordinates_)
   : numOfVertices(numOfVertices_),
     endPtsOfContours(std::move(endPtsOfContours_)),
     boundingRect(boundingRect_),
     coordinates(std::move(coordinates_)),
-    ptsOnCurve(std::move(ptsOnCurve_)) {
+    onCurveFlags(std::move(onCurveFlags_)) {
 }
 
 uint16_t GlyphComponent::getNumOfVertices() const {
   return numOfVertices;
 }
 
-const std::unordered_set<uint16_t>&
-GlyphComponent::getEndPtsOfContours() const {
+std::span<const uint16_t> GlyphComponent::getEndPtsOfContours() const {
   return endPtsOfContours;
 }
 
-const std::unordered_set<uint16_t>& GlyphComponent::getPtsOnCurve() const {
-  return ptsOnCurve;
+std::span<const uint8_t> GlyphComponent::getOnCurveFlags() const {
+  return onCurveFlags;
 }
 
-
-const std::vector<glm::vec2>& GlyphComponent::getCoordinates() const {
+std::span<const glm::vec2> GlyphComponent::getCoordinates() const {
   return coordinates;
 }
 
-
 BoundingRect GlyphComponent::getBoundingRect() const {
   return boundingRect;
 }
 
+template <class F>
+void GlyphComponent::forEachSegment(const int first, const int last,
+                                    F&& segment) const {
+  // The contour has to start from an on-curve point. If both ends are
+  // control points, the implicit on-curve point between them is used.
+  glm::vec2 startPt;
+  int from = first;
+  int to = last;
+  if (isOnCurve(first)) {
+    startPt = coordinates[first];
+    from = first + 1;
+  } else if (isOnCurve(last)) {
+    startPt = coordinates[last];
+    to = last - 1;
+  } else {
+    startPt = (coordinates[first] + coordinates[last]) / 2.0f;
+  }
+
+  glm::vec2 currentPt = startPt;
+  std::optional<glm::vec2> controlPt;
+  const auto visit = [&](const glm::vec2& pt, const bool onCurve) {
+    if (onCurve) {
+      segment(currentPt, controlPt ? &*controlPt : nullptr, pt);
+      controlPt.reset();
+      currentPt = pt;
+    } else {
+      if (controlPt) {
+        // Implicit on-curve point between two consecutive control points
+        const auto midPt = (*controlPt + pt) / 2.0f;
+        segment(currentPt, &*controlPt, midPt);
+        currentPt = midPt;
+      }
+      controlPt = pt;
+    }
+  };
+  for (int j = from; j <= to; ++j) visit(coordinates[j], isOnCurve(j));
+  // Close the contour
+  visit(startPt, true);
+}
+
+std::vector<std::vector<glm::vec2>> GlyphComponent::getFlattenedContours(
+    const float tolerance) const {
+  std::vector<std::vector<glm::vec2>> contours;
+  for (std::size_t i = 0; i < endPtsOfContours.size(); ++i) {
+    std::vector<glm::vec2> polyline;
+    flattenContour(i, tolerance, polyline);
+    if (polyline.size() >= 2) contours.emplace_back(std::move(polyline));
+  }
+  return contours;
+}
+
+void GlyphComponent::flattenContour(const std::size_t contour,
+                                    const float tolerance,
+                                    std::vector<glm::vec2>& polyline) const {
+  polyline.clear();
+  const int first = contour == 0 ? 0 : endPtsOfContours[contour - 1] + 1;
+  forEachSegment(first, endPtsOfContours[contour],
+                 [&](const glm::vec2& from, const glm::vec2* control,
+                     const glm::vec2& to) {
+                   if (polyline.empty()) polyline.emplace_back(from);
+                   if (control) {
+                     flattenQuadBezier(from, *control, to, tolerance,
+                                       polyline);
+                   } else {
+                     polyline.emplace_back(to);
+                   }
+                 });
+  // Drop the closing point, it repeats the first one
+  polyline.pop_back();
+}
+
+GlyphComponent GlyphComponent::simplify(const float tolerance) const {
+  std::vector<uint16_t> endPts;
+  std::vector<uint8_t> flags;
+  std::vector<glm::vec2> points;
+  std::vector<OutlineSegment> segments;
+  // A contour has at most one segment per point, plus an implicit one
+  const auto maxSegments = coordinates.size() + endPtsOfContours.size();
+  endPts.reserve(endPtsOfContours.size());
+  flags.reserve(numOfVertices);
+  points.reserve(numOfVertices);
+  segments.reserve(maxSegments);
+  ContourSimplifier simplifier(tolerance, boundingRect, maxSegments);
+  int contourStartPt = 0;
+  for (const auto endPt : endPtsOfContours) {
+    const int first = contourStartPt;
+    contourStartPt = endPt + 1;
+    auto lo = coordinates[first];
+    auto hi = lo;
+    for (int j = first; j <= endPt; ++j) {
+      lo = glm::min(lo, coordinates[j]);
+      hi = glm::max(hi, coordinates[j]);
+    }
+    // A contour within the tolerance of its center, control points and so
+    // the whole curve included, is a dot or hole that collapses to a point
+    const auto center = (lo + hi) / 2.0f;
+    if (std::ranges::all_of(std::span(coordinates).subspan(first,
+                                                           endPt - first + 1),
+                            [&](const glm::vec2& p) {
+                              return glm::dot(p - center, p - center) <=
+                                     tolerance * tolerance;
+                            })) {
+      continue;
+    }
+
+    segments.clear();
+    forEachSegment(first, endPt,
+                   [&](const glm::vec2& from, const glm::vec2* control,
+                       const glm::vec2& to) {
+                     segments.push_back(control
+                                          ? OutlineSegment{from, *control, to,
+                                                           true}
+                                          : OutlineSegment{from, from, to,
+                                                           false});
+                   });
+    const auto& merged = simplifier.simplify(segments);
+
+    for (std::size_t i = 0; i < merged.size(); ++i) {
+      const auto& seg = merged[i];
+      // Keep on-curve points between two control points implicit
+      const bool implicit = i > 0 && seg.curved && merged[i - 1].curved &&
+                            seg.from == (merged[i - 1].control + seg.control)
+                            / 2.0f;
+      if (!implicit) {
+        points.push_back(seg.from);
+        flags.push_back(1);
+      }
+      if (seg.curved) {
+        points.push_back(seg.control);
+        flags.push_back(0);
+      }
+    }
+    endPts.push_back(static_cast<uint16_t>(points.size() - 1));
+  }
+  const auto numOfPoints = static_cast<uint16_t>(points.size());
+  return GlyphComponent(numOfPoints, std::move(endPts), std::move(flags),
+                        boundingRect, std::move(points));
+}
+
+MemoryUsage GlyphComponent::getMemoryUsage() const {
+  auto usage = ::getMemoryUsage(coordinates);
+  usage += ::getMemoryUsage(endPtsOfContours);
+  usage += ::getMemoryUsage(onCurveFlags);
+  return usage;
+}
+
 void GlyphComponent::printDebugInfo() const {
   std::wcout << "numOfVertices: " << numOfVertices << std::endl;
 
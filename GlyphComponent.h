@@ -1,12 +1,14 @@
 #pragma once
 #ifndef GLYPHCOMPONENT_H
 #define GLYPHCOMPONENT_H
+#include <cstddef>
 #include <cstdint>
-#include <unordered_set>
+#include <span>
 #include <vector>
 #include <glm/vec2.hpp>
 
 #include "utils/Geometry.h"
+#include "utils/Memory.h"
 
 
 class GlyphComponent {
@@ -14,24 +16,81 @@ public:
   GlyphComponent() : numOfVertices(0) {
   }
 
+  /**
+   * @param numOfVertices_ Number of points
+   * @param endPtsOfContours_ Last point of every contour, ascending
+   * @param onCurveFlags_ Non-zero for the points on the curve, one per point
+   * @param boundingRect_ Bounding rect in font units
+   * @param coordinates_ Points in font units
+   */
   explicit GlyphComponent(uint16_t numOfVertices_,
-                          std::unordered_set<uint16_t> endPtsOfContours_,
-                          std::unordered_set<uint16_t> ptsOnCurve_,
+                          std::vector<uint16_t> endPtsOfContours_,
+                          std::vector<uint8_t> onCurveFlags_,
                           BoundingRect boundingRect_,
                           std::vector<glm::vec2> coordinates_);
   [[nodiscard]] uint16_t getNumOfVertices() const;
   [[nodiscard]] BoundingRect getBoundingRect() const;
-  [[nodiscard]] const std::unordered_set<uint16_t>& getEndPtsOfContours() const;
-  [[nodiscard]] const std::unordered_set<uint16_t>& getPtsOnCurve() const;
-  [[nodiscard]] const std::vector<glm::vec2>& getCoordinates() const;
+  // The views below stay valid as long as the component
+  [[nodiscard]] std::span<const uint16_t> getEndPtsOfContours() const;
+  [[nodiscard]] std::span<const uint8_t> getOnCurveFlags() const;
+  [[nodiscard]] std::span<const glm::vec2> getCoordinates() const;
+  [[nodiscard]] bool isOnCurve(const uint16_t i) const {
+    return onCurveFlags[i] != 0;
+  }
+  /**
+   * Flatten every contour into a closed polyline in font units.
+   * Quadratic curves are subdivided adaptively so that no chord deviates
+   * from the curve more than the tolerance.
+   * @param tolerance Maximum allowed deviation in font units
+   * @return Polylines, one per contour, without the repeated closing point
+   */
+  [[nodiscard]] std::vector<std::vector<glm::vec2>> getFlattenedContours(
+      float tolerance) const;
+  /**
+   * Flatten one contour into a closed polyline in font units, reusing the
+   * storage of the output.
+   * @param contour Index of the contour
+   * @param tolerance Maximum allowed deviation in font units
+   * @param polyline Replaced by the polyline, without the repeated closing
+   * point
+   */
+  void flattenContour(std::size_t contour, float tolerance,
+                      std::vector<glm::vec2>& polyline) const;
+  /**
+   * Build a simplified copy for small sizes. Runs of lines and curves are
+   * merged into single lines or quadratic curves where the result stays
+   * within the tolerance of the original, and contours whose points are all
+   * within the tolerance of their center are dropped. No point of either
+   * outline is further than the tolerance from the other. The result stays
+   * inside the bounding rect.
+   * @param tolerance Maximum allowed deviation in font units
+   * @return Simplified component
+   */
+  [[nodiscard]] GlyphComponent simplify(float tolerance) const;
+  /**
+   * Estimate the heap memory owned by the component.
+   * @return Bytes and allocations
+   */
+  [[nodiscard]] MemoryUsage getMemoryUsage() const;
   void printDebugInfo() const;
 
 private:
   uint16_t numOfVertices;
-  std::unordered_set<uint16_t> endPtsOfContours;
+  std::vector<uint16_t> endPtsOfContours;
   BoundingRect boundingRect;
   std::vector<glm::vec2> coordinates;
-  std::unordered_set<uint16_t> ptsOnCurve;
+  std::vector<uint8_t> onCurveFlags;
+
+  /**
+   * Walk a contour as lines and quadratic curves with explicit end points,
+   * starting from an on-curve point and ending where it started.
+   * @param first First point of the contour
+   * @param last Last point of the contour
+   * @param segment Called with the start point, the control point or
+   * nullptr for a line, and the end point of each segment
+   */
+  template <class F>
+  void forEachSegment(int first, int last, F&& segment) const;
 };
 
 #endif  // GLYPHCOMPONENT_H
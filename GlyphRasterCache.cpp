@@ -0,0 +1,231 @@
+#include "GlyphRasterCache.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#include "FrameBufferCanvas.h"
+#include "Rasterizer.h"
+
+MemoryUsage RleMask::getMemoryUsage() const {
+  auto usage = ::getMemoryUsage(rowSpans);
+  usage += ::getMemoryUsage(spans);
+  usage += ::getMemoryUsage(coverage);
+  return usage;
+}
+
+void rasterizeGlyphMask(const Glyph& glyph, const float scale,
+                        const float penX, CoverageMask& mask) {
+  if (glyph.getComponents().empty()) {
+    mask.left = mask.top = mask.width = mask.height = 0;
+    mask.data.clear();
+    return;
+  }
+  const glm::mat3 transform(scale, 0, 0, 0, -scale, 0, penX, 0, 1);
+  const auto r = transformBoundingRect(transform, glyph.getBoundingRect());
+  const PixelRect area{r.xMin, r.yMin, r.xMax, r.yMax};
+  mask.left = area.left;
+  mask.top = area.top;
+  mask.width = area.right - area.left;
+  mask.height = area.bottom - area.top;
+  mask.data.assign(static_cast<std::size_t>(mask.width) * mask.height, 0);
+  const auto edges = buildGlyphEdges(glyph.getLevelOfDetail(scale),
+                                     transform,
+                                     FLATTEN_TOLERANCE / SUPERSAMPLE);
+  rasterizeEdges<FillRule::NonZero, Supersampled<SUPERSAMPLE>>(
+      edges, area, MaskTarget{mask});
+}
+
+RleMask encodeRleMask(const CoverageMask& mask) {
+  RleMask rle{mask.left, mask.top, mask.width, mask.height, {}, {}, {}};
+  const auto denseSize = static_cast<std::size_t>(mask.width) * mask.height;
+  const auto keepDense = [&] {
+    rle.rowSpans.clear();
+    rle.spans.clear();
+    rle.coverage.assign(mask.data.begin(), mask.data.end());
+    return rle;
+  };
+  // Span positions and lengths have 16 and 15 bits
+  if (mask.width > INT16_MAX || mask.height == 0) return keepDense();
+
+  rle.rowSpans.reserve(mask.height);
+  const auto addSpan = [&](const uint8_t* row, const int x0, const int x1,
+                           const bool solid) {
+    if (x0 >= x1) return;
+    if (!solid) rle.coverage.insert(rle.coverage.end(), row + x0, row + x1);
+    rle.spans.push_back({static_cast<uint16_t>(x0),
+                         static_cast<uint16_t>(x1 - x0), solid});
+    ++rle.rowSpans.back();
+  };
+  for (int y = 0; y < mask.height; ++y) {
+    rle.rowSpans.push_back(0);
+    const auto* row = mask.data.data() +
+                      static_cast<std::size_t>(y) * mask.width;
+    int x = 0;
+    while (x < mask.width) {
+      // Skip empty pixels, then take the covered run up to the next one
+      while (x < mask.width && row[x] == 0) ++x;
+      const int end = static_cast<int>(
+        std::find(row + x, row + mask.width, 0) - row);
+      // Split the run at long fully covered stretches
+      int start = x;
+      while (x < end) {
+        if (row[x] != 255) {
+          ++x;
+          continue;
+        }
+        const int solidEnd = static_cast<int>(
+          std::find_if(row + x, row + end,
+                       [](const uint8_t c) { return c != 255; }) - row);
+        if (solidEnd - x >= MIN_SOLID_RUN) {
+          addSpan(row, start, x, false);
+          addSpan(row, x, solidEnd, true);
+          start = solidEnd;
+        }
+        x = solidEnd;
+      }
+      addSpan(row, start, end, false);
+    }
+  }
+  rle.spans.shrink_to_fit();
+  rle.coverage.shrink_to_fit();
+  if (rle.getMemoryUsage().bytes >= allocationSize(denseSize)) {
+    return keepDense();
+  }
+  return rle;
+}
+
+namespace {
+// Rebuild cost of a mask in nanoseconds, a fixed part for the outline and
+// the setup plus a part per pixel, measured with bench raster_cache
+constexpr double MASK_BASE_COST = 2000;
+constexpr double MASK_PIXEL_COST = 4;
+}
+
+GlyphRasterCache::GlyphRasterCache(const FontParser& font_,
+                                   const std::size_t capacityBytes,
+                                   MemoryBudget* budget_) :
+  font(font_), capacity(capacityBytes), budget(budget_) {
+  if (budget) budget->attach(*this);
+}
+
+GlyphRasterCache::~GlyphRasterCache() {
+  if (budget) budget->detach(*this);
+}
+
+const RleMask& GlyphRasterCache::getMask(const FontParser& glyphFont,
+                                         const uint16_t glyphCode,
+                                         const float scale,
+                                         const int subpixel) {
+  if (&glyphFont != &font) {
+    throw std::invalid_argument("raster cache is bound to another font");
+  }
+  const uint64_t key = static_cast<uint64_t>(std::bit_cast<uint32_t>(scale))
+                       << 32 | static_cast<uint64_t>(subpixel) << 16 |
+                       glyphCode;
+  {
+    std::unique_lock lock(mutex);
+    // The previous mask is no longer in use
+    if (handedOutEvicted) {
+      handedOutEvicted = false;
+      if (const auto it = entries.find(handedOut); it != entries.end()) {
+        erase(it);
+      }
+    }
+    if (const auto it = entries.find(key); it != entries.end()) {
+      ++hits;
+      lru.splice(lru.begin(), lru, it->second.lruPosition);
+      handedOut = key;
+      lock.unlock();
+      if (budget) budget->touch(*this, key);
+      return it->second.mask;
+    }
+  }
+  ++misses;
+
+  // Only the owning thread touches the scratch mask
+  rasterizeGlyphMask(*font.getCachedGlyph(glyphCode), scale,
+                     static_cast<float>(subpixel) / SUBPIXEL_STEPS, scratch);
+  auto mask = encodeRleMask(scratch);
+
+  const auto usage = mask.getMemoryUsage();
+  std::unique_lock lock(mutex);
+  lru.push_front(key);
+  const auto it = entries.emplace(key, Entry{std::move(mask), usage,
+                                             lru.begin()}).first;
+  used += usage;
+  handedOut = key;
+  evict();
+  lock.unlock();
+  // The budget may evict from this cache, but never the mask it charges
+  if (budget) {
+    budget->charge(*this, key, usage.bytes,
+                   MASK_BASE_COST + MASK_PIXEL_COST * scratch.width *
+                   scratch.height);
+  }
+  return it->second.mask;
+}
+
+void GlyphRasterCache::erase(
+    const std::unordered_map<uint64_t, Entry>::iterator it) {
+  used.bytes -= it->second.usage.bytes;
+  used.allocations -= it->second.usage.allocations;
+  // The budget may have picked it already, releasing it again is harmless
+  if (budget) budget->release(*this, it->first);
+  lru.erase(it->second.lruPosition);
+  entries.erase(it);
+}
+
+void GlyphRasterCache::evict() {
+  // The newest mask is kept even if it alone is over the capacity
+  while (used.bytes > capacity && lru.size() > 1) {
+    erase(entries.find(lru.back()));
+  }
+}
+
+void GlyphRasterCache::evictEntry(const uint64_t key) {
+  std::lock_guard lock(mutex);
+  // The mask handed out last may be in use by the owner until its next call
+  if (key == handedOut) {
+    handedOutEvicted = true;
+    return;
+  }
+  if (const auto it = entries.find(key); it != entries.end()) erase(it);
+}
+
+void GlyphRasterCache::clear() {
+  std::lock_guard lock(mutex);
+  if (budget) budget->releaseAll(*this);
+  entries.clear();
+  lru.clear();
+  used = {};
+  handedOutEvicted = false;
+}
+
+std::size_t GlyphRasterCache::size() const {
+  std::lock_guard lock(mutex);
+  return entries.size();
+}
+
+uint64_t GlyphRasterCache::getHits() const {
+  return hits;
+}
+
+uint64_t GlyphRasterCache::getMisses() const {
+  return misses;
+}
+
+MemoryReport GlyphRasterCache::getMemoryReport() const {
+  std::lock_guard lock(mutex);
+  MemoryReport report;
+  report.add("rasterCache.masks", used);
+  auto entryUsage = getHashtableMemoryUsage<std::pair<const uint64_t, Entry>,
+                                            false>(entries.size(),
+                                                   entries.bucket_count());
+  // One list node per entry: two links and the key
+  entryUsage += MemoryUsage{lru.size() * allocationSize(3 * sizeof(void*)),
+                            lru.size()};
+  report.add("rasterCache.entries", entryUsage);
+  report.add("rasterCache.scratch", ::getMemoryUsage(scratch.data));
+  return report;
+}
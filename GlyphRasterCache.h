@@ -0,0 +1,150 @@
+#pragma once
+#ifndef GLYPHRASTERCACHE_H
+#define GLYPHRASTERCACHE_H
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Compositor.h"
+#include "FontParser.h"
+#include "MemoryBudget.h"
+#include "utils/Memory.h"
+
+// Horizontal positions are quantized to this many steps per pixel
+constexpr int SUBPIXEL_STEPS = 4;
+// Fully covered runs shorter than this stay in the coverage bytes, a
+// separate span would cost more than it saves
+constexpr int MIN_SOLID_RUN = 8;
+
+/**
+ * Run of pixels on a row of a RleMask. Pixels between spans have no coverage.
+ */
+struct CoverageSpan {
+  // First pixel from the left edge of the mask
+  uint16_t x;
+  uint16_t length : 15;
+  // Fully covered, the span has no coverage bytes
+  uint16_t solid : 1;
+};
+
+/**
+ * Run-length encoded coverage of a glyph. Empty pixels are dropped, fully
+ * covered runs become solid spans and only edge pixels keep their coverage,
+ * so large glyphs take a fraction of a dense mask. Small glyphs are mostly
+ * edges, so when the spans would not pay off the mask stays dense.
+ */
+struct RleMask {
+  // Top left pixel relative to the pen position
+  int left = 0;
+  int top = 0;
+  int width = 0;
+  int height = 0;
+  // Number of spans per row, empty for a dense mask
+  std::vector<uint16_t> rowSpans;
+  std::vector<CoverageSpan> spans;
+  // Coverage of the edge spans in span order, or width x height bytes for a
+  // dense mask
+  std::vector<uint8_t> coverage;
+
+  [[nodiscard]] bool isDense() const { return rowSpans.empty(); }
+  [[nodiscard]] MemoryUsage getMemoryUsage() const;
+};
+
+/**
+ * Rasterize the anti-aliased coverage of a glyph by non-zero rule, with the
+ * pen at (penX, 0) of the mask's pixel space. Small scales use the glyph's
+ * simplified outline, see Glyph::getLevelOfDetail.
+ * @param glyph Glyph
+ * @param scale Font units to pixels
+ * @param penX Pen x offset in pixels, usually within [0, 1)
+ * @param mask Receives the coverage over the glyph's pixel rect, placed
+ * relative to the pen. Its buffer is reused.
+ */
+void rasterizeGlyphMask(const Glyph& glyph, float scale, float penX,
+                        CoverageMask& mask);
+
+/**
+ * Encode a dense mask into spans, or keep it dense if that is smaller.
+ * @param mask Dense coverage, its position is kept
+ * @return Run-length encoded mask
+ */
+RleMask encodeRleMask(const CoverageMask& mask);
+
+/**
+ * Rasterized glyphs of one font in RleMask form, keyed by glyph code, scale
+ * and horizontal subpixel position. The least recently used masks are evicted
+ * once the masks take more than the capacity. With a memory budget the
+ * masks are also charged to it and evicted by it, from any thread. Not
+ * thread-safe otherwise, use one cache per thread.
+ */
+class GlyphRasterCache : MemoryBudget::Client {
+public:
+  /**
+   * @param font_ Font parser of every glyph in the cache, it must outlive
+   * the cache
+   * @param capacityBytes Heap the masks may take, in bytes
+   * @param budget_ Budget shared with other caches, or nullptr. It must
+   * outlive the cache.
+   */
+  GlyphRasterCache(const FontParser& font_, std::size_t capacityBytes,
+                   MemoryBudget* budget_ = nullptr);
+  ~GlyphRasterCache() override;
+  GlyphRasterCache(const GlyphRasterCache&) = delete;
+  GlyphRasterCache& operator=(const GlyphRasterCache&) = delete;
+  /**
+   * Get the mask of a glyph, rasterizing it on a miss. Throws
+   * std::invalid_argument if glyphFont is not the one the cache was made
+   * for.
+   * @param glyphFont Font parser the glyph code belongs to
+   * @param glyphCode Glyph code
+   * @param scale Font units to pixels
+   * @param subpixel Pen x offset in 1 / SUBPIXEL_STEPS pixels
+   * @return Mask, valid until the next call, even if the budget evicts it
+   */
+  const RleMask& getMask(const FontParser& glyphFont, uint16_t glyphCode,
+                         float scale, int subpixel);
+  void clear();
+  [[nodiscard]] std::size_t size() const;
+  [[nodiscard]] uint64_t getHits() const;
+  [[nodiscard]] uint64_t getMisses() const;
+  /**
+   * Report the memory used by the cache.
+   * @return Bytes and allocations per structure
+   */
+  [[nodiscard]] MemoryReport getMemoryReport() const;
+
+private:
+  struct Entry {
+    RleMask mask;
+    MemoryUsage usage;
+    std::list<uint64_t>::iterator lruPosition;
+  };
+
+  // Masks are keyed without the font, so the cache takes only this one
+  const FontParser& font;
+  std::size_t capacity;
+  MemoryBudget* budget;
+  // Heap owned by the cached masks
+  MemoryUsage used;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  std::unordered_map<uint64_t, Entry> entries;
+  // Most recently used first
+  std::list<uint64_t> lru;
+  // Dense coverage reused between misses
+  CoverageMask scratch;
+  // Guards the entries against evictions from the budget's threads
+  mutable std::mutex mutex;
+  // Key of the mask returned last, the budget's eviction of it waits for
+  // the next call
+  uint64_t handedOut = UINT64_MAX;
+  bool handedOutEvicted = false;
+
+  void erase(std::unordered_map<uint64_t, Entry>::iterator it);
+  void evict();
+  void evictEntry(uint64_t key) override;
+};
+
+#endif //GLYPHRASTERCACHE_H
@@ -0,0 +1,214 @@
+#include "ImageReader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+constexpr uint8_t PNG_SIGNATURE[] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+enum PngColorType : uint8_t {
+  COLOR_GRAY = 0,
+  COLOR_RGB = 2,
+  COLOR_PALETTE = 3,
+  COLOR_GRAY_ALPHA = 4,
+  COLOR_RGBA = 6,
+};
+
+uint32_t readBe32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+uint8_t paeth(const int a, const int b, const int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+/**
+ * Undo the filter of one row in place.
+ * @param row Filtered bytes of the row, stride long
+ * @param prev Previous unfiltered row, or nullptr for the first row
+ * @param stride Bytes per row
+ * @param bpp Bytes per complete pixel, at least 1
+ * @param filter Filter type
+ */
+void unfilterRow(uint8_t* row, const uint8_t* prev, const std::size_t stride,
+                 const std::size_t bpp, const uint8_t filter) {
+  for (std::size_t i = 0; i < stride; ++i) {
+    const int a = i >= bpp ? row[i - bpp] : 0;
+    const int b = prev ? prev[i] : 0;
+    const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+    switch (filter) {
+    case 0:
+      return;
+    case 1:
+      row[i] += a;
+      break;
+    case 2:
+      row[i] += b;
+      break;
+    case 3:
+      row[i] += (a + b) / 2;
+      break;
+    case 4:
+      row[i] += paeth(a, b, c);
+      break;
+    default:
+      throw std::runtime_error("PNG: invalid filter type");
+    }
+  }
+}
+
+int getChannels(const uint8_t colorType) {
+  switch (colorType) {
+  case COLOR_GRAY:
+  case COLOR_PALETTE:
+    return 1;
+  case COLOR_GRAY_ALPHA:
+    return 2;
+  case COLOR_RGB:
+    return 3;
+  case COLOR_RGBA:
+    return 4;
+  default:
+    throw std::runtime_error("PNG: invalid color type");
+  }
+}
+}
+
+DecodedImage decodePng(const std::span<const uint8_t> png) {
+  if (png.size() < sizeof(PNG_SIGNATURE) ||
+      std::memcmp(png.data(), PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) != 0) {
+    throw std::runtime_error("PNG: invalid signature");
+  }
+
+  DecodedImage image;
+  uint8_t bitDepth = 0;
+  uint8_t colorType = 0;
+  std::vector<std::array<uint8_t, 4>> palette;
+  // Gray or RGB value drawn fully transparent, from tRNS
+  bool hasColorKey = false;
+  std::array<uint16_t, 3> colorKey{};
+  std::vector<uint8_t> compressed;
+
+  std::size_t pos = sizeof(PNG_SIGNATURE);
+  bool hasHeader = false;
+  while (pos + 12 <= png.size()) {
+    const auto length = readBe32(png.data() + pos);
+    const auto* type = png.data() + pos + 4;
+    const auto* data = png.data() + pos + 8;
+    if (length > png.size() - pos - 12) {
+      throw std::runtime_error("PNG: truncated chunk");
+    }
+    if (std::memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+      image.width = static_cast<int>(readBe32(data));
+      image.height = static_cast<int>(readBe32(data + 4));
+      bitDepth = data[8];
+      colorType = data[9];
+      if (data[12] != 0) {
+        throw std::runtime_error("PNG: interlaced images are not supported");
+      }
+      hasHeader = true;
+    } else if (std::memcmp(type, "PLTE", 4) == 0) {
+      for (uint32_t i = 0; i + 3 <= length; i += 3) {
+        palette.push_back({data[i], data[i + 1], data[i + 2], 255});
+      }
+    } else if (std::memcmp(type, "tRNS", 4) == 0) {
+      if (colorType == COLOR_PALETTE) {
+        for (uint32_t i = 0; i < length && i < palette.size(); ++i) {
+          palette[i][3] = data[i];
+        }
+      } else if (colorType == COLOR_GRAY && length >= 2) {
+        hasColorKey = true;
+        colorKey[0] = static_cast<uint16_t>(data[0] << 8 | data[1]);
+      } else if (colorType == COLOR_RGB && length >= 6) {
+        hasColorKey = true;
+        for (int c = 0; c < 3; ++c) {
+          colorKey[c] = static_cast<uint16_t>(data[c * 2] << 8 |
+                                              data[c * 2 + 1]);
+        }
+      }
+    } else if (std::memcmp(type, "IDAT", 4) == 0) {
+      compressed.insert(compressed.end(), data, data + length);
+    } else if (std::memcmp(type, "IEND", 4) == 0) {
+      break;
+    }
+    pos += 12 + length;
+  }
+
+  // Glyph images are small, larger sizes are most likely corrupt data
+  constexpr int MAX_SIZE = 1 << 14;
+  if (!hasHeader || image.width <= 0 || image.height <= 0 ||
+      image.width > MAX_SIZE || image.height > MAX_SIZE) {
+    throw std::runtime_error("PNG: missing or invalid header");
+  }
+  const int channels = getChannels(colorType);
+  const bool lowBitDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4;
+  if (!(bitDepth == 8 || (lowBitDepth && channels == 1))) {
+    throw std::runtime_error("PNG: unsupported bit depth");
+  }
+  if (colorType == COLOR_PALETTE && palette.empty()) {
+    throw std::runtime_error("PNG: missing palette");
+  }
+
+  const auto width = static_cast<std::size_t>(image.width);
+  const auto height = static_cast<std::size_t>(image.height);
+  const std::size_t stride = (width * channels * bitDepth + 7) / 8;
+  const std::size_t bpp = std::max(1, channels * bitDepth / 8);
+  // Every row starts with its filter type
+  std::vector<uint8_t> raw(height * (stride + 1));
+  auto rawSize = static_cast<uLongf>(raw.size());
+  if (uncompress(raw.data(), &rawSize, compressed.data(),
+                 static_cast<uLong>(compressed.size())) != Z_OK ||
+      rawSize != raw.size()) {
+    throw std::runtime_error("PNG: invalid image data");
+  }
+
+  image.rgba.resize(width * height * 4);
+  const int maxValue = (1 << bitDepth) - 1;
+  const uint8_t* prev = nullptr;
+  for (std::size_t y = 0; y < height; ++y) {
+    auto* row = raw.data() + y * (stride + 1) + 1;
+    unfilterRow(row, prev, stride, bpp, row[-1]);
+    prev = row;
+
+    auto* out = image.rgba.data() + y * width * 4;
+    for (std::size_t x = 0; x < width; ++x, out += 4) {
+      if (channels == 1) {
+        int v = row[x];
+        if (lowBitDepth) {
+          const auto bit = x * bitDepth;
+          v = row[bit / 8] >> (8 - bitDepth - bit % 8) & maxValue;
+        }
+        if (colorType == COLOR_PALETTE) {
+          if (static_cast<std::size_t>(v) >= palette.size()) {
+            throw std::runtime_error("PNG: palette index out of range");
+          }
+          std::memcpy(out, palette[v].data(), 4);
+        } else {
+          const auto gray = static_cast<uint8_t>(v * 255 / maxValue);
+          out[0] = out[1] = out[2] = gray;
+          out[3] = hasColorKey && v == colorKey[0] ? 0 : 255;
+        }
+      } else if (channels == 2) {
+        out[0] = out[1] = out[2] = row[x * 2];
+        out[3] = row[x * 2 + 1];
+      } else if (channels == 3) {
+        const auto* p = row + x * 3;
+        std::memcpy(out, p, 3);
+        out[3] = hasColorKey && p[0] == colorKey[0] && p[1] == colorKey[1] &&
+                 p[2] == colorKey[2] ? 0 : 255;
+      } else {
+        std::memcpy(out, row + x * 4, 4);
+      }
+    }
+  }
+  return image;
+}
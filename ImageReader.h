@@ -0,0 +1,26 @@
+#pragma once
+#ifndef IMAGEREADER_H
+#define IMAGEREADER_H
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * 8-bit RGBA pixels with straight alpha, laid out row by row.
+ */
+struct DecodedImage {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> rgba;
+};
+
+/**
+ * Decode a PNG image to RGBA.
+ * Every color type is supported at bit depth 8, grayscale and palette
+ * images also at 1, 2 and 4 bits. 16-bit and interlaced images are not.
+ * @param png PNG file content
+ * @return Decoded image
+ */
+DecodedImage decodePng(std::span<const uint8_t> png);
+
+#endif //IMAGEREADER_H
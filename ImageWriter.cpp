@@ -0,0 +1,348 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <zlib.h>
+
+#include "utils/MappedFile.h"
+
+namespace {
+// Size of the deflate window, also the size of the dictionary handed over
+// between row groups
+constexpr std::size_t WINDOW_SIZE = 32768;
+// Smallest amount of filtered data worth compressing on its own
+constexpr std::size_t MIN_CHUNK_BYTES = 256 * 1024;
+constexpr uint8_t PNG_SIGNATURE[] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+enum PngFilter : uint8_t {
+  FILTER_NONE = 0,
+  FILTER_SUB = 1,
+  FILTER_UP = 2,
+  FILTER_AVERAGE = 3,
+  FILTER_PAETH = 4,
+};
+
+void checkImage(const ImageView& image) {
+  if (!image.data || image.width <= 0 || image.height <= 0 ||
+      (image.channels != 1 && image.channels != 3)) {
+    throw std::runtime_error("invalid image");
+  }
+}
+
+std::size_t getStride(const ImageView& image) {
+  return static_cast<std::size_t>(image.width) * image.channels;
+}
+
+uint8_t paeth(const int a, const int b, const int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+/**
+ * Filter one row with the given filter type.
+ * @param out Filtered bytes, stride long
+ * @param row Current row
+ * @param prev Previous row, or nullptr for the first row
+ * @param stride Bytes per row
+ * @param bpp Bytes per pixel
+ * @param filter Filter type
+ */
+void filterRow(uint8_t* out, const uint8_t* row, const uint8_t* prev,
+               const std::size_t stride, const std::size_t bpp,
+               const PngFilter filter) {
+  for (std::size_t i = 0; i < stride; ++i) {
+    const int a = i >= bpp ? row[i - bpp] : 0;
+    const int b = prev ? prev[i] : 0;
+    const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+    int predictor = 0;
+    switch (filter) {
+      case FILTER_SUB: predictor = a;
+        break;
+      case FILTER_UP: predictor = b;
+        break;
+      case FILTER_AVERAGE: predictor = (a + b) / 2;
+        break;
+      case FILTER_PAETH: predictor = paeth(a, b, c);
+        break;
+      default: break;
+    }
+    out[i] = static_cast<uint8_t>(row[i] - predictor);
+  }
+}
+
+/**
+ * Filter rows, picking the filter with the smallest sum of absolute values
+ * per row (the heuristic recommended by the PNG specification).
+ * @param image Source image
+ * @param firstRow First row to filter
+ * @param lastRow One past the last row
+ * @return Filter type byte followed by the filtered row, for every row
+ */
+std::vector<uint8_t> filterRows(const ImageView& image, const int firstRow,
+                                const int lastRow) {
+  const auto stride = getStride(image);
+  const auto bpp = static_cast<std::size_t>(image.channels);
+  std::vector<uint8_t> out((stride + 1) * (lastRow - firstRow));
+  std::vector<uint8_t> candidate(stride);
+  for (int y = firstRow; y < lastRow; ++y) {
+    const auto* row = image.data + y * stride;
+    const auto* prev = y > 0 ? row - stride : nullptr;
+    auto* dst = out.data() + (y - firstRow) * (stride + 1);
+    uint64_t bestCost = UINT64_MAX;
+    for (const auto filter : {FILTER_NONE, FILTER_SUB, FILTER_UP,
+                              FILTER_AVERAGE, FILTER_PAETH}) {
+      filterRow(candidate.data(), row, prev, stride, bpp, filter);
+      uint64_t cost = 0;
+      for (const auto v : candidate) cost += std::abs(static_cast<int8_t>(v));
+      if (cost < bestCost) {
+        bestCost = cost;
+        dst[0] = filter;
+        std::memcpy(dst + 1, candidate.data(), stride);
+      }
+    }
+  }
+  return out;
+}
+
+/**
+ * Deflate one row group into a raw deflate stream.
+ * @param input Filtered rows of the group
+ * @param dictionary Tail of the previous group, empty for the first group
+ * @param level Compression level
+ * @param isLast The last group finishes the stream, the others end with a
+ * sync flush so the next group can be appended
+ * @return Compressed bytes
+ */
+std::vector<uint8_t> deflateChunk(const std::vector<uint8_t>& input,
+                                  const std::span<const uint8_t> dictionary,
+                                  const int level, const bool isLast) {
+  z_stream stream{};
+  // Negative window bits: raw deflate without the zlib header and checksum
+  if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)
+      != Z_OK) {
+    throw std::runtime_error("failed to initialize deflate");
+  }
+  if (!dictionary.empty()) {
+    deflateSetDictionary(&stream, dictionary.data(),
+                         static_cast<uInt>(dictionary.size()));
+  }
+  // Room for the flush marker on top of the worst case
+  std::vector<uint8_t> out(deflateBound(&stream, input.size()) + 16);
+  stream.next_in = const_cast<Bytef*>(input.data());
+  stream.avail_in = static_cast<uInt>(input.size());
+  const int flush = isLast ? Z_FINISH : Z_SYNC_FLUSH;
+  int status;
+  do {
+    if (stream.total_out == out.size()) out.resize(out.size() * 2);
+    stream.next_out = out.data() + stream.total_out;
+    stream.avail_out = static_cast<uInt>(out.size() - stream.total_out);
+    status = deflate(&stream, flush);
+  } while (status == Z_OK && (stream.avail_out == 0 || isLast));
+  deflateEnd(&stream);
+  if (status != (isLast ? Z_STREAM_END : Z_OK)) {
+    throw std::runtime_error("failed to deflate image data");
+  }
+  out.resize(stream.total_out);
+  return out;
+}
+
+/**
+ * Run body(i) for i in [0, count) on up to numThreads threads.
+ * The first exception thrown by a body is rethrown.
+ */
+template <class F>
+void parallelFor(const std::size_t count, const unsigned numThreads,
+                 F&& body) {
+  std::atomic<std::size_t> next = 0;
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  auto work = [&] {
+    for (std::size_t i; (i = next++) < count;) {
+      try {
+        body(i);
+      } catch (...) {
+        std::lock_guard lock(errorMutex);
+        if (!error) error = std::current_exception();
+      }
+    }
+  };
+  {
+    const auto threads = std::min<std::size_t>(std::max(1u, numThreads),
+                                               count);
+    std::vector<std::jthread> workers;
+    for (std::size_t t = 1; t < threads; ++t) workers.emplace_back(work);
+    work();
+  }
+  if (error) std::rethrow_exception(error);
+}
+
+void appendBe32(std::vector<uint8_t>& out, const uint32_t v) {
+  out.push_back(v >> 24);
+  out.push_back(v >> 16 & 0xFF);
+  out.push_back(v >> 8 & 0xFF);
+  out.push_back(v & 0xFF);
+}
+
+/**
+ * Append a PNG chunk whose data is the concatenation of the parts.
+ */
+void appendChunk(std::vector<uint8_t>& out, const char* type,
+                 const std::initializer_list<std::span<const uint8_t>> parts) {
+  std::size_t length = 0;
+  for (const auto& part : parts) length += part.size();
+  appendBe32(out, static_cast<uint32_t>(length));
+  const auto typeStart = out.size();
+  out.insert(out.end(), type, type + 4);
+  for (const auto& part : parts) out.insert(out.end(), part.begin(), part.end());
+  appendBe32(out, crc32(0, out.data() + typeStart,
+                        static_cast<uInt>(out.size() - typeStart)));
+}
+
+int getRowsPerChunk(const ImageView& image, const PngOptions& options) {
+  if (options.rowsPerChunk > 0) return options.rowsPerChunk;
+  const auto threads = std::max(1u, options.numThreads);
+  // A few groups per thread to balance the load, but large enough that
+  // restarting the compressor costs little
+  const int minRows = static_cast<int>(
+      (MIN_CHUNK_BYTES + getStride(image)) / (getStride(image) + 1));
+  const int balancedRows = static_cast<int>(
+      (image.height + threads * 4 - 1) / (threads * 4));
+  return std::max({1, minRows, balancedRows});
+}
+
+std::string getPnmHeader(const ImageView& image) {
+  return (image.channels == 1 ? "P5\n" : "P6\n") +
+         std::to_string(image.width) + " " + std::to_string(image.height) +
+         "\n255\n";
+}
+
+void writeFile(const char* fileName, const std::string& header,
+               const ImageView& image) {
+  std::ofstream file(fileName, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(std::string("failed to open file: ") + fileName);
+  }
+  file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  file.write(reinterpret_cast<const char*>(image.data),
+             static_cast<std::streamsize>(getStride(image) * image.height));
+  if (!file) {
+    throw std::runtime_error(std::string("failed to write file: ") +
+                             fileName);
+  }
+}
+}
+
+std::vector<uint8_t> encodePng(const ImageView& image,
+                               const PngOptions& options) {
+  checkImage(image);
+  const int level = std::clamp(options.compressionLevel, 0, 9);
+  const int rowsPerChunk = getRowsPerChunk(image, options);
+  const std::size_t numChunks = (image.height + rowsPerChunk - 1) /
+                                rowsPerChunk;
+
+  // Filtering only reads the source rows, so every group is independent
+  std::vector<std::vector<uint8_t>> filtered(numChunks);
+  parallelFor(numChunks, options.numThreads, [&](const std::size_t i) {
+    const int first = static_cast<int>(i) * rowsPerChunk;
+    filtered[i] = filterRows(image, first,
+                             std::min(first + rowsPerChunk, image.height));
+  });
+
+  // Compressing needs the previous group's tail as the dictionary, which is
+  // ready now that every group is filtered
+  std::vector<std::vector<uint8_t>> compressed(numChunks);
+  std::vector<uLong> checksums(numChunks);
+  parallelFor(numChunks, options.numThreads, [&](const std::size_t i) {
+    std::span<const uint8_t> dictionary;
+    if (i > 0) {
+      const auto& prev = filtered[i - 1];
+      const auto size = std::min(prev.size(), WINDOW_SIZE);
+      dictionary = std::span(prev).last(size);
+    }
+    compressed[i] = deflateChunk(filtered[i], dictionary, level,
+                                 i + 1 == numChunks);
+    checksums[i] = adler32(1, filtered[i].data(),
+                           static_cast<uInt>(filtered[i].size()));
+  });
+
+  uLong checksum = adler32(0, nullptr, 0);
+  for (std::size_t i = 0; i < numChunks; ++i) {
+    checksum = adler32_combine(checksum, checksums[i],
+                               static_cast<z_off_t>(filtered[i].size()));
+  }
+
+  std::vector<uint8_t> out(std::begin(PNG_SIGNATURE), std::end(PNG_SIGNATURE));
+  std::vector<uint8_t> header;
+  appendBe32(header, image.width);
+  appendBe32(header, image.height);
+  // Bit depth, color type, compression, filter and interlace methods
+  const uint8_t colorType = image.channels == 1 ? 0 : 2;
+  header.insert(header.end(), {8, colorType, 0, 0, 0});
+  appendChunk(out, "IHDR", {header});
+
+  // zlib header: 32KB window, the level hint and the check bits
+  const uint8_t cmf = 0x78;
+  const uint8_t levelHint = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+  uint8_t flg = levelHint << 6;
+  flg += 31 - (cmf * 256 + flg) % 31;
+  const uint8_t zlibHeader[] = {cmf, flg};
+  std::vector<uint8_t> trailer;
+  appendBe32(trailer, static_cast<uint32_t>(checksum));
+  // One IDAT per group, so the pieces never need to be joined in memory
+  for (std::size_t i = 0; i < numChunks; ++i) {
+    appendChunk(out, "IDAT",
+                {i == 0 ? std::span<const uint8_t>(zlibHeader)
+                        : std::span<const uint8_t>(),
+                 compressed[i],
+                 i + 1 == numChunks ? std::span<const uint8_t>(trailer)
+                                    : std::span<const uint8_t>()});
+  }
+  appendChunk(out, "IEND", {});
+  return out;
+}
+
+void writePng(const char* fileName, const ImageView& image,
+              const PngOptions& options) {
+  const auto png = encodePng(image, options);
+  std::ofstream file(fileName, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(std::string("failed to open file: ") + fileName);
+  }
+  file.write(reinterpret_cast<const char*>(png.data()),
+             static_cast<std::streamsize>(png.size()));
+  if (!file) {
+    throw std::runtime_error(std::string("failed to write file: ") +
+                             fileName);
+  }
+}
+
+void writeRaw(const char* fileName, const ImageView& image) {
+  checkImage(image);
+  writeFile(fileName, "", image);
+}
+
+void writePnm(const char* fileName, const ImageView& image) {
+  checkImage(image);
+  writeFile(fileName, getPnmHeader(image), image);
+}
+
+void writePnmMapped(const char* fileName, const ImageView& image) {
+  checkImage(image);
+  const auto header = getPnmHeader(image);
+  const auto pixels = getStride(image) * image.height;
+  const MappedOutputFile file(fileName, header.size() + pixels);
+  std::memcpy(file.data(), header.data(), header.size());
+  std::memcpy(file.data() + header.size(), image.data, pixels);
+}
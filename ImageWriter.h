@@ -0,0 +1,73 @@
+#pragma once
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+ * 8-bit pixels laid out row by row without padding.
+ */
+struct ImageView {
+  const uint8_t* data = nullptr;
+  int width = 0;
+  int height = 0;
+  // 1 for grayscale, 3 for RGB
+  int channels = 3;
+};
+
+struct PngOptions {
+  // zlib compression level, 0 (store) to 9 (smallest)
+  int compressionLevel = 6;
+  // Number of threads filtering and compressing row groups
+  unsigned numThreads = std::thread::hardware_concurrency();
+  // Rows per independently compressed group, 0 picks it from the image size
+  int rowsPerChunk = 0;
+};
+
+/**
+ * Encode an image to PNG.
+ * The rows are split into groups that are filtered and deflated on several
+ * threads. Each group is primed with the last 32KB of the previous group as
+ * the dictionary and ends on a byte boundary with a sync flush, so the
+ * pieces concatenate into one zlib stream. Their checksums are combined with
+ * adler32_combine.
+ * @param image Image to encode
+ * @param options Compression level and parallelism
+ * @return PNG file content
+ */
+std::vector<uint8_t> encodePng(const ImageView& image,
+                               const PngOptions& options = {});
+
+/**
+ * Encode an image to PNG and write it to a file.
+ * @param fileName Output path
+ * @param image Image to encode
+ * @param options Compression level and parallelism
+ */
+void writePng(const char* fileName, const ImageView& image,
+              const PngOptions& options = {});
+
+/**
+ * Write the pixels as they are, without any header.
+ * @param fileName Output path
+ * @param image Image to write
+ */
+void writeRaw(const char* fileName, const ImageView& image);
+
+/**
+ * Write a binary PGM (1 channel) or PPM (3 channels) file.
+ * @param fileName Output path
+ * @param image Image to write
+ */
+void writePnm(const char* fileName, const ImageView& image);
+
+/**
+ * Write a binary PGM/PPM file through a shared memory mapping, so the pixels
+ * are copied straight into the page cache without write() calls.
+ * @param fileName Output path
+ * @param image Image to write
+ */
+void writePnmMapped(const char* fileName, const ImageView& image);
+
+#endif //IMAGEWRITER_H
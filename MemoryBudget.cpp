@@ -0,0 +1,173 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+MemoryBudget::MemoryBudget(const std::size_t limitBytes) : limit(limitBytes) {
+}
+
+void MemoryBudget::attach(Client& client) {
+  std::lock_guard lock(mutex);
+  if (!clients.try_emplace(&client).second) {
+    throw std::invalid_argument("memory budget: client attached twice");
+  }
+}
+
+void MemoryBudget::detach(Client& client) {
+  std::unique_lock lock(mutex);
+  const auto it = clients.find(&client);
+  if (it == clients.end()) return;
+  eraseEntries(client);
+  evictionsDone.wait(lock, [&] { return it->second.evicting == 0; });
+  clients.erase(it);
+}
+
+void MemoryBudget::eraseEntries(const Client& client) {
+  std::erase_if(entries, [&](const auto& entry) {
+    if (entry.first.client != &client) return false;
+    used -= entry.second.bytes;
+    queue.erase(entry.second.position);
+    return true;
+  });
+}
+
+void MemoryBudget::charge(Client& client, const uint64_t key,
+                          const std::size_t bytes, const double cost) {
+  std::unique_lock lock(mutex);
+  if (!clients.contains(&client)) {
+    throw std::invalid_argument("memory budget: client not attached");
+  }
+  const EntryKey entryKey{&client, key};
+  const double density = cost / static_cast<double>(std::max<std::size_t>(
+                           bytes, 1));
+  auto [it, inserted] = entries.try_emplace(entryKey);
+  auto& entry = it->second;
+  if (!inserted) {
+    used -= entry.bytes;
+    queue.erase(entry.position);
+  }
+  entry.bytes = bytes;
+  entry.density = density;
+  entry.position = queue.emplace(inflation + density, entryKey);
+  used += bytes;
+  if (used > limit) evictDownTo(lock, limit, &entryKey);
+  stats.peak = std::max(stats.peak, used);
+}
+
+void MemoryBudget::touch(Client& client, const uint64_t key) {
+  std::lock_guard lock(mutex);
+  const auto it = entries.find(EntryKey{&client, key});
+  if (it == entries.end()) return;
+  // Move the node instead of reallocating it, hits must not allocate
+  auto node = queue.extract(it->second.position);
+  node.key() = inflation + it->second.density;
+  it->second.position = queue.insert(std::move(node));
+}
+
+void MemoryBudget::erase(const decltype(entries)::iterator it) {
+  used -= it->second.bytes;
+  queue.erase(it->second.position);
+  entries.erase(it);
+}
+
+void MemoryBudget::release(Client& client, const uint64_t key) {
+  std::lock_guard lock(mutex);
+  const auto it = entries.find(EntryKey{&client, key});
+  if (it != entries.end()) erase(it);
+}
+
+void MemoryBudget::releaseAll(Client& client) {
+  std::lock_guard lock(mutex);
+  eraseEntries(client);
+}
+
+void MemoryBudget::evictDownTo(std::unique_lock<std::mutex>& lock,
+                               const std::size_t target,
+                               const EntryKey* keep) {
+  std::vector<EntryKey> victims;
+  std::size_t evictedBytes = 0;
+  for (auto q = queue.begin(); used > target && q != queue.end();) {
+    if (keep && q->second == *keep) {
+      ++q;
+      continue;
+    }
+    inflation = std::max(inflation, q->first);
+    const auto it = entries.find(q->second);
+    ++q;
+    evictedBytes += it->second.bytes;
+    victims.push_back(it->first);
+    ++clients.at(it->first.client).evicting;
+    erase(it);
+  }
+  if (victims.empty()) return;
+  stats.evictions += victims.size();
+  stats.evictedBytes += evictedBytes;
+  const PressureEvent event{used, limit, evictedBytes, victims.size()};
+  std::vector<PressureListener> notified;
+  for (const auto& [id, listener] : listeners) notified.push_back(listener);
+
+  // Clients take their own locks to drop the entries, and may charge the
+  // budget from other threads meanwhile
+  lock.unlock();
+  for (const auto& victim : victims) victim.client->evictEntry(victim.key);
+  lock.lock();
+  for (const auto& victim : victims) --clients.at(victim.client).evicting;
+  evictionsDone.notify_all();
+  lock.unlock();
+  for (const auto& listener : notified) listener(event);
+  lock.lock();
+}
+
+void MemoryBudget::setLimit(const std::size_t bytes) {
+  std::unique_lock lock(mutex);
+  limit = bytes;
+  if (used > limit) evictDownTo(lock, limit, nullptr);
+}
+
+void MemoryBudget::trim(const std::size_t targetBytes) {
+  std::unique_lock lock(mutex);
+  if (used > targetBytes) evictDownTo(lock, targetBytes, nullptr);
+}
+
+int MemoryBudget::addPressureListener(PressureListener listener) {
+  std::lock_guard lock(mutex);
+  listeners.emplace_back(nextListenerId, std::move(listener));
+  return nextListenerId++;
+}
+
+void MemoryBudget::removePressureListener(const int id) {
+  std::lock_guard lock(mutex);
+  std::erase_if(listeners, [&](const auto& l) { return l.first == id; });
+}
+
+std::size_t MemoryBudget::getLimit() const {
+  std::lock_guard lock(mutex);
+  return limit;
+}
+
+std::size_t MemoryBudget::getUsed() const {
+  std::lock_guard lock(mutex);
+  return used;
+}
+
+MemoryBudget::Stats MemoryBudget::getStats() const {
+  std::lock_guard lock(mutex);
+  return stats;
+}
+
+MemoryReport MemoryBudget::getMemoryReport() const {
+  std::lock_guard lock(mutex);
+  MemoryReport report;
+  // The charged entries are owned and reported by the clients
+  auto bookkeeping = getHashtableMemoryUsage<
+    std::pair<const EntryKey, Entry>, true>(entries.size(),
+                                            entries.bucket_count());
+  // One tree node per entry: three links, the color and the value
+  bookkeeping += MemoryUsage{
+      queue.size() * allocationSize(4 * sizeof(void*) +
+                                    sizeof(Queue::value_type)),
+      queue.size()};
+  report.add("budget.entries", bookkeeping);
+  return report;
+}
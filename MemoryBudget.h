@@ -0,0 +1,200 @@
+#pragma once
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/Memory.h"
+
+/**
+ * Memory limit shared by several caches, for example the outline caches of
+ * a set of fonts, the raster caches of the threads drawing them and a canvas
+ * pool. Caches register as clients and charge every entry they keep with its
+ * bytes and the cost of rebuilding it. When the charged bytes go over the
+ * limit, entries are evicted across all clients by GreedyDual-Size: an entry
+ * is worth its rebuild cost per byte plus the value of the last evicted one
+ * at the time it was used, and the least worth goes first. Among entries of
+ * the same cost per byte that is plain LRU, while cheap to rebuild, large
+ * entries go before expensive, small ones. Thread-safe.
+ */
+class MemoryBudget {
+public:
+  /**
+   * Cache holding entries charged to the budget.
+   */
+  class Client {
+  public:
+    virtual ~Client() = default;
+
+  private:
+    friend class MemoryBudget;
+
+    /**
+     * Drop an entry picked for eviction. Called from the thread that pushed
+     * the budget over its limit, without the budget's lock held, so it may
+     * run concurrently with the client's own calls. The entry is already
+     * uncharged, the client must not release it. Must not throw.
+     * @param key Key the entry was charged with
+     */
+    virtual void evictEntry(uint64_t key) = 0;
+  };
+
+  /**
+   * Passed to the pressure listeners after entries were evicted.
+   */
+  struct PressureEvent {
+    // Charged bytes and limit after the eviction
+    std::size_t used;
+    std::size_t limit;
+    std::size_t evictedBytes;
+    std::size_t evictedEntries;
+  };
+
+  using PressureListener = std::function<void(const PressureEvent&)>;
+
+  struct Stats {
+    uint64_t evictions = 0;
+    uint64_t evictedBytes = 0;
+    // Most bytes charged at once, after evicting
+    std::size_t peak = 0;
+  };
+
+  /**
+   * @param limitBytes Bytes the clients may keep together
+   */
+  explicit MemoryBudget(std::size_t limitBytes);
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+  /**
+   * Register a cache. The budget must outlive the registration.
+   * @param client Cache
+   */
+  void attach(Client& client);
+  /**
+   * Unregister a cache and uncharge its entries. Waits for evictions of its
+   * entries running on other threads, so it must not be called from a
+   * client's evictEntry.
+   * @param client Cache
+   */
+  void detach(Client& client);
+  /**
+   * Charge an entry, or update it if it is charged already, and evict until
+   * the budget is back under its limit. The entry itself is never evicted
+   * by its own charge, so a cache may still hand it out. The caller must not
+   * hold a lock its evictEntry takes.
+   * @param client Cache holding the entry
+   * @param key Key of the entry, unique within the cache
+   * @param bytes Heap the entry holds
+   * @param cost Estimated nanoseconds to rebuild the entry
+   */
+  void charge(Client& client, uint64_t key, std::size_t bytes, double cost);
+  /**
+   * Mark an entry as used. Unknown entries, for example ones being evicted,
+   * are ignored.
+   */
+  void touch(Client& client, uint64_t key);
+  /**
+   * Uncharge an entry the cache dropped on its own. Never calls back into a
+   * client, so it can be called with the cache's lock held. Unknown entries
+   * are ignored.
+   */
+  void release(Client& client, uint64_t key);
+  /**
+   * Uncharge every entry of a cache, for example when it is cleared.
+   */
+  void releaseAll(Client& client);
+  /**
+   * Change the limit at runtime, a lower one evicts right away. Meant to
+   * follow the memory limit of a container as it changes.
+   * @param bytes New limit
+   */
+  void setLimit(std::size_t bytes);
+  /**
+   * Evict down to a number of bytes without changing the limit, to give
+   * memory back under transient pressure.
+   * @param targetBytes Bytes left charged at most
+   */
+  void trim(std::size_t targetBytes);
+  /**
+   * Add a listener called after every round of evictions, on the evicting
+   * thread and without the budget's lock held. It may change the limit.
+   * @param listener Listener, must not throw
+   * @return Id for removePressureListener
+   */
+  int addPressureListener(PressureListener listener);
+  void removePressureListener(int id);
+  [[nodiscard]] std::size_t getLimit() const;
+  [[nodiscard]] std::size_t getUsed() const;
+  [[nodiscard]] Stats getStats() const;
+  /**
+   * Report the memory of the budget's own bookkeeping.
+   * @return Bytes and allocations of the entry index
+   */
+  [[nodiscard]] MemoryReport getMemoryReport() const;
+
+private:
+  struct EntryKey {
+    Client* client;
+    uint64_t key;
+
+    bool operator==(const EntryKey&) const = default;
+  };
+
+  struct EntryKeyHash {
+    std::size_t operator()(const EntryKey& k) const {
+      return std::hash<const void*>{}(k.client) ^ std::hash<uint64_t>{}(k.key)
+             * 0x9e3779b97f4a7c15ull;
+    }
+  };
+
+  // Entries by worth, least first. Equal worth keeps insertion order, so
+  // the least recently used goes first.
+  using Queue = std::multimap<double, EntryKey>;
+
+  struct Entry {
+    std::size_t bytes;
+    // Cost per byte
+    double density;
+    Queue::iterator position;
+  };
+
+  struct ClientState {
+    // Evictions of its entries running without the lock
+    unsigned evicting = 0;
+  };
+
+  mutable std::mutex mutex;
+  std::condition_variable evictionsDone;
+  std::size_t limit;
+  std::size_t used = 0;
+  // Worth of the last evicted entry, added to the worth of used entries so
+  // entries that were not used for long lose to recent ones
+  double inflation = 0;
+  std::unordered_map<EntryKey, Entry, EntryKeyHash> entries;
+  Queue queue;
+  std::unordered_map<Client*, ClientState> clients;
+  std::vector<std::pair<int, PressureListener>> listeners;
+  int nextListenerId = 0;
+  Stats stats;
+
+  // Uncharge every entry of a client, mutex must be held
+  void eraseEntries(const Client& client);
+  void erase(decltype(entries)::iterator it);
+  /**
+   * Evict entries until at most target bytes are charged. mutex must be
+   * held by lock, it is released while the clients drop the entries.
+   * @param lock Lock of mutex
+   * @param target Bytes left charged at most
+   * @param keep Entry that is not evicted, or nullptr
+   */
+  void evictDownTo(std::unique_lock<std::mutex>& lock, std::size_t target,
+                   const EntryKey* keep);
+};
+
+#endif //MEMORYBUDGET_H
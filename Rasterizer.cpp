@@ -0,0 +1,43 @@
+#include "Rasterizer.h"
+
+#include "GlyphComponent.h"
+
+std::vector<Edge> buildGlyphEdges(const Glyph& glyph,
+                                  const glm::mat3& transform,
+                                  const float tolerance) {
+  RasterScratch scratch;
+  buildGlyphEdges(glyph, transform, tolerance, scratch);
+  return std::move(scratch.edges);
+}
+
+void buildGlyphEdges(const Glyph& glyph, const glm::mat3& transform,
+                     const float tolerance, RasterScratch& scratch) {
+  // The tolerance is given in pixels, flattening works in font units
+  const float pixelsPerUnit = std::max(
+      glm::length(glm::vec2(transform[0][0], transform[0][1])),
+      glm::length(glm::vec2(transform[1][0], transform[1][1])));
+  auto& edges = scratch.edges;
+  auto& contour = scratch.polyline;
+  edges.clear();
+  for (const auto& c : glyph.getComponents()) {
+    const auto numContours = c.getEndPtsOfContours().size();
+    for (std::size_t k = 0; k < numContours; ++k) {
+      c.flattenContour(k, tolerance / pixelsPerUnit, contour);
+      if (contour.size() < 2) continue;
+      for (std::size_t i = 0; i < contour.size(); ++i) {
+        const auto a = transformVec2(transform, contour[i]);
+        const auto b = transformVec2(transform,
+                                     contour[(i + 1) % contour.size()]);
+        if (a.y == b.y) continue;
+        const auto& upper = a.y < b.y ? a : b;
+        const auto& lower = a.y < b.y ? b : a;
+        edges.push_back(Edge{upper.y, lower.y, upper.x,
+                             (lower.x - upper.x) / (lower.y - upper.y),
+                             a.y < b.y ? 1 : -1});
+      }
+    }
+  }
+  std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+    return a.yTop < b.yTop;
+  });
+}
@@ -0,0 +1,274 @@
+#pragma once
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Compositor.h"
+#include "Glyph.h"
+#include "utils/Color.h"
+#include "utils/Geometry.h"
+
+// Scanline rasterizer shared by every glyph rendering path. The core is a
+// template over the fill rule, the coverage mode and the pixel format, so
+// each combination compiles to its own loop without per-pixel branches.
+
+enum class FillRule {
+  // Inside where a ray crosses an odd number of edges
+  EvenOdd,
+  // Inside where the edges crossed by a ray don't cancel out
+  NonZero,
+};
+
+/**
+ * Line segment of an outline in canvas pixels, oriented top to bottom.
+ */
+struct Edge {
+  float yTop;
+  float yBottom;
+  // x at yTop
+  float xTop;
+  // x step per pixel of y
+  float dxdy;
+  // +1 if the outline goes downwards here, -1 if it goes upwards
+  int winding;
+};
+
+/**
+ * Flatten the outline of a glyph into edges. Each component is flattened
+ * once, so the scanline loop only intersects straight lines.
+ * @param glyph Glyph
+ * @param transform Font units to canvas pixels
+ * @param tolerance Maximum distance between the edges and the curves in
+ * canvas pixels
+ * @return Edges sorted by yTop, horizontal edges are dropped
+ */
+std::vector<Edge> buildGlyphEdges(const Glyph& glyph,
+                                  const glm::mat3& transform, float tolerance);
+
+// One sample at the center of each pixel, pixels are either filled or not
+struct Aliased {
+  static constexpr int SAMPLES = 1;
+};
+
+// SAMPLES x SAMPLES samples per pixel turned into 8-bit coverage
+template <int S>
+struct Supersampled {
+  static constexpr int SAMPLES = S;
+};
+
+/**
+ * RGB pixels of a framebuffer. Aliased spans are filled with the color,
+ * coverage is composited with the blend mode.
+ */
+struct RgbTarget {
+  RGB* pixels;
+  int stride;
+  RGB color;
+  BlendMode mode = BlendMode::SrcOver;
+
+  void fillSpan(const int y, const int x0, const int x1) const {
+    auto* row = pixels + static_cast<std::size_t>(y) * stride;
+    std::fill(row + x0, row + x1, color);
+  }
+
+  void coverageRow(const int y, const int x, const uint8_t* coverage,
+                   const int n) const {
+    compositeRow(pixels + static_cast<std::size_t>(y) * stride + x, coverage,
+                 n, color, mode);
+  }
+};
+
+/**
+ * 8-bit coverage mask. Overlapping draws keep the highest coverage.
+ */
+struct MaskTarget {
+  CoverageMask& mask;
+
+  [[nodiscard]] uint8_t* row(const int y, const int x) const {
+    return mask.data.data() + static_cast<std::size_t>(y - mask.top) *
+           mask.width + (x - mask.left);
+  }
+
+  void fillSpan(const int y, const int x0, const int x1) const {
+    std::memset(row(y, x0), 255, x1 - x0);
+  }
+
+  void coverageRow(const int y, const int x, const uint8_t* coverage,
+                   const int n) const {
+    auto* dst = row(y, x);
+    for (int i = 0; i < n; ++i) dst[i] = std::max(dst[i], coverage[i]);
+  }
+};
+
+namespace rasterizer_detail {
+struct Crossing {
+  float x;
+  int winding;
+};
+
+template <FillRule Rule>
+constexpr bool isInside(const int winding) {
+  if constexpr (Rule == FillRule::EvenOdd) return winding & 1;
+  else return winding != 0;
+}
+
+/**
+ * Collect the crossings of the active edges with a sample row, dropping the
+ * edges that ended above it.
+ */
+inline void intersectRow(const std::vector<Edge>& edges, std::size_t& next,
+                         std::vector<const Edge*>& active,
+                         std::vector<Crossing>& crossings, const float sy) {
+  while (next < edges.size() && edges[next].yTop <= sy) {
+    active.push_back(&edges[next++]);
+  }
+  std::erase_if(active, [&](const Edge* e) { return e->yBottom <= sy; });
+  crossings.clear();
+  for (const auto* e : active) {
+    crossings.push_back({e->xTop + (sy - e->yTop) * e->dxdy, e->winding});
+  }
+  // Few crossings per row, insertion sort beats std::sort here
+  for (std::size_t i = 1; i < crossings.size(); ++i) {
+    const auto c = crossings[i];
+    std::size_t j = i;
+    for (; j > 0 && crossings[j - 1].x > c.x; --j) {
+      crossings[j] = crossings[j - 1];
+    }
+    crossings[j] = c;
+  }
+}
+
+/**
+ * Call span(x0, x1) for every inside interval of a sample row, in sample
+ * indices clipped to [left, right).
+ */
+template <FillRule Rule, class F>
+void forEachSpan(const std::vector<Crossing>& crossings, const int samples,
+                 const int left, const int right, F&& span) {
+  int winding = 0;
+  for (std::size_t i = 0; i + 1 < crossings.size(); ++i) {
+    winding += Rule == FillRule::EvenOdd ? 1 : crossings[i].winding;
+    if (!isInside<Rule>(winding)) continue;
+    // Samples sit at the centers of their cells
+    const int x0 = std::max(left, static_cast<int>(
+                                std::ceil(crossings[i].x * samples - 0.5f)));
+    const int x1 = std::min(right, static_cast<int>(
+                                std::ceil(crossings[i + 1].x * samples - 0.5f)));
+    if (x0 < x1) span(x0, x1);
+  }
+}
+}
+
+/**
+ * Buffers of one glyph draw, kept by the caller so that drawing more glyphs
+ * reuses their storage instead of allocating.
+ */
+struct RasterScratch {
+  std::vector<Edge> edges;
+  // Flattened contour being turned into edges
+  std::vector<glm::vec2> polyline;
+  std::vector<const Edge*> active;
+  std::vector<rasterizer_detail::Crossing> crossings;
+  std::vector<uint16_t> counts;
+  std::vector<uint8_t> coverage;
+};
+
+/**
+ * Flatten the outline of a glyph into scratch.edges, sorted by yTop.
+ * @param glyph Glyph
+ * @param transform Font units to canvas pixels
+ * @param tolerance Maximum distance between the edges and the curves in
+ * canvas pixels
+ * @param scratch Buffers to reuse
+ */
+void buildGlyphEdges(const Glyph& glyph, const glm::mat3& transform,
+                     float tolerance, RasterScratch& scratch);
+
+/**
+ * Rasterize edges into the target.
+ * @tparam Rule Fill rule
+ * @tparam Coverage Aliased or Supersampled<S>
+ * @tparam Target Pixel format, RgbTarget or MaskTarget
+ * @param edges Edges sorted by yTop
+ * @param area Pixels that may be written
+ * @param target Destination
+ */
+template <FillRule Rule, class Coverage, class Target>
+void rasterizeEdges(const std::vector<Edge>& edges, const PixelRect& area,
+                    const Target& target) {
+  RasterScratch scratch;
+  rasterizeEdges<Rule, Coverage>(edges, area, target, scratch);
+}
+
+/**
+ * Rasterize edges into the target with the row buffers of a scratch.
+ * @param edges Edges sorted by yTop, may be scratch.edges
+ * @param area Pixels that may be written
+ * @param target Destination
+ * @param scratch Buffers to reuse
+ */
+template <FillRule Rule, class Coverage, class Target>
+void rasterizeEdges(const std::vector<Edge>& edges, const PixelRect& area,
+                    const Target& target, RasterScratch& scratch) {
+  using namespace rasterizer_detail;
+  if (edges.empty() || area.isEmpty()) return;
+  constexpr int S = Coverage::SAMPLES;
+  const int top = std::max(area.top,
+                           static_cast<int>(std::floor(edges.front().yTop)));
+  std::size_t next = 0;
+  auto& active = scratch.active;
+  auto& crossings = scratch.crossings;
+  active.clear();
+
+  if constexpr (S == 1) {
+    for (int y = top; y < area.bottom; ++y) {
+      intersectRow(edges, next, active, crossings, y + 0.5f);
+      if (active.empty() && next == edges.size()) break;
+      forEachSpan<Rule>(crossings, 1, area.left, area.right,
+                        [&](const int x0, const int x1) {
+                          target.fillSpan(y, x0, x1);
+                        });
+    }
+  } else {
+    const int width = area.right - area.left;
+    auto& counts = scratch.counts;
+    auto& coverage = scratch.coverage;
+    counts.resize(width);
+    coverage.resize(width);
+    for (int y = top; y < area.bottom; ++y) {
+      std::fill_n(counts.begin(), width, 0);
+      bool covered = false;
+      for (int sub = 0; sub < S; ++sub) {
+        intersectRow(edges, next, active, crossings,
+                     y + (sub + 0.5f) / static_cast<float>(S));
+        forEachSpan<Rule>(crossings, S, area.left * S, area.right * S,
+                          [&](const int x0, const int x1) {
+                            covered = true;
+                            // Spread the samples over the pixels they fall in
+                            for (int x = x0; x < x1;) {
+                              // Masks put the pen at 0, so x may be negative
+                              const int px = x >= 0 ? x / S
+                                                    : (x - S + 1) / S;
+                              const int end = std::min(x1, (px + 1) * S);
+                              counts[px - area.left] += end - x;
+                              x = end;
+                            }
+                          });
+      }
+      if (covered) {
+        for (int i = 0; i < width; ++i) {
+          coverage[i] = static_cast<uint8_t>(counts[i] * 255 / (S * S));
+        }
+        target.coverageRow(y, area.left, coverage.data(), width);
+      }
+      if (active.empty() && next == edges.size()) break;
+    }
+  }
+}
+
+#endif //RASTERIZER_H
@@ -0,0 +1,139 @@
+#include "Stroker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "utils/Geometry.h"
+
+namespace {
+// Number of stroke polygons packed into one component. Small groups keep the
+// bounding rects tight, so the scanline rasterizer only visits the rows a
+// group actually covers.
+constexpr std::size_t PIECES_PER_COMPONENT = 32;
+
+float signedArea(const std::vector<glm::vec2>& polygon) {
+  float area = 0;
+  for (std::size_t i = 0; i < polygon.size(); ++i) {
+    const auto& a = polygon[i];
+    const auto& b = polygon[(i + 1) % polygon.size()];
+    area += a.x * b.y - b.x * a.y;
+  }
+  return area / 2;
+}
+
+float cross(const glm::vec2& u, const glm::vec2& v) {
+  return u.x * v.y - u.y * v.x;
+}
+
+GlyphComponent makeComponent(const std::vector<std::vector<glm::vec2>>& pieces,
+                             const std::size_t begin, const std::size_t end) {
+  std::vector<uint16_t> endPtsOfContours;
+  std::vector<glm::vec2> coordinates;
+  auto minPt = pieces[begin].front();
+  auto maxPt = minPt;
+  for (std::size_t p = begin; p < end; ++p) {
+    for (const auto& pt : pieces[p]) {
+      coordinates.emplace_back(pt);
+      minPt = glm::vec2(std::min(minPt.x, pt.x), std::min(minPt.y, pt.y));
+      maxPt = glm::vec2(std::max(maxPt.x, pt.x), std::max(maxPt.y, pt.y));
+    }
+    endPtsOfContours.push_back(static_cast<uint16_t>(coordinates.size() - 1));
+  }
+  const BoundingRect rect{
+      static_cast<int>(std::floor(minPt.x)),
+      static_cast<int>(std::ceil(maxPt.x)),
+      static_cast<int>(std::floor(minPt.y)),
+      static_cast<int>(std::ceil(maxPt.y))};
+  const auto n = static_cast<uint16_t>(coordinates.size());
+  // Polygon corners are all on the curve
+  return GlyphComponent{n, std::move(endPtsOfContours),
+                        std::vector<uint8_t>(n, 1), rect,
+                        std::move(coordinates)};
+}
+}
+
+Stroker::Stroker(const StrokeStyle style_, const float tolerance_) :
+  style(style_), tolerance(tolerance_) {
+}
+
+Glyph Stroker::stroke(const Glyph& glyph) const {
+  std::vector<std::vector<glm::vec2>> pieces;
+  for (const auto& c : glyph.getComponents()) {
+    for (const auto& polyline : c.getFlattenedContours(tolerance)) {
+      strokePolyline(polyline, pieces);
+    }
+  }
+
+  std::vector<GlyphComponent> components;
+  for (std::size_t i = 0; i < pieces.size(); i += PIECES_PER_COMPONENT) {
+    components.emplace_back(makeComponent(
+        pieces, i, std::min(i + PIECES_PER_COMPONENT, pieces.size())));
+  }
+  return Glyph(std::move(components), glyph.getMetric());
+}
+
+void Stroker::strokePolyline(const std::vector<glm::vec2>& polyline,
+                             std::vector<std::vector<glm::vec2>>& pieces)
+const {
+  const float halfWidth = style.width / 2;
+
+  // Drop zero-length segments so that every segment has a direction
+  std::vector<glm::vec2> pts;
+  for (const auto& pt : polyline) {
+    if (pts.empty() || glm::length(pt - pts.back()) > eps) pts.emplace_back(pt);
+  }
+  while (pts.size() > 1 && glm::length(pts.front() - pts.back()) <= eps) {
+    pts.pop_back();
+  }
+  const auto n = pts.size();
+  if (n < 2) return;
+
+  const auto firstPiece = pieces.size();
+  const auto direction = [&](const std::size_t i) {
+    return glm::normalize(pts[(i + 1) % n] - pts[i]);
+  };
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto& a = pts[i];
+    const auto& b = pts[(i + 1) % n];
+    const auto dir = direction(i);
+    const auto normal = glm::vec2(-dir.y, dir.x) * halfWidth;
+    pieces.push_back({a + normal, b + normal, b - normal, a - normal});
+    addJoin(b, dir, direction((i + 1) % n), pieces);
+  }
+
+  // Wind every piece like a TrueType outer contour (clockwise, y-up)
+  for (auto i = firstPiece; i < pieces.size(); ++i) {
+    auto& piece = pieces[i];
+    if (signedArea(piece) > 0) std::reverse(piece.begin(), piece.end());
+  }
+}
+
+void Stroker::addJoin(const glm::vec2& vertex, const glm::vec2& prevDir,
+                      const glm::vec2& nextDir,
+                      std::vector<std::vector<glm::vec2>>& pieces) const {
+  const float turn = cross(prevDir, nextDir);
+  // Collinear segments already overlap at the vertex
+  if (std::fabs(turn) <= eps && glm::dot(prevDir, nextDir) > 0) return;
+
+  const float halfWidth = style.width / 2;
+  // The gap opens on the opposite side of the turn
+  const float side = turn > 0 ? -1.0f : 1.0f;
+  const auto prevNormal = glm::vec2(-prevDir.y, prevDir.x) * side;
+  const auto nextNormal = glm::vec2(-nextDir.y, nextDir.x) * side;
+  const auto prevEdge = vertex + prevNormal * halfWidth;
+  const auto nextEdge = vertex + nextNormal * halfWidth;
+
+  if (style.join == LineJoin::Miter) {
+    const auto bisector = prevNormal + nextNormal;
+    // cos of the half angle between the two normals
+    const float cosHalf = glm::length(bisector) / 2;
+    if (cosHalf > eps && 1.0f / cosHalf <= style.miterLimit) {
+      const auto tip = vertex + glm::normalize(bisector) * (halfWidth /
+                         cosHalf);
+      pieces.push_back({vertex, prevEdge, tip, nextEdge});
+      return;
+    }
+  }
+  pieces.push_back({vertex, prevEdge, nextEdge});
+}
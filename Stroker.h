@@ -0,0 +1,65 @@
+#pragma once
+#ifndef STROKER_H
+#define STROKER_H
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Glyph.h"
+
+enum class LineJoin {
+  Miter,
+  Bevel,
+};
+
+struct StrokeStyle {
+  // Stroke width in font units
+  float width;
+  LineJoin join = LineJoin::Miter;
+  // Miter joins longer than width * miterLimit / 2 fall back to bevel joins
+  float miterLimit = 4.0f;
+};
+
+/**
+ * Turns glyph outlines into fillable stroke polygons.
+ * Every flattened segment becomes a quad and every corner a join polygon,
+ * all wound like TrueType outer contours, so filling the result once with
+ * the non-zero rule gives the union of them.
+ */
+class Stroker {
+public:
+  /**
+   * @param style_ Stroke style
+   * @param tolerance_ Flattening tolerance in font units
+   */
+  explicit Stroker(StrokeStyle style_, float tolerance_);
+  /**
+   * Stroke all components of the glyph.
+   * @param glyph Glyph to stroke
+   * @return Glyph whose components are the stroke polygons
+   */
+  [[nodiscard]] Glyph stroke(const Glyph& glyph) const;
+  /**
+   * Stroke a closed polyline.
+   * @param polyline Closed polyline without the repeated closing point
+   * @param pieces Output polygons, appended
+   */
+  void strokePolyline(const std::vector<glm::vec2>& polyline,
+                      std::vector<std::vector<glm::vec2>>& pieces) const;
+
+private:
+  StrokeStyle style;
+  float tolerance;
+
+  /**
+   * Add the join polygon for the corner at the given vertex.
+   * @param vertex Corner vertex
+   * @param prevDir Unit direction of the incoming segment
+   * @param nextDir Unit direction of the outgoing segment
+   * @param pieces Output polygons, appended
+   */
+  void addJoin(const glm::vec2& vertex, const glm::vec2& prevDir,
+               const glm::vec2& nextDir,
+               std::vector<std::vector<glm::vec2>>& pieces) const;
+};
+
+#endif //STROKER_H
@@ -0,0 +1,123 @@
+#include "TextLayout.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "utils/Unicode.h"
+
+namespace {
+bool isSpace(const uint32_t cp) {
+  return cp == ' ' || cp == '\t' || cp == 0x3000;
+}
+
+// Ideographs, kana and hangul can be broken between any two characters
+bool isCjk(const uint32_t cp) {
+  return (cp >= 0x2E80 && cp <= 0x9FFF) || (cp >= 0xAC00 && cp <= 0xD7AF) ||
+         (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0xFF00 && cp <= 0xFFEF) ||
+         (cp >= 0x20000 && cp <= 0x2FFFF);
+}
+}
+
+TextLayouter::TextLayouter(const FontParser& parser_) :
+  parser(parser_), metric(parser_.getFontMetric()) {
+  for (uint32_t cp = 0; cp < asciiGlyphs.size(); ++cp) {
+    const auto glyphCode = parser.getGlyphCode(cp);
+    asciiGlyphs[cp] = {glyphCode, parser.getMetric(glyphCode).advanceWidth};
+  }
+}
+
+TextLayouter::CachedGlyph TextLayouter::lookup(const uint32_t cp) {
+  if (cp < asciiGlyphs.size()) return asciiGlyphs[cp];
+  const auto it = glyphs.find(cp);
+  if (it != glyphs.end()) return it->second;
+  const auto glyphCode = parser.getGlyphCode(cp);
+  const CachedGlyph glyph{glyphCode, parser.getMetric(glyphCode).advanceWidth};
+  glyphs.emplace(cp, glyph);
+  return glyph;
+}
+
+ParagraphLayout TextLayouter::layout(const std::string_view text,
+                                     const int32_t maxWidth,
+                                     const float lineSpacing) {
+  const int32_t lineHeight = static_cast<int32_t>(
+      std::lround((metric.ascent - metric.descent) * lineSpacing));
+  ParagraphLayout result;
+  // Every byte is at most one glyph
+  result.glyphs.reserve(text.size());
+  auto& out = result.glyphs;
+
+  // Pen position and width of the inked part of the current line
+  int32_t x = 0;
+  int32_t inkWidth = 0;
+  uint32_t lineFirst = 0;
+  // Last place the current line can be broken: the next line would start
+  // at glyph breakGlyph and pen position breakX
+  bool hasBreak = false;
+  uint32_t breakGlyph = 0;
+  int32_t breakWidth = 0;
+  int32_t breakX = 0;
+  // Spaces at the start of a wrapped line are dropped
+  bool wrapped = false;
+
+  auto closeLine = [&](const uint32_t end, const int32_t width) {
+    const auto baseline = metric.ascent +
+                          static_cast<int32_t>(result.lines.size()) *
+                          lineHeight;
+    result.lines.push_back({lineFirst, end - lineFirst, width, baseline});
+    result.width = std::max(result.width, width);
+    lineFirst = end;
+    hasBreak = false;
+  };
+  auto setBreak = [&] {
+    hasBreak = true;
+    breakGlyph = static_cast<uint32_t>(out.size());
+    breakWidth = inkWidth;
+    breakX = x;
+  };
+
+  Utf8Decoder decoder(text);
+  for (uint32_t cp; decoder.next(cp);) {
+    if (cp == '\n') {
+      closeLine(static_cast<uint32_t>(out.size()), inkWidth);
+      x = inkWidth = 0;
+      wrapped = false;
+      continue;
+    }
+    if (cp == '\r') continue;
+
+    const auto glyph = lookup(cp);
+    if (isSpace(cp)) {
+      if (wrapped && out.size() == lineFirst) continue;
+      x += glyph.advance;
+      setBreak();
+      continue;
+    }
+    const bool cjk = isCjk(cp);
+    if (cjk && out.size() > lineFirst) setBreak();
+
+    while (x + glyph.advance > maxWidth && out.size() > lineFirst) {
+      if (hasBreak && breakGlyph > lineFirst) {
+        // Move the glyphs after the break to the next line
+        closeLine(breakGlyph, breakWidth);
+        for (auto j = breakGlyph; j < out.size(); ++j) out[j].x -= breakX;
+        x -= breakX;
+        inkWidth = out.size() > lineFirst ? inkWidth - breakX : 0;
+      } else {
+        // No break in the line, cut the word where it overflows
+        closeLine(static_cast<uint32_t>(out.size()), inkWidth);
+        x = inkWidth = 0;
+      }
+      wrapped = true;
+    }
+
+    out.push_back({glyph.glyphCode, x});
+    x += glyph.advance;
+    inkWidth = x;
+    if (cjk || cp == '-') setBreak();
+  }
+  closeLine(static_cast<uint32_t>(out.size()), inkWidth);
+
+  result.height = static_cast<int32_t>(result.lines.size() - 1) * lineHeight +
+                  metric.ascent - metric.descent;
+  return result;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef TEXTLAYOUT_H
+#define TEXTLAYOUT_H
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "FontParser.h"
+
+/**
+ * A glyph placed on a line, in font units from the start of the line.
+ */
+struct PositionedGlyph {
+  uint16_t glyphCode;
+  int32_t x;
+};
+
+struct LayoutLine {
+  // Range of the line's glyphs in ParagraphLayout::glyphs
+  uint32_t firstGlyph;
+  uint32_t numGlyphs;
+  // Width without trailing spaces, in font units
+  int32_t width;
+  // Distance from the top of the paragraph to the baseline, in font units
+  int32_t baseline;
+};
+
+struct ParagraphLayout {
+  // Glyphs of every line, spaces are left out since they draw nothing
+  std::vector<PositionedGlyph> glyphs;
+  std::vector<LayoutLine> lines;
+  // Width of the widest line, in font units
+  int32_t width = 0;
+  // Height of all lines, in font units
+  int32_t height = 0;
+};
+
+/**
+ * Breaks text into lines and places the glyphs.
+ * Advances are looked up in the font once per codepoint and cached, so
+ * laying out text only touches the text and the cache. Not thread-safe,
+ * use one layouter per thread.
+ */
+class TextLayouter {
+public:
+  /**
+   * @param parser_ Font parser, must outlive the layouter
+   */
+  explicit TextLayouter(const FontParser& parser_);
+  /**
+   * Lay out a paragraph with greedy line breaking in a single pass.
+   * Lines break after spaces and hyphens, around CJK characters and at
+   * '\n'. A word wider than the line is broken where it overflows.
+   * Invalid UTF-8 is laid out as U+FFFD.
+   * @param text UTF-8 encoded text
+   * @param maxWidth Maximum line width in font units
+   * @param lineSpacing Line height as a multiple of ascent - descent
+   * @return Positioned glyphs and lines
+   */
+  ParagraphLayout layout(std::string_view text, int32_t maxWidth,
+                         float lineSpacing = 1.f);
+
+private:
+  struct CachedGlyph {
+    uint16_t glyphCode;
+    uint16_t advance;
+  };
+
+  const FontParser& parser;
+  FontMetric metric;
+  std::array<CachedGlyph, 128> asciiGlyphs;
+  std::unordered_map<uint32_t, CachedGlyph> glyphs;
+
+  CachedGlyph lookup(uint32_t cp);
+};
+
+#endif //TEXTLAYOUT_H
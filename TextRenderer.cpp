@@ -0,0 +1,69 @@
+#include "TextRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "utils/Unicode.h"
+
+TextLine layoutText(const FontParser& parser, const std::string& text,
+                    const int pixelHeight) {
+  const auto [ascent, descent] = parser.getFontMetric();
+  const float scale = static_cast<float>(pixelHeight) / (ascent - descent);
+  TextLine line{{}, 0, pixelHeight, scale, ascent};
+  // Same placement as FontParser::getGlyphs, decoded without a codepoint
+  // vector
+  forEachCodepoint(text, [&](const uint32_t cp) {
+    // Glyph 0 is .notdef, what the cmap gives for unmapped codepoints
+    const auto code = parser.getGlyphCode(cp);
+    if (code == 0) throw std::invalid_argument("Glyph not found");
+    line.glyphs.push_back(parser.getCachedGlyph(code));
+    line.width += line.glyphs.back()->getMetric().advanceWidth * scale;
+  }, Utf8Errors::Throw);
+  return line;
+}
+
+FrameBufferCanvas rasterizeText(const TextLine& line) {
+  // Keep at least one column so empty text still makes a valid image
+  FrameBufferCanvas canvas{std::max(line.width, 1), line.height};
+  rasterizeText(line, canvas);
+  return canvas;
+}
+
+void rasterizeText(const TextLine& line, FrameBufferCanvas& canvas) {
+  canvas.reset(std::max(line.width, 1), line.height);
+  canvas.setGlyphBaseline(line.ascent);
+  canvas.setScale(line.scale);
+  canvas.renderGlyphs(line.glyphs);
+}
+
+FrameBufferCanvas renderText(const FontParser& parser, const std::string& text,
+                             const int pixelHeight) {
+  return rasterizeText(layoutText(parser, text, pixelHeight));
+}
+
+void renderText(const FontParser& parser, const std::string& text,
+                const int pixelHeight, FrameBufferCanvas& canvas) {
+  rasterizeText(layoutText(parser, text, pixelHeight), canvas);
+}
+
+FrameBufferCanvas renderParagraph(const FontParser& parser,
+                                  const ParagraphLayout& layout,
+                                  const float scale, const RGB color) {
+  FrameBufferCanvas canvas{
+      std::max(1, static_cast<int>(std::ceil(layout.width * scale))),
+      std::max(1, static_cast<int>(std::ceil(layout.height * scale)))};
+  canvas.setScale(scale);
+  // The canvas moves the baseline relative to the previous one
+  int32_t baseline = 0;
+  for (const auto& line : layout.lines) {
+    canvas.setGlyphBaseline(line.baseline - baseline);
+    baseline = line.baseline;
+    for (uint32_t i = 0; i < line.numGlyphs; ++i) {
+      const auto& g = layout.glyphs[line.firstGlyph + i];
+      canvas.renderGlyphByNonZero(*parser.getCachedGlyph(g.glyphCode), color,
+                                  g.x);
+    }
+  }
+  return canvas;
+}
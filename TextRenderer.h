@@ -0,0 +1,86 @@
+#pragma once
+#ifndef TEXTRENDERER_H
+#define TEXTRENDERER_H
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FontParser.h"
+#include "FrameBufferCanvas.h"
+#include "TextLayout.h"
+
+/**
+ * Glyphs of a line of text and what is needed to place them on a canvas.
+ */
+struct TextLine {
+  // Shared with the parser's outline cache
+  std::vector<std::shared_ptr<const Glyph>> glyphs;
+  // Width of the line in pixels
+  int width = 0;
+  // Height of the line (ascent to descent) in pixels
+  int height = 0;
+  float scale = 1;
+  // Ascent in font units, the baseline sits this far below the top
+  int16_t ascent = 0;
+};
+
+/**
+ * Get the glyphs of a line of text from the parser's outline cache, each
+ * glyph is decoded once per parser. Unless level of detail was enabled on
+ * the parser, the text renders the same as from freshly decoded glyphs.
+ * Throws std::invalid_argument for invalid UTF-8 or a codepoint the font
+ * has no glyph for.
+ * @param parser Font parser
+ * @param text UTF-8 encoded text
+ * @param pixelHeight Height of the line (ascent to descent) in pixels
+ * @return Decoded line
+ */
+TextLine layoutText(const FontParser& parser, const std::string& text,
+                    int pixelHeight);
+
+/**
+ * Rasterize a decoded line on a canvas sized to fit it.
+ * @param line Decoded line
+ * @return Canvas with the rendered text
+ */
+FrameBufferCanvas rasterizeText(const TextLine& line);
+/**
+ * Rasterize a decoded line on an existing canvas, resized to fit it.
+ * Reusing the canvas avoids allocating a framebuffer per line.
+ * @param line Decoded line
+ * @param canvas Target canvas, reset before drawing
+ */
+void rasterizeText(const TextLine& line, FrameBufferCanvas& canvas);
+
+/**
+ * Render a single line of text on a canvas sized to fit it.
+ * @param parser Font parser
+ * @param text UTF-8 encoded text
+ * @param pixelHeight Height of the line (ascent to descent) in pixels
+ * @return Canvas with the rendered text
+ */
+FrameBufferCanvas renderText(const FontParser& parser, const std::string& text,
+                             int pixelHeight);
+/**
+ * Render a single line of text on an existing canvas, resized to fit it.
+ * @param parser Font parser
+ * @param text UTF-8 encoded text
+ * @param pixelHeight Height of the line (ascent to descent) in pixels
+ * @param canvas Target canvas, reset before drawing
+ */
+void renderText(const FontParser& parser, const std::string& text,
+                int pixelHeight, FrameBufferCanvas& canvas);
+/**
+ * Render a laid out paragraph on a canvas sized to fit all its lines.
+ * Glyphs come from the parser's glyph cache, each is decoded once.
+ * @param parser Font parser the layout was made with
+ * @param layout Paragraph layout
+ * @param scale Scaling value of glyph size
+ * @param color Fill color
+ * @return Canvas with the rendered paragraph
+ */
+FrameBufferCanvas renderParagraph(const FontParser& parser,
+                                  const ParagraphLayout& layout, float scale,
+                                  RGB color = WHITE);
+
+#endif //TEXTRENDERER_H
@@ -0,0 +1,30 @@
+#include "TileRasterizer.h"
+
+std::vector<std::vector<StripEdge>> binEdges(
+    const std::span<const std::vector<Edge>> shapes, const PixelRect& area,
+    const int samples) {
+  using namespace tile_detail;
+  const int numStrips = (area.bottom - area.top + TILE_SIZE - 1) / TILE_SIZE;
+  const int stripRows = TILE_SIZE * samples;
+  const int top = area.top * samples;
+  const int bottom = area.bottom * samples;
+  std::vector<std::vector<StripEdge>> strips(numStrips);
+  for (uint32_t shape = 0; shape < shapes.size(); ++shape) {
+    const auto& edges = shapes[shape];
+    for (uint32_t i = 0; i < edges.size(); ++i) {
+      const auto& e = edges[i];
+      const int begin = std::max(firstSampleRow(e.yTop, samples), top);
+      const int end = std::min(firstSampleRow(e.yBottom, samples), bottom);
+      for (int row = begin; row < end;) {
+        const int strip = (row - top) / stripRows;
+        const int stripTop = top + strip * stripRows;
+        const int rowEnd = std::min(end, stripTop + stripRows);
+        strips[strip].push_back(StripEdge{
+            shape, i, static_cast<uint16_t>(row - stripTop),
+            static_cast<uint16_t>(rowEnd - stripTop)});
+        row = rowEnd;
+      }
+    }
+  }
+  return strips;
+}
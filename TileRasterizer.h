@@ -0,0 +1,317 @@
+#pragma once
+#ifndef TILERASTERIZER_H
+#define TILERASTERIZER_H
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "Rasterizer.h"
+
+// Sparse strip rasterizer, the second engine beside the scanline one. The
+// edges of every shape of a draw are binned into strips, rows of square
+// tiles, and their crossings with the sample rows into the tiles. Coverage
+// is computed only in tiles that have crossings, the tiles between them are
+// filled as solid spans from the winding carried over from the left. A strip
+// writes only its own pixels, so strips render in parallel and in any
+// order. Samples and crossings are computed exactly like rasterizeEdges
+// does, so both engines produce the same pixels.
+
+enum class RasterEngine {
+  // One shape at a time, sample row by sample row
+  Scanline,
+  // Every shape of a draw binned into tiles, strips rendered in parallel
+  SparseStrips,
+};
+
+// Tiles are TILE_SIZE x TILE_SIZE pixels
+constexpr int TILE_SIZE = 16;
+
+/**
+ * Edge of a shape that passes through a strip.
+ */
+struct StripEdge {
+  uint32_t shape;
+  uint32_t edge;
+  // Sample rows of the strip the edge is active on, from its top
+  uint16_t rowBegin;
+  uint16_t rowEnd;
+};
+
+namespace tile_detail {
+/**
+ * Get the y of a sample row, the rows are centered in their cells.
+ * @param row Sample row, pixel row * samples + sub row
+ * @param samples Samples per pixel along each axis
+ */
+inline float sampleY(const int row, const int samples) {
+  const int y = row >= 0 ? row / samples : (row - samples + 1) / samples;
+  return y + (row - y * samples + 0.5f) / static_cast<float>(samples);
+}
+
+/**
+ * Get the first sample row at or below y.
+ */
+inline int firstSampleRow(const float y, const int samples) {
+  auto row = static_cast<int>(std::ceil(y * samples - 0.5f));
+  while (sampleY(row - 1, samples) >= y) --row;
+  while (sampleY(row, samples) < y) ++row;
+  return row;
+}
+
+/**
+ * Get the first sample right of where the edge crosses a sample row at sy.
+ * The crossing flips the winding of that sample and every one after it.
+ */
+inline int crossingSample(const Edge& e, const float sy, const int samples) {
+  const float x = e.xTop + (sy - e.yTop) * e.dxdy;
+  return static_cast<int>(std::ceil(x * samples - 0.5f));
+}
+
+/**
+ * Crossing of an edge with a sample row, binned into a tile.
+ */
+struct TileCrossing {
+  // Tile column, -1 left of the area
+  int column;
+  int row;
+  int x;
+  int winding;
+
+  bool operator<(const TileCrossing& o) const {
+    if (column != o.column) return column < o.column;
+    if (row != o.row) return row < o.row;
+    return x < o.x;
+  }
+};
+
+/**
+ * Rasterize the shapes passing through one strip.
+ */
+template <FillRule Rule, class Coverage, class Target>
+void rasterizeStrip(const std::span<const std::vector<Edge>> shapes,
+                    const std::vector<StripEdge>& stripEdges,
+                    const PixelRect& area, const int strip,
+                    const Target& target) {
+  using rasterizer_detail::isInside;
+  constexpr int S = Coverage::SAMPLES;
+  const int y0 = area.top + strip * TILE_SIZE;
+  const int y1 = std::min(y0 + TILE_SIZE, area.bottom);
+  const int numRows = (y1 - y0) * S;
+  const int numColumns = (area.right - area.left + TILE_SIZE - 1) / TILE_SIZE;
+  const int left = area.left * S;
+  const int right = area.right * S;
+
+  std::vector<float> rowY(numRows);
+  for (int row = 0; row < numRows; ++row) rowY[row] = sampleY(y0 * S + row, S);
+  // Winding of each sample row left of the next tile
+  std::vector<int> backdrop(numRows);
+  std::vector<TileCrossing> unsorted;
+  std::vector<TileCrossing> crossings;
+  std::vector<uint32_t> offsets;
+  std::vector<uint16_t> counts(TILE_SIZE);
+  std::vector<uint8_t> coverage(area.right - area.left);
+
+  // Tiles without crossings have the same winding across each sample row
+  const auto fillGap = [&](const int column0, const int column1) {
+    const int x0 = area.left + column0 * TILE_SIZE;
+    const int x1 = std::min(area.left + column1 * TILE_SIZE, area.right);
+    if (x0 >= x1) return;
+    for (int y = y0; y < y1; ++y) {
+      int inside = 0;
+      for (int sub = 0; sub < S; ++sub) {
+        inside += isInside<Rule>(backdrop[(y - y0) * S + sub]);
+      }
+      if (inside == 0) continue;
+      if constexpr (S == 1) {
+        target.fillSpan(y, x0, x1);
+      } else {
+        std::fill(coverage.begin(), coverage.begin() + (x1 - x0),
+                  static_cast<uint8_t>(inside * S * 255 / (S * S)));
+        target.coverageRow(y, x0, coverage.data(), x1 - x0);
+      }
+    }
+  };
+
+  // Crossings of the tile are sorted by row, then by x
+  const auto renderTile = [&](const int column, const TileCrossing* first,
+                              const TileCrossing* last) {
+    const int x0 = area.left + column * TILE_SIZE;
+    const int x1 = std::min(x0 + TILE_SIZE, area.right);
+    const int tileLeft = x0 * S;
+    const int tileRight = x1 * S;
+    for (int y = y0; y < y1; ++y) {
+      std::fill(counts.begin(), counts.end(), 0);
+      bool covered = false;
+      for (int sub = 0; sub < S; ++sub) {
+        const int row = (y - y0) * S + sub;
+        int winding = backdrop[row];
+        int x = tileLeft;
+        // Emit the span from x to the next crossing if it is inside
+        const auto span = [&](const int end) {
+          if (x < end && isInside<Rule>(winding)) {
+            if constexpr (S == 1) {
+              target.fillSpan(y, x, end);
+            } else {
+              covered = true;
+              for (int sx = x; sx < end;) {
+                const int px = sx >= 0 ? sx / S : (sx - S + 1) / S;
+                const int pxEnd = std::min(end, (px + 1) * S);
+                counts[px - x0] += pxEnd - sx;
+                sx = pxEnd;
+              }
+            }
+          }
+          x = end;
+        };
+        for (; first != last && first->row == row; ++first) {
+          span(first->x);
+          winding += first->winding;
+        }
+        span(tileRight);
+        backdrop[row] = winding;
+      }
+      if (covered) {
+        for (int i = 0; i < x1 - x0; ++i) {
+          coverage[i] = static_cast<uint8_t>(counts[i] * 255 / (S * S));
+        }
+        target.coverageRow(y, x0, coverage.data(), x1 - x0);
+      }
+    }
+  };
+
+  // Edges are grouped by shape
+  for (auto it = stripEdges.begin(); it != stripEdges.end();) {
+    const auto shape = it->shape;
+    const auto& edges = shapes[shape];
+    // Bin every crossing of the shape with the strip into its tile
+    unsorted.clear();
+    int minColumn = numColumns;
+    int maxColumn = -1;
+    for (; it != stripEdges.end() && it->shape == shape; ++it) {
+      const auto& e = edges[it->edge];
+      for (int row = it->rowBegin; row < it->rowEnd; ++row) {
+        const int x = crossingSample(e, rowY[row], S);
+        // Right of the area nothing is drawn
+        if (x >= right) continue;
+        const int column = x < left ? -1 : (x - left) / (TILE_SIZE * S);
+        minColumn = std::min(minColumn, column);
+        maxColumn = std::max(maxColumn, column);
+        unsorted.push_back({column, row, x, e.winding});
+      }
+    }
+    // Counting sort by tile and row, then the few crossings of each row of
+    // a tile are put in x order
+    const auto key = [&](const TileCrossing& c) {
+      return static_cast<std::size_t>(c.column - minColumn) * numRows + c.row;
+    };
+    const auto numKeys = maxColumn < minColumn
+                           ? 0
+                           : static_cast<std::size_t>(
+                               maxColumn - minColumn + 1) * numRows;
+    offsets.assign(numKeys + 1, 0);
+    for (const auto& c : unsorted) ++offsets[key(c) + 1];
+    for (std::size_t i = 1; i < offsets.size(); ++i) {
+      offsets[i] += offsets[i - 1];
+    }
+    crossings.resize(unsorted.size());
+    for (const auto& c : unsorted) crossings[offsets[key(c)]++] = c;
+    for (std::size_t i = 1; i < crossings.size(); ++i) {
+      const auto c = crossings[i];
+      std::size_t j = i;
+      for (; j > 0 && c < crossings[j - 1]; --j) {
+        crossings[j] = crossings[j - 1];
+      }
+      crossings[j] = c;
+    }
+
+    std::fill(backdrop.begin(), backdrop.end(), 0);
+    int nextColumn = 0;
+    for (auto c = crossings.begin(); c != crossings.end();) {
+      const int column = c->column;
+      auto end = c;
+      while (end != crossings.end() && end->column == column) ++end;
+      if (column < 0) {
+        // Crossings left of the area only set the starting winding
+        for (; c != end; ++c) backdrop[c->row] += c->winding;
+        continue;
+      }
+      fillGap(nextColumn, column);
+      renderTile(column, &*c, &*c + (end - c));
+      nextColumn = column + 1;
+      c = end;
+    }
+    // Closed outlines are back outside after their last crossing, but a
+    // shape cut by the right edge of the area may still be inside
+    fillGap(nextColumn, numColumns);
+  }
+}
+}
+
+/**
+ * Bin the edges of shapes into the strips of an area.
+ * @param shapes Edges of each shape, in draw order
+ * @param area Pixels that may be written
+ * @param samples Samples per pixel along each axis
+ * @return Edges passing through each strip, in shape order
+ */
+std::vector<std::vector<StripEdge>> binEdges(
+    std::span<const std::vector<Edge>> shapes, const PixelRect& area,
+    int samples);
+
+/**
+ * Rasterize shapes into the target with the sparse strip engine. Shapes are
+ * drawn in order, so overlapping ones blend like separate draws would.
+ * @tparam Rule Fill rule
+ * @tparam Coverage Aliased or Supersampled<S>
+ * @tparam Target Pixel format, RgbTarget or MaskTarget
+ * @param shapes Edges of each shape
+ * @param area Pixels that may be written
+ * @param target Destination, written from several threads in disjoint rows
+ * @param numThreads Threads rendering strips, 1 renders on the caller
+ */
+template <FillRule Rule, class Coverage, class Target>
+void rasterizeTiles(const std::span<const std::vector<Edge>> shapes,
+                    const PixelRect& area, const Target& target,
+                    const unsigned numThreads = 1) {
+  if (shapes.empty() || area.isEmpty()) return;
+  const auto strips = binEdges(shapes, area, Coverage::SAMPLES);
+  const auto numStrips = strips.size();
+  const auto renderStrip = [&](const std::size_t strip) {
+    if (strips[strip].empty()) return;
+    tile_detail::rasterizeStrip<Rule, Coverage>(
+        shapes, strips[strip], area, static_cast<int>(strip), target);
+  };
+  const auto threads = std::min<std::size_t>(std::max(1u, numThreads),
+                                             numStrips);
+  if (threads == 1) {
+    for (std::size_t i = 0; i < numStrips; ++i) renderStrip(i);
+    return;
+  }
+
+  std::atomic<std::size_t> nextStrip = 0;
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t t = 0; t < threads; ++t) {
+      workers.emplace_back([&] {
+        try {
+          for (std::size_t i; (i = nextStrip++) < numStrips;) renderStrip(i);
+        } catch (...) {
+          std::lock_guard lock(errorMutex);
+          if (!error) error = std::current_exception();
+          nextStrip = numStrips;
+        }
+      });
+    }
+  }
+  if (error) std::rethrow_exception(error);
+}
+
+#endif //TILERASTERIZER_H
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "FontParser.h"
+#include "GlyphAtlas.h"
+#include "ImageWriter.h"
+#include "utils/Unicode.h"
+
+// Offline atlas baker: rasterizes a glyph set at several sizes, packs it into
+// coverage pages and writes the pages with an index of the glyphs.
+// Usage: petite_atlas <font path> <output prefix> [-s sizes] [-c charset]
+//                     [-p page size] [-g padding] [-t threads]
+//
+// sizes is a comma separated list of pixels per em (default 32). charset is
+// a UTF-8 text file whose characters are baked; without it every glyph of
+// the font is. Writes <prefix>_<page>.png (8-bit grayscale coverage),
+// <prefix>.json and <prefix>.bin.
+//
+// The binary index is little-endian:
+//   header: "PTAT", uint32 version, pageWidth, pageHeight, numPages,
+//           numGlyphs
+//   glyph:  uint16 glyphCode, uint16 page (0xffff without outline),
+//           float32 pixelSize, uint16 x, y, width, height,
+//           int16 bearingX, bearingY, float32 advance,
+//           uint16 advanceWidth, int16 leftSideBearing (font units)
+
+namespace {
+using Clock = std::chrono::steady_clock;
+constexpr uint32_t INDEX_VERSION = 1;
+
+std::vector<float> parseSizes(const std::string& list) {
+  std::vector<float> sizes;
+  std::istringstream in(list);
+  for (std::string size; std::getline(in, size, ',');) {
+    const float s = std::stof(size);
+    if (s <= 0) throw std::runtime_error("invalid size: " + size);
+    sizes.push_back(s);
+  }
+  return sizes;
+}
+
+/**
+ * Collect the glyphs of the characters in a UTF-8 file, without duplicates.
+ * Characters the font has no glyph for are reported and skipped.
+ */
+std::vector<uint16_t> readCharset(const FontParser& font,
+                                  const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw std::runtime_error("failed to open charset: " + path);
+  const std::string text{std::istreambuf_iterator<char>(in), {}};
+  std::vector<bool> seen(font.getNumOfGlyphs());
+  std::vector<uint16_t> codes;
+  unsigned missing = 0;
+  forEachCodepoint(text, [&](const uint32_t cp) {
+    if (cp == '\n' || cp == '\r') return;
+    const auto code = font.getGlyphCode(cp);
+    if (code == 0) ++missing;
+    if (!seen[code]) {
+      seen[code] = true;
+      codes.push_back(code);
+    }
+  }, Utf8Errors::Throw);
+  if (missing > 0) {
+    std::cerr << missing << " characters have no glyph, baked as .notdef\n";
+  }
+  std::ranges::sort(codes);
+  return codes;
+}
+
+template <class T>
+void appendLe(std::vector<uint8_t>& out, const T value) {
+  const auto bits = std::bit_cast<std::conditional_t<sizeof(T) == 4, uint32_t,
+                                                     uint16_t>>(value);
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    out.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+  }
+}
+
+std::vector<uint8_t> encodeIndex(const GlyphAtlas& atlas) {
+  std::vector<uint8_t> out{'P', 'T', 'A', 'T'};
+  appendLe(out, INDEX_VERSION);
+  appendLe(out, static_cast<uint32_t>(atlas.pageWidth));
+  appendLe(out, static_cast<uint32_t>(atlas.pageHeight));
+  appendLe(out, static_cast<uint32_t>(atlas.pages.size()));
+  appendLe(out, static_cast<uint32_t>(atlas.glyphs.size()));
+  for (const auto& g : atlas.glyphs) {
+    appendLe(out, g.glyphCode);
+    appendLe(out, static_cast<uint16_t>(g.page));
+    appendLe(out, g.pixelSize);
+    appendLe(out, static_cast<uint16_t>(g.rect.left));
+    appendLe(out, static_cast<uint16_t>(g.rect.top));
+    appendLe(out, static_cast<uint16_t>(g.rect.right - g.rect.left));
+    appendLe(out, static_cast<uint16_t>(g.rect.bottom - g.rect.top));
+    appendLe(out, static_cast<int16_t>(g.bearingX));
+    appendLe(out, static_cast<int16_t>(g.bearingY));
+    appendLe(out, g.advance);
+    appendLe(out, g.metric.advanceWidth);
+    appendLe(out, g.metric.leftSideBearing);
+  }
+  return out;
+}
+
+void writeJsonIndex(std::ostream& out, const GlyphAtlas& atlas,
+                    const std::string& prefix) {
+  out << "{\n  \"version\": " << INDEX_VERSION << ",\n  \"pageWidth\": " <<
+      atlas.pageWidth << ",\n  \"pageHeight\": " << atlas.pageHeight <<
+      ",\n  \"pages\": [";
+  for (std::size_t i = 0; i < atlas.pages.size(); ++i) {
+    out << (i ? ", " : "") << "\"" << prefix << "_" << i << ".png\"";
+  }
+  out << "],\n  \"glyphs\": [";
+  for (std::size_t i = 0; i < atlas.glyphs.size(); ++i) {
+    const auto& g = atlas.glyphs[i];
+    out << (i ? "," : "") << "\n    {\"id\": " << g.glyphCode <<
+        ", \"size\": " << g.pixelSize << ", \"page\": " << g.page <<
+        ", \"x\": " << g.rect.left << ", \"y\": " << g.rect.top <<
+        ", \"width\": " << g.rect.right - g.rect.left << ", \"height\": " <<
+        g.rect.bottom - g.rect.top << ", \"bearingX\": " << g.bearingX <<
+        ", \"bearingY\": " << g.bearingY << ", \"advance\": " << g.advance <<
+        ", \"advanceWidth\": " << g.metric.advanceWidth <<
+        ", \"leftSideBearing\": " << g.metric.leftSideBearing << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+double secondsSince(const Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+}
+
+int main(const int argc, char** argv) {
+  std::vector<std::string> positional;
+  std::string sizeList = "32";
+  std::string charsetPath;
+  AtlasOptions options;
+  options.numThreads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "-s" && hasValue) {
+      sizeList = argv[++i];
+    } else if (arg == "-c" && hasValue) {
+      charsetPath = argv[++i];
+    } else if (arg == "-p" && hasValue) {
+      options.pageWidth = options.pageHeight = std::stoi(argv[++i]);
+    } else if (arg == "-g" && hasValue) {
+      options.padding = std::stoi(argv[++i]);
+    } else if (arg == "-t" && hasValue) {
+      options.numThreads = std::max(1, std::stoi(argv[++i]));
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 2) {
+    std::cerr << "usage: petite_atlas <font path> <output prefix> "
+        "[-s sizes] [-c charset] [-p page size] [-g padding] [-t threads]\n";
+    return 1;
+  }
+  const auto& fontPath = positional[0];
+  const auto& prefix = positional[1];
+
+  try {
+    const auto start = Clock::now();
+    const FontParser font(fontPath);
+    const auto sizes = parseSizes(sizeList);
+    std::vector<uint16_t> codes;
+    if (charsetPath.empty()) {
+      codes.resize(font.getNumOfGlyphs());
+      for (std::size_t i = 0; i < codes.size(); ++i) {
+        codes[i] = static_cast<uint16_t>(i);
+      }
+    } else {
+      codes = readCharset(font, charsetPath);
+    }
+
+    const auto bakeStart = Clock::now();
+    const auto atlas = bakeGlyphAtlas(font, codes, sizes, options);
+    const auto bakeSeconds = secondsSince(bakeStart);
+
+    for (std::size_t i = 0; i < atlas.pages.size(); ++i) {
+      const auto path = prefix + "_" + std::to_string(i) + ".png";
+      writePng(path.c_str(), ImageView{atlas.pages[i].data(), atlas.pageWidth,
+                                       atlas.pageHeight, 1});
+    }
+    const auto index = encodeIndex(atlas);
+    std::ofstream binary(prefix + ".bin", std::ios::binary);
+    binary.write(reinterpret_cast<const char*>(index.data()),
+                 static_cast<std::streamsize>(index.size()));
+    std::ofstream json(prefix + ".json");
+    // Page paths are relative to the index
+    const auto slash = prefix.find_last_of('/');
+    writeJsonIndex(json, atlas, slash == std::string::npos
+                                  ? prefix
+                                  : prefix.substr(slash + 1));
+    if (!binary || !json) throw std::runtime_error("failed to write index");
+
+    std::cout << "baked " << atlas.glyphs.size() << " glyphs (" <<
+        codes.size() << " x " << sizes.size() << " sizes) into " <<
+        atlas.pages.size() << " pages in " << bakeSeconds * 1000 <<
+        " ms with " << options.numThreads << " threads, " <<
+        secondsSince(start) * 1000 << " ms total\n";
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+}
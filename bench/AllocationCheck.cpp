@@ -0,0 +1,191 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CanvasPool.h"
+#include "FontParser.h"
+#include "FrameBufferCanvas.h"
+#include "GlyphRasterCache.h"
+#include "bench/AllocationCounter.h"
+
+// Checks that the paths meant to run without allocating do so.
+// Usage: petite_alloc_check [font path]
+//
+// Every path is warmed up once, then run again while the allocations of the
+// process are counted. Exits with 1 when a path allocates, or when the
+// counter misses a form of operator new, which would hide allocations.
+
+namespace {
+
+const std::string TEXT = "The quick brown fox jumps over the lazy dog";
+
+class AllocationCheck {
+public:
+  /**
+   * Run the body once to warm it up, then again counting its allocations.
+   * @param name Name of the path
+   * @param expected Allocations the second run must make
+   * @param body Code to check
+   */
+  template <class F>
+  void expect(const std::string& name, const uint64_t expected, F&& body) {
+    expectRange(name, expected, expected, body);
+  }
+
+  /**
+   * Like expect, for a path that must allocate at least a given number of
+   * times, e.g. the baseline another path is compared with.
+   * @param name Name of the path
+   * @param minimum Fewest allocations the second run may make
+   * @param body Code to check
+   */
+  template <class F>
+  void expectAtLeast(const std::string& name, const uint64_t minimum,
+                     F&& body) {
+    expectRange(name, minimum, UINT64_MAX, body);
+  }
+
+  [[nodiscard]] int getFailures() const { return failures; }
+
+private:
+  int failures = 0;
+
+  template <class F>
+  void expectRange(const std::string& name, const uint64_t minimum,
+                   const uint64_t maximum, F&& body) {
+    body();
+    const auto allocations = countAllocations(body);
+    const bool passed = allocations >= minimum && allocations <= maximum;
+    std::cout << name << ": " << allocations << " allocations";
+    if (!passed) {
+      std::cout << ", expected " << (minimum == maximum ? "" : "at least ")
+          << minimum;
+    }
+    std::cout << "\n";
+    if (!passed) ++failures;
+  }
+};
+
+struct alignas(64) OverAligned {
+  char bytes[64];
+};
+
+// Allocations stored here escape, so the compiler can't elide them
+void* volatile sink = nullptr;
+
+/**
+ * Let the pointer escape before it is deleted.
+ * @param p Newly allocated object
+ * @return p
+ */
+template <class T>
+T* escape(T* p) {
+  sink = p;
+  return static_cast<T*>(sink);
+}
+
+/**
+ * Lay out the text as a run of glyphs on one line.
+ * @param font Font
+ * @return Positioned glyphs
+ */
+std::vector<RunGlyph> makeRun(const FontParser& font) {
+  std::vector<RunGlyph> run;
+  float x = 0;
+  for (const auto ch : TEXT) {
+    const auto code = font.getGlyphCode(static_cast<unsigned char>(ch));
+    run.push_back({code, x, 0});
+    x += font.getMetric(code).advanceWidth;
+  }
+  return run;
+}
+
+} // namespace
+
+int main(const int argc, char** argv) {
+  const std::string fontPath = argc > 1
+                                 ? argv[1]
+                                 : "fonts/JetBrainsMono-Bold.ttf";
+  AllocationCheck check;
+
+  // Each form of operator new must be seen, one allocation per expression
+  check.expect("counter_scalar", 1, [] { delete escape(new int(1)); });
+  check.expect("counter_array", 1, [] { delete[] escape(new int[4]); });
+  check.expect("counter_unique_array", 1, [] {
+    escape(std::make_unique<int[]>(4).get());
+  });
+  check.expect("counter_nothrow", 1, [] {
+    delete escape(new(std::nothrow) int(1));
+  });
+  check.expect("counter_aligned", 2, [] {
+    delete escape(new OverAligned);
+    delete[] escape(new OverAligned[2]);
+  });
+
+  try {
+    const FontParser font(fontPath);
+    const auto numGlyphs = font.getNumOfGlyphs();
+    // The cache hands out shared glyphs and the accessors return views
+    check.expect("glyph_fetch", 0, [&] {
+      float checksum = 0;
+      for (uint16_t code = 0; code < numGlyphs; ++code) {
+        const auto glyph = font.getCachedGlyph(code);
+        for (const auto& c : glyph->getComponents()) {
+          for (const auto& pt : c.getCoordinates()) checksum += pt.x;
+          checksum += static_cast<float>(c.getEndPtsOfContours().size() +
+                                         c.getOnCurveFlags().size());
+        }
+      }
+      if (checksum == 0.5f) std::cout << "";
+    });
+
+    const auto run = makeRun(font);
+    const auto [ascent, descent] = font.getFontMetric();
+    const float scale = 32.f / (ascent - descent);
+    FrameBufferCanvas canvas{
+        static_cast<int>((run.back().x + font.getMetric(run.back().glyphCode).
+                          advanceWidth) * scale) + 1, 32};
+    canvas.setScale(scale);
+    canvas.setGlyphBaseline(ascent);
+    // The outlines are never copied and the canvas reuses its buffers
+    check.expect("glyph_run", 0, [&] {
+      canvas.renderGlyphRun(font, GlyphRun{run});
+    });
+    GlyphRasterCache cache(font, SIZE_MAX);
+    check.expect("glyph_run_raster_cache", 0, [&] {
+      canvas.renderGlyphRun(font, GlyphRun{run}, cache);
+    });
+
+    // Jobs of every size in turn, a fresh canvas allocates its pixels each
+    // time while a warm pool hands out canvases large enough already
+    std::vector<std::pair<int, int>> sizes;
+    for (const int height : {16, 32, 64}) {
+      for (const int width : {100, 300, 700}) sizes.emplace_back(width, height);
+    }
+    const auto render = [&](FrameBufferCanvas& target, const int height) {
+      target.setScale(static_cast<float>(height) / (ascent - descent));
+      target.setGlyphBaseline(ascent);
+      target.renderGlyphRun(font, GlyphRun{run}, cache);
+    };
+    check.expectAtLeast("canvas_fresh", sizes.size(), [&] {
+      for (const auto& [width, height] : sizes) {
+        FrameBufferCanvas fresh{width, height};
+        render(fresh, height);
+      }
+    });
+    CanvasPool pool;
+    check.expect("canvas_pooled", 0, [&] {
+      for (const auto& [width, height] : sizes) {
+        render(*pool.acquire(width, height), height);
+      }
+    });
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 2;
+  }
+  return check.getFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include "bench/AllocationCounter.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<uint64_t> allocationCount = 0;
+
+void* allocate(const std::size_t size, const std::size_t alignment) noexcept {
+  ++allocationCount;
+  const auto bytes = size ? size : 1;
+  if (alignment <= alignof(std::max_align_t)) return std::malloc(bytes);
+  // aligned_alloc wants the size to be a multiple of the alignment
+  return std::aligned_alloc(alignment,
+                            (bytes + alignment - 1) / alignment * alignment);
+}
+
+void* allocateOrThrow(const std::size_t size, const std::size_t alignment) {
+  if (void* p = allocate(size, alignment)) return p;
+  throw std::bad_alloc();
+}
+}
+
+uint64_t getAllocationCount() {
+  return allocationCount.load();
+}
+
+// Sanitizers and the standard library provide each form on its own, so every
+// one of them is replaced, not just the scalar operator new
+
+void* operator new(const std::size_t size) {
+  return allocateOrThrow(size, 0);
+}
+
+void* operator new[](const std::size_t size) {
+  return allocateOrThrow(size, 0);
+}
+
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size, 0);
+}
+
+void* operator new[](const std::size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size, 0);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](const std::size_t size,
+                     const std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+// Everything above comes from malloc or aligned_alloc, so every delete is a
+// free(). Not inlined, so GCC doesn't flag the free() as mismatched with new
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p,
+                                       const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p,
+                                         const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::size_t,
+                                       std::align_val_t) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::size_t,
+                                         std::align_val_t) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t,
+                                       const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t,
+                                         const std::nothrow_t&) noexcept {
+  std::free(p);
+}
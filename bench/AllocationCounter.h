@@ -0,0 +1,27 @@
+#pragma once
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+#include <cstdint>
+
+// AllocationCounter.cpp replaces every form of the global operator new, so
+// linking it into a program counts all of its allocations: scalar and
+// array, nothrow and over-aligned.
+
+/**
+ * @return Allocations made by the process so far
+ */
+uint64_t getAllocationCount();
+
+/**
+ * Count the allocations made by the body.
+ * @param body Code to measure
+ * @return Number of allocations
+ */
+template <class F>
+uint64_t countAllocations(F&& body) {
+  const auto before = getAllocationCount();
+  body();
+  return getAllocationCount() - before;
+}
+
+#endif //ALLOCATIONCOUNTER_H
@@ -0,0 +1,758 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "CanvasPool.h"
+#include "Compositor.h"
+#include "FontParser.h"
+#include "FrameBufferCanvas.h"
+#include "GlyphRasterCache.h"
+#include "ImageWriter.h"
+#include "MemoryBudget.h"
+#include "TextLayout.h"
+#include "bench/AllocationCounter.h"
+#include "utils/Unicode.h"
+
+// Micro benchmarks for the hot paths.
+// Usage: petite_bench [font path] [benchmark name filter]
+
+// Allocations are counted by bench/AllocationCounter.cpp, the zero
+// allocation paths are checked by petite_alloc_check
+
+namespace {
+using Clock = std::chrono::steady_clock;
+// Every benchmark body is repeated until it ran at least this long
+constexpr double MIN_SECONDS = 0.5;
+
+struct BenchContext {
+  std::string fontPath;
+};
+
+void report(const std::string& name, const double count, const double seconds,
+            const std::string& unit) {
+  std::cout << name << ": " << static_cast<uint64_t>(count / seconds) << " "
+      << unit << "/s (" << static_cast<uint64_t>(count) << " " << unit
+      << " in " << seconds * 1000 << " ms)\n";
+}
+
+/**
+ * Run the body repeatedly for at least MIN_SECONDS.
+ * @param body Benchmark body
+ * @return Elapsed seconds
+ */
+template <class F>
+double repeat(F&& body) {
+  const auto start = Clock::now();
+  double seconds = 0;
+  do {
+    body();
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (seconds < MIN_SECONDS);
+  return seconds;
+}
+
+void benchOutlineDecode(const BenchContext& ctx) {
+  FontParser parser(ctx.fontPath);
+  const auto numGlyphs = parser.getNumOfGlyphs();
+  double points = 0;
+  double glyphs = 0;
+  const auto seconds = repeat([&] {
+    for (uint16_t code = 0; code < numGlyphs; ++code) {
+      const auto glyph = parser.getGlyphByCode(code);
+      for (const auto& c : glyph.getComponents()) {
+        points += c.getNumOfVertices();
+      }
+    }
+    glyphs += numGlyphs;
+  });
+  report("outline_decode", points, seconds, "points");
+  report("outline_decode", glyphs, seconds, "glyphs");
+}
+
+bool isSameGlyph(const Glyph& a, const Glyph& b) {
+  const auto& ac = a.getComponents();
+  const auto& bc = b.getComponents();
+  if (ac.size() != bc.size()) return false;
+  for (std::size_t i = 0; i < ac.size(); ++i) {
+    if (!std::ranges::equal(ac[i].getCoordinates(), bc[i].getCoordinates()) ||
+        !std::ranges::equal(ac[i].getOnCurveFlags(),
+                            bc[i].getOnCurveFlags()) ||
+        !std::ranges::equal(ac[i].getEndPtsOfContours(),
+                            bc[i].getEndPtsOfContours())) {
+      return false;
+    }
+  }
+  return a.getMetric().advanceWidth == b.getMetric().advanceWidth;
+}
+
+// Stress test for the shared parser: every thread decodes every glyph from
+// the same FontParser and compares it with a single-threaded decode.
+void benchConcurrentDecode(const BenchContext& ctx) {
+  const FontParser parser(ctx.fontPath);
+  const auto numGlyphs = parser.getNumOfGlyphs();
+  std::vector<Glyph> expected;
+  for (uint16_t code = 0; code < numGlyphs; ++code) {
+    expected.emplace_back(parser.getGlyphByCode(code));
+  }
+
+  const unsigned numThreads = std::max(2u, std::thread::hardware_concurrency());
+  std::atomic<uint64_t> glyphs = 0;
+  std::atomic<uint64_t> mismatches = 0;
+  const auto seconds = repeat([&] {
+    std::vector<std::jthread> threads;
+    for (unsigned t = 0; t < numThreads; ++t) {
+      threads.emplace_back([&, t] {
+        // Start at different glyphs so threads hit different offsets
+        for (uint16_t i = 0; i < numGlyphs; ++i) {
+          const auto code = static_cast<uint16_t>((i + t * 97) % numGlyphs);
+          if (!isSameGlyph(parser.getGlyphByCode(code), expected[code])) {
+            ++mismatches;
+          }
+        }
+        glyphs += numGlyphs;
+      });
+    }
+  });
+  if (mismatches > 0) {
+    throw std::runtime_error("concurrent_decode: " +
+                             std::to_string(mismatches.load()) +
+                             " glyphs differ from the single-threaded decode");
+  }
+  report("concurrent_decode x" + std::to_string(numThreads),
+         static_cast<double>(glyphs), seconds, "glyphs");
+}
+
+// Encode a large canvas covered with rectangles at several thread counts
+void benchPngEncode(const BenchContext&) {
+  FrameBufferCanvas canvas{4000, 4000};
+  std::mt19937 random(1);
+  for (int i = 0; i < 2000; ++i) {
+    const int w = 1 + random() % 300;
+    const int h = 1 + random() % 60;
+    const CoverageMask rect{static_cast<int>(random() % 4000),
+                            static_cast<int>(random() % 4000), w, h,
+                            std::vector<uint8_t>(w * h, 255)};
+    canvas.compositeMask(rect, RGB(random() % 256, random() % 256,
+                                   random() % 256));
+  }
+  const auto image = canvas.getImageView();
+  const double megabytes = 4000.0 * 4000 * 3 / (1 << 20);
+
+  std::vector<unsigned> threadCounts = {1};
+  if (std::thread::hardware_concurrency() > 1) {
+    threadCounts.push_back(std::thread::hardware_concurrency());
+  }
+  for (const auto numThreads : threadCounts) {
+    std::size_t size = 0;
+    double encoded = 0;
+    const auto seconds = repeat([&] {
+      size = encodePng(image, PngOptions{6, numThreads}).size();
+      encoded += megabytes;
+    });
+    report("png_encode x" + std::to_string(numThreads) + " (" +
+           std::to_string(size) + " bytes)", encoded, seconds, "MB");
+  }
+}
+
+// Lay out a book-length document (about 1MB of text) into 600px lines
+void benchParagraphLayout(const BenchContext& ctx) {
+  const FontParser parser(ctx.fontPath);
+  TextLayouter layouter(parser);
+  std::string book;
+  while (book.size() < (1 << 20)) {
+    book += "It was the best of times, it was the worst of times, it was the "
+        "age of wisdom, it was the age of foolishness, it was the epoch of "
+        "belief, it was the epoch of incredulity.\n";
+  }
+  const auto [ascent, descent] = parser.getFontMetric();
+  const auto maxWidth = static_cast<int32_t>(600.f * (ascent - descent) / 16);
+  double bytes = 0;
+  double glyphs = 0;
+  const auto seconds = repeat([&] {
+    const auto layout = layouter.layout(book, maxWidth);
+    bytes += book.size();
+    glyphs += layout.glyphs.size();
+  });
+  report("paragraph_layout", bytes / (1 << 20), seconds, "MB");
+  report("paragraph_layout", glyphs, seconds, "glyphs");
+}
+
+// Decode 1MB of ASCII and of mixed Latin, Greek, CJK and emoji text
+void benchUtf8Decode(const BenchContext&) {
+  const std::pair<const char*, const char*> texts[] = {
+      {"ascii", "The quick brown fox jumps over the lazy dog. "},
+      {"mixed", "Caf\u00e9 na\u00efve \u03b1\u03b2\u03b3 "
+                "\u65e5\u672c\u8a9e\u306e\u6587\u7ae0 \U0001F600 ok. "},
+  };
+  for (const auto& [name, sample] : texts) {
+    std::string text;
+    while (text.size() < (1 << 20)) text += sample;
+    double bytes = 0;
+    uint32_t checksum = 0;
+    const auto seconds = repeat([&] {
+      forEachCodepoint(text, [&](const uint32_t cp) { checksum += cp; });
+      bytes += text.size();
+    });
+    // Keep the checksum alive so the loop isn't optimized away
+    if (checksum == 1) std::cout << "";
+    report(std::string("utf8_decode ") + name, bytes / (1 << 20), seconds,
+           "MB");
+  }
+}
+
+// Fetch cached outlines and walk their points. Shouldn't allocate: the cache
+// hands out shared glyphs and the outline accessors return views.
+void benchGlyphFetch(const BenchContext& ctx) {
+  const FontParser parser(ctx.fontPath);
+  const auto numGlyphs = parser.getNumOfGlyphs();
+  for (uint16_t code = 0; code < numGlyphs; ++code) {
+    (void)parser.getCachedGlyph(code);
+  }
+
+  double glyphs = 0;
+  float checksum = 0;
+  uint64_t allocations = 0;
+  const auto seconds = repeat([&] {
+    allocations += countAllocations([&] {
+      for (uint16_t code = 0; code < numGlyphs; ++code) {
+        const auto glyph = parser.getCachedGlyph(code);
+        for (const auto& c : glyph->getComponents()) {
+          for (const auto& pt : c.getCoordinates()) checksum += pt.x;
+          checksum += static_cast<float>(c.getEndPtsOfContours().size() +
+                                         c.getOnCurveFlags().size());
+        }
+      }
+    });
+    glyphs += numGlyphs;
+  });
+  if (checksum == 0.5f) std::cout << "";
+  report("glyph_fetch", glyphs, seconds, "glyphs");
+
+  // Decoding without the cache for comparison
+  const auto decodeAllocations = countAllocations([&] {
+    for (uint16_t code = 0; code < numGlyphs; ++code) {
+      (void)parser.getGlyphByCode(code);
+    }
+  });
+  std::cout << "glyph_fetch: " << static_cast<double>(allocations) / glyphs <<
+      " allocations/glyph cached, " <<
+      static_cast<double>(decodeAllocations) / numGlyphs <<
+      " allocations/glyph decoded\n";
+}
+
+// Render a run of cached glyphs. Shouldn't allocate once warm: the outlines
+// are never copied and the canvas reuses the rasterizer's buffers.
+void benchGlyphRun(const BenchContext& ctx) {
+  const FontParser parser(ctx.fontPath);
+  const std::string text = "The quick brown fox jumps over the lazy dog";
+  std::vector<RunGlyph> run;
+  float x = 0;
+  for (const auto ch : text) {
+    const auto code = parser.getGlyphCode(static_cast<unsigned char>(ch));
+    run.push_back({code, x, 0});
+    x += parser.getMetric(code).advanceWidth;
+  }
+  const auto [ascent, descent] = parser.getFontMetric();
+  const float scale = 32.f / (ascent - descent);
+  FrameBufferCanvas canvas{static_cast<int>(x * scale) + 1, 32};
+  canvas.setScale(scale);
+  canvas.setGlyphBaseline(ascent);
+  canvas.renderGlyphRun(parser, GlyphRun{run});
+
+  double glyphs = 0;
+  uint64_t allocations = 0;
+  const auto seconds = repeat([&] {
+    allocations += countAllocations([&] {
+      canvas.renderGlyphRun(parser, GlyphRun{run});
+    });
+    glyphs += run.size();
+  });
+  report("glyph_run", glyphs, seconds, "glyphs");
+  std::cout << "glyph_run: " << static_cast<double>(allocations) / glyphs <<
+      " allocations/glyph\n";
+}
+
+/**
+ * Count how many masks fit in the budget, taken in order.
+ * @param sizes Bytes per mask
+ * @param budget Bytes available
+ * @return Number of masks
+ */
+std::size_t countFitting(const std::vector<std::size_t>& sizes,
+                         const std::size_t budget) {
+  std::size_t used = 0;
+  std::size_t count = 0;
+  for (const auto size : sizes) {
+    if (used + size > budget) break;
+    used += size;
+    ++count;
+  }
+  return count;
+}
+
+// Compare run-length encoded masks with dense ones: memory per glyph, how
+// many glyphs a fixed budget holds, and rendering from the cache.
+void benchRasterCache(const BenchContext& ctx) {
+  const FontParser parser(ctx.fontPath);
+  const auto numGlyphs = parser.getNumOfGlyphs();
+  const auto [ascent, descent] = parser.getFontMetric();
+  constexpr std::size_t BUDGET = 4 << 20;
+  for (const int pixels : {32, 800}) {
+    const float scale = static_cast<float>(pixels) / (ascent - descent);
+    GlyphRasterCache cache(parser, SIZE_MAX);
+    std::vector<std::size_t> denseSizes;
+    std::vector<std::size_t> rleSizes;
+    for (uint16_t code = 0; code < numGlyphs; ++code) {
+      const auto& mask = cache.getMask(parser, code, scale, 0);
+      const auto dense = static_cast<std::size_t>(mask.width) * mask.height;
+      denseSizes.push_back(dense ? allocationSize(dense) : 0);
+      rleSizes.push_back(mask.getMemoryUsage().bytes);
+    }
+    const auto denseTotal = std::accumulate(denseSizes.begin(),
+                                            denseSizes.end(), std::size_t{0});
+    const auto rleTotal = std::accumulate(rleSizes.begin(), rleSizes.end(),
+                                          std::size_t{0});
+    const auto name = "raster_cache_" + std::to_string(pixels) + "px";
+    std::cout << name << ": dense " << denseTotal / numGlyphs <<
+        " bytes/glyph, rle " << rleTotal / numGlyphs << " bytes/glyph (" <<
+        static_cast<double>(denseTotal) / rleTotal << "x smaller)\n";
+    std::cout << name << ": " << (BUDGET >> 20) << " MB holds " <<
+        countFitting(denseSizes, BUDGET) << " dense, " <<
+        countFitting(rleSizes, BUDGET) << " rle of " << numGlyphs <<
+        " glyphs\n";
+  }
+
+  // Render a run uncached and from a warm cache
+  const std::string text = "The quick brown fox jumps over the lazy dog";
+  std::vector<RunGlyph> run;
+  float x = 0;
+  for (const auto ch : text) {
+    const auto code = parser.getGlyphCode(static_cast<unsigned char>(ch));
+    run.push_back({code, x, 0});
+    x += parser.getMetric(code).advanceWidth;
+  }
+  for (const int pixels : {32, 200}) {
+    const float scale = static_cast<float>(pixels) / (ascent - descent);
+    FrameBufferCanvas canvas{static_cast<int>(x * scale) + 1, pixels};
+    canvas.setScale(scale);
+    canvas.setGlyphBaseline(ascent);
+    GlyphRasterCache cache(parser, BUDGET);
+    canvas.renderGlyphRun(parser, GlyphRun{run}, cache);
+    const auto name = "raster_cache_run_" + std::to_string(pixels) + "px";
+    double glyphs = 0;
+    auto seconds = repeat([&] {
+      canvas.renderGlyphRun(parser, GlyphRun{run});
+      glyphs += run.size();
+    });
+    report(name + "_uncached", glyphs, seconds, "glyphs");
+    glyphs = 0;
+    seconds = repeat([&] {
+      canvas.renderGlyphRun(parser, GlyphRun{run}, cache);
+      glyphs += run.size();
+    });
+    report(name + "_cached", glyphs, seconds, "glyphs");
+  }
+}
+
+// Render jobs of varying size on a fresh canvas each versus canvases from a
+// pool. Glyphs come from a warm raster cache, so the canvas is all that
+// allocates; with the pool that drops to nothing once it is warm, which
+// petite_alloc_check asserts.
+void benchCanvasPool(const BenchContext& ctx) {
+  const FontParser parser(ctx.fontPath);
+  const auto [ascent, descent] = parser.getFontMetric();
+  const std::string text = "The quick brown fox jumps over the lazy dog";
+  struct Job {
+    std::vector<RunGlyph> run;
+    int width;
+    int height;
+    float scale;
+  };
+  std::vector<Job> jobs;
+  for (const int pixels : {16, 32, 64}) {
+    for (const std::size_t length : {std::size_t{9}, std::size_t{19},
+                                     text.size()}) {
+      Job job{{}, 0, pixels, static_cast<float>(pixels) / (ascent - descent)};
+      float x = 0;
+      for (std::size_t i = 0; i < length; ++i) {
+        const auto code = parser.getGlyphCode(
+            static_cast<unsigned char>(text[i]));
+        job.run.push_back({code, x, 0});
+        x += parser.getMetric(code).advanceWidth;
+      }
+      job.width = static_cast<int>(x * job.scale) + 1;
+      jobs.push_back(std::move(job));
+    }
+  }
+  GlyphRasterCache cache(parser, SIZE_MAX);
+  const auto render = [&](FrameBufferCanvas& canvas, const Job& job) {
+    canvas.setScale(job.scale);
+    canvas.setGlyphBaseline(ascent);
+    canvas.renderGlyphRun(parser, GlyphRun{job.run}, cache);
+  };
+  for (const auto& job : jobs) {
+    FrameBufferCanvas canvas{job.width, job.height};
+    render(canvas, job);
+  }
+
+  double count = 0;
+  uint64_t allocations = 0;
+  auto seconds = repeat([&] {
+    allocations += countAllocations([&] {
+      for (const auto& job : jobs) {
+        FrameBufferCanvas canvas{job.width, job.height};
+        render(canvas, job);
+      }
+    });
+    count += jobs.size();
+  });
+  report("canvas_pool_fresh", count, seconds, "jobs");
+  std::cout << "canvas_pool_fresh: " << allocations / count <<
+      " allocations/job\n";
+
+  // Warm the pool with every job size, so only the steady state is measured
+  CanvasPool pool;
+  for (const auto& job : jobs) {
+    const auto canvas = pool.acquire(job.width, job.height);
+    render(*canvas, job);
+  }
+  count = 0;
+  allocations = 0;
+  seconds = repeat([&] {
+    allocations += countAllocations([&] {
+      for (const auto& job : jobs) {
+        const auto canvas = pool.acquire(job.width, job.height);
+        render(*canvas, job);
+      }
+    });
+    count += jobs.size();
+  });
+  report("canvas_pool_pooled", count, seconds, "jobs");
+  const auto stats = pool.getStats();
+  std::cout << "canvas_pool_pooled: " << allocations / count <<
+      " allocations/job, " << stats.created << " created, " << stats.grown <<
+      " grown, " << stats.reused << " reused\n";
+}
+
+// Render a page of text in one run with the scanline engine and the sparse
+// strip engine on one and on every thread. Both must produce the same
+// pixels.
+void benchTileRaster(const BenchContext& ctx) {
+  const FontParser parser(ctx.fontPath);
+  const auto numGlyphs = parser.getNumOfGlyphs();
+  const auto [ascent, descent] = parser.getFontMetric();
+  const int lineHeight = ascent - descent;
+  for (const int pixels : {24, 96}) {
+    const float scale = static_cast<float>(pixels) / lineHeight;
+    constexpr int PAGE = 1500;
+    std::vector<RunGlyph> run;
+    const float lineWidth = PAGE / scale;
+    float x = 0;
+    float y = 0;
+    for (uint32_t i = 0; y > -PAGE / scale + lineHeight; ++i) {
+      const auto code = static_cast<uint16_t>(1 + i * 37 % (numGlyphs - 1));
+      const auto advance = parser.getMetric(code).advanceWidth;
+      if (x + advance > lineWidth) {
+        x = 0;
+        y -= lineHeight;
+      }
+      run.push_back({code, x, y});
+      x += advance;
+    }
+    std::vector<std::pair<RasterEngine, unsigned>> engines = {
+        {RasterEngine::Scanline, 1}, {RasterEngine::SparseStrips, 1}};
+    if (const auto threads = std::thread::hardware_concurrency();
+        threads > 1) {
+      engines.emplace_back(RasterEngine::SparseStrips, threads);
+    }
+    std::vector<uint8_t> reference;
+    for (const auto& [engine, numThreads] : engines) {
+      FrameBufferCanvas canvas{PAGE, PAGE};
+      canvas.setScale(scale);
+      canvas.setGlyphBaseline(ascent);
+      canvas.setRasterEngine(engine, numThreads);
+      double glyphs = 0;
+      const auto seconds = repeat([&] {
+        canvas.clear();
+        canvas.renderGlyphRun(parser, GlyphRun{run});
+        glyphs += run.size();
+      });
+      const auto image = canvas.getImageView();
+      const std::vector<uint8_t> pixelData(
+          image.data, image.data + static_cast<std::size_t>(image.width) *
+                                   image.height * image.channels);
+      if (reference.empty()) {
+        reference = pixelData;
+      } else if (pixelData != reference) {
+        throw std::runtime_error("tile_raster: engines disagree");
+      }
+      report("tile_raster_" + std::to_string(pixels) + "px_" +
+             (engine == RasterEngine::Scanline ? "scanline" : "strips") +
+             "_" + std::to_string(numThreads) + "t", glyphs, seconds,
+             "glyphs");
+    }
+  }
+}
+
+/**
+ * Drop the font file from the page cache, so the next parser reads it from
+ * disk.
+ * @param path Font path
+ */
+void evictFromPageCache(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+// Decode the glyphs of a page with a cold outline cache and a cold page
+// cache, lazily in text order versus prefetched in file order.
+void benchGlyphPrefetch(const BenchContext& ctx) {
+  uint16_t numGlyphs;
+  {
+    const FontParser parser(ctx.fontPath);
+    numGlyphs = parser.getNumOfGlyphs();
+  }
+  std::mt19937 random(7);
+  std::vector<uint16_t> page(3000);
+  for (auto& code : page) {
+    code = static_cast<uint16_t>(random() % numGlyphs);
+  }
+
+  for (const bool prefetch : {false, true}) {
+    double pages = 0;
+    std::size_t points = 0;
+    const auto seconds = repeat([&] {
+      evictFromPageCache(ctx.fontPath);
+      const FontParser parser(ctx.fontPath);
+      if (prefetch) parser.prefetchGlyphs(page);
+      for (const auto code : page) {
+        for (const auto& c : parser.getCachedGlyph(code)->getComponents()) {
+          points += c.getCoordinates().size();
+        }
+      }
+      ++pages;
+    });
+    if (points == 1) std::cout << "";
+    report(std::string("glyph_prefetch_") + (prefetch ? "sorted" : "lazy"),
+           pages, seconds, "pages");
+  }
+}
+
+// Render every glyph of two fonts at growing sizes through outline caches,
+// raster caches and a canvas pool sharing one budget. What the caches hold
+// must stay under the limit, and halving the limit must evict right away.
+void benchMemoryBudget(const BenchContext& ctx) {
+  constexpr std::size_t LIMIT = 2 << 20;
+  MemoryBudget budget(LIMIT);
+  uint64_t pressureEvents = 0;
+  budget.addPressureListener([&](const MemoryBudget::PressureEvent&) {
+    ++pressureEvents;
+  });
+  FontParser fontA(ctx.fontPath);
+  FontParser fontB(ctx.fontPath);
+  fontA.setMemoryBudget(&budget);
+  fontB.setMemoryBudget(&budget);
+  GlyphRasterCache cacheA(fontA, SIZE_MAX, &budget);
+  GlyphRasterCache cacheB(fontB, SIZE_MAX, &budget);
+  CanvasPool pool(4, &budget);
+  const std::pair<const FontParser*, GlyphRasterCache*> fonts[] = {
+      {&fontA, &cacheA}, {&fontB, &cacheB}};
+
+  // Bytes of the cached entries, as the caches themselves count them
+  const auto held = [&] {
+    MemoryReport report;
+    for (const auto& r : {fontA.getMemoryReport(), fontB.getMemoryReport(),
+                          cacheA.getMemoryReport(), cacheB.getMemoryReport(),
+                          pool.getMemoryReport()}) {
+      for (const auto& [name, usage] : r.entries) {
+        if (name == "font.glyphCacheOutlines" ||
+            name == "rasterCache.masks" || name == "canvasPool.idle") {
+          report.add(name, usage);
+        }
+      }
+    }
+    return report.total().bytes;
+  };
+
+  const auto numGlyphs = fontA.getNumOfGlyphs();
+  const auto [ascent, descent] = fontA.getFontMetric();
+  std::size_t maxHeld = 0;
+  double glyphs = 0;
+  const auto start = Clock::now();
+  for (const int pixels : {16, 32, 64, 128, 256}) {
+    const float scale = static_cast<float>(pixels) / (ascent - descent);
+    for (const auto& [font, cache] : fonts) {
+      for (uint16_t code = 0; code < numGlyphs; ++code) {
+        (void)cache->getMask(*font, code, scale, code % SUBPIXEL_STEPS);
+        if (code % 64 == 0) maxHeld = std::max(maxHeld, held());
+      }
+      glyphs += numGlyphs;
+    }
+    (void)pool.acquire(pixels * 4, pixels);
+    maxHeld = std::max(maxHeld, held());
+  }
+  const auto seconds = std::chrono::duration<double>(Clock::now() - start).
+      count();
+  report("memory_budget", glyphs, seconds, "glyphs");
+  const auto stats = budget.getStats();
+  std::cout << "memory_budget: limit " << (LIMIT >> 10) << " KB, peak " <<
+      (stats.peak >> 10) << " KB charged, " << (maxHeld >> 10) <<
+      " KB held at most, " << stats.evictions << " evictions in " <<
+      pressureEvents << " rounds\n";
+  budget.setLimit(LIMIT / 2);
+  std::cout << "memory_budget: limit halved to " << (LIMIT >> 11) <<
+      " KB, " << (held() >> 10) << " KB held\n";
+  if (maxHeld > LIMIT || held() > LIMIT / 2) {
+    throw std::runtime_error("memory_budget: caches over the limit");
+  }
+}
+
+std::size_t countPoints(const Glyph& glyph) {
+  std::size_t points = 0;
+  for (const auto& c : glyph.getComponents()) points += c.getNumOfVertices();
+  return points;
+}
+
+// Small text drawn from the simplified outlines of the glyph cache versus
+// the full outlines: throughput, and how far apart the pixels are.
+void benchLevelOfDetail(const BenchContext& ctx) {
+  FontParser parser(ctx.fontPath);
+  parser.setLevelOfDetail(true);
+  const auto numGlyphs = parser.getNumOfGlyphs();
+  const float unitsPerEm = parser.getUnitsPerEm();
+  std::vector<Glyph> full;
+  std::vector<std::shared_ptr<const Glyph>> cached;
+  double fullPoints = 0;
+  double keptPoints = 0;
+  for (uint16_t code = 1; code < numGlyphs; ++code) {
+    full.push_back(parser.getGlyphByCode(code));
+    cached.push_back(parser.getCachedGlyph(code));
+    fullPoints += countPoints(full.back());
+    keptPoints += countPoints(cached.back()->getLevelOfDetail(
+        LOD_MAX_PIXELS_PER_EM / unitsPerEm));
+  }
+  std::cout << "lod_small_text: " << 100 * keptPoints / fullPoints <<
+      "% of the points kept\n";
+  const float tolerance = unitsPerEm * LOD_MAX_ERROR / LOD_MAX_PIXELS_PER_EM;
+  double simplified = 0;
+  const auto simplifySeconds = repeat([&] {
+    for (const auto& glyph : full) (void)glyph.simplify(tolerance);
+    simplified += full.size();
+  });
+  report("lod_small_text_simplify", simplified, simplifySeconds, "glyphs");
+
+  const auto [ascent, descent] = parser.getFontMetric();
+  const int lineHeight = ascent - descent;
+  for (const int pixels : {10, 12, 16}) {
+    constexpr int PAGE = 640;
+    const float scale = static_cast<float>(pixels) / unitsPerEm;
+    // Glyph, x and whether it starts a line, for the glyphs on the page
+    struct Placed {
+      std::size_t glyph;
+      int x;
+      bool newLine;
+    };
+    std::vector<Placed> page;
+    const int lineWidth = static_cast<int>(PAGE / scale);
+    int x = 0;
+    int y = lineHeight;
+    for (std::size_t i = 0; i < full.size(); ++i) {
+      const int advance = full[i].getMetric().advanceWidth;
+      const bool newLine = x + advance > lineWidth;
+      if (newLine) {
+        x = 0;
+        y += lineHeight;
+        if (y * scale > PAGE) break;
+      }
+      page.push_back({i, x, newLine});
+      x += advance;
+    }
+
+    FrameBufferCanvas canvas{PAGE, PAGE};
+    const auto draw = [&](const bool useCache) {
+      canvas.reset(PAGE, PAGE);
+      canvas.setScale(scale);
+      canvas.setGlyphBaseline(ascent);
+      for (const auto& p : page) {
+        if (p.newLine) canvas.setGlyphBaseline(lineHeight);
+        canvas.renderGlyphComposited(useCache ? *cached[p.glyph]
+                                              : full[p.glyph], WHITE, p.x);
+      }
+    };
+    double rates[2];
+    std::vector<uint8_t> images[2];
+    for (const bool useCache : {false, true}) {
+      double glyphs = 0;
+      const auto seconds = repeat([&] {
+        draw(useCache);
+        glyphs += page.size();
+      });
+      rates[useCache] = glyphs / seconds;
+      const auto image = canvas.getImageView();
+      images[useCache].assign(image.data, image.data +
+                                          static_cast<std::size_t>(
+                                            image.width) * image.height *
+                                          image.channels);
+    }
+    // Compare coverage, white text is blended in linear light
+    const auto& gamma = getGammaTables();
+    const auto coverage = [&](const uint8_t srgb) {
+      constexpr int LINEAR_MAX = (1 << LINEAR_BITS) - 1;
+      return (gamma.toLinear[srgb] * 255 + LINEAR_MAX / 2) / LINEAR_MAX;
+    };
+    int maxDiff = 0;
+    double sumDiff = 0;
+    std::size_t covered = 0;
+    for (std::size_t i = 0; i < images[0].size(); ++i) {
+      if (images[0][i] == 0 && images[1][i] == 0) continue;
+      const int d = std::abs(coverage(images[0][i]) - coverage(images[1][i]));
+      maxDiff = std::max(maxDiff, d);
+      sumDiff += d;
+      ++covered;
+    }
+    std::cout << "lod_small_text_" << pixels << "px: " <<
+        static_cast<uint64_t>(rates[0]) << " glyphs/s full, " <<
+        static_cast<uint64_t>(rates[1]) << " glyphs/s simplified (x" <<
+        rates[1] / rates[0] << "), coverage difference max " << maxDiff <<
+        "/255, mean " << sumDiff / std::max<std::size_t>(covered, 1) <<
+        " over the covered pixels\n";
+  }
+}
+
+const std::vector<std::pair<std::string, void (*)(const BenchContext&)>>
+BENCHMARKS = {
+    {"outline_decode", benchOutlineDecode},
+    {"concurrent_decode", benchConcurrentDecode},
+    {"png_encode", benchPngEncode},
+    {"paragraph_layout", benchParagraphLayout},
+    {"utf8_decode", benchUtf8Decode},
+    {"glyph_fetch", benchGlyphFetch},
+    {"glyph_run", benchGlyphRun},
+    {"raster_cache", benchRasterCache},
+    {"canvas_pool", benchCanvasPool},
+    {"tile_raster", benchTileRaster},
+    {"glyph_prefetch", benchGlyphPrefetch},
+    {"memory_budget", benchMemoryBudget},
+    {"lod_small_text", benchLevelOfDetail},
+};
+}
+
+int main(const int argc, char** argv) {
+  const BenchContext ctx{argc > 1 ? argv[1] : "fonts/JetBrainsMono-Bold.ttf"};
+  const std::string filter = argc > 2 ? argv[2] : "";
+  for (const auto& [name, bench] : BENCHMARKS) {
+    if (name.find(filter) != std::string::npos) bench(ctx);
+  }
+}
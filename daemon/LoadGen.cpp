@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon/Protocol.h"
+
+// Load generator for petite_daemon: every connection keeps a number of
+// requests in flight and the latency of each request is recorded.
+// Usage: petite_loadgen <socket path> [-c connections] [-n requests per
+//        connection] [-d requests in flight] [-s pixel height] [-f raw|png]
+//        [-i font index] [-x text]
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions {
+  std::string socketPath;
+  unsigned connections = 8;
+  unsigned requests = 1000;
+  unsigned depth = 1;
+  uint32_t pixelHeight = 64;
+  ImageFormat format = ImageFormat::Png;
+  uint16_t font = 0;
+  std::string text = "The quick brown fox jumps over the lazy dog";
+};
+
+struct ConnectionResult {
+  // Seconds per completed request
+  std::vector<double> latencies;
+  uint64_t errors = 0;
+  uint64_t bytes = 0;
+};
+
+int connectTo(const std::string& path) {
+  const auto address = makeSocketAddress(path);
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) throw std::runtime_error("failed to create socket");
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)) != 0) {
+    ::close(fd);
+    throw std::runtime_error("failed to connect to " + path);
+  }
+  return fd;
+}
+
+ConnectionResult runConnection(const LoadOptions& options) {
+  ConnectionResult result;
+  const int fd = connectTo(options.socketPath);
+  std::unordered_map<uint32_t, Clock::time_point> sentAt;
+  uint32_t nextId = 0;
+  auto send = [&] {
+    const RequestHeader header{REQUEST_MAGIC, nextId, options.font,
+                               options.format, options.pixelHeight,
+                               static_cast<uint32_t>(options.text.size())};
+    sentAt[nextId++] = Clock::now();
+    writeExactly(fd, &header, sizeof(header));
+    writeExactly(fd, options.text.data(), options.text.size());
+  };
+
+  std::vector<uint8_t> payload;
+  try {
+    while (nextId < std::min(options.depth, options.requests)) send();
+    for (unsigned received = 0; received < options.requests; ++received) {
+      ResponseHeader response;
+      if (!readExactly(fd, &response, sizeof(response)) ||
+          response.magic != RESPONSE_MAGIC) {
+        throw std::runtime_error("bad response");
+      }
+      payload.resize(response.payloadLength);
+      readExactly(fd, payload.data(), payload.size());
+      const auto it = sentAt.find(response.id);
+      if (it == sentAt.end()) throw std::runtime_error("unknown response id");
+      result.latencies.push_back(
+          std::chrono::duration<double>(Clock::now() - it->second).count());
+      sentAt.erase(it);
+      if (response.status != ResponseStatus::Ok) ++result.errors;
+      result.bytes += payload.size();
+      if (nextId < options.requests) send();
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+  return result;
+}
+
+double percentile(const std::vector<double>& sorted, const double p) {
+  if (sorted.empty()) return 0;
+  const auto index = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+}
+
+int main(const int argc, char** argv) {
+  LoadOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "-c" && hasValue) {
+      options.connections = std::stoul(argv[++i]);
+    } else if (arg == "-n" && hasValue) {
+      options.requests = std::stoul(argv[++i]);
+    } else if (arg == "-d" && hasValue) {
+      options.depth = std::stoul(argv[++i]);
+    } else if (arg == "-s" && hasValue) {
+      options.pixelHeight = std::stoul(argv[++i]);
+    } else if (arg == "-f" && hasValue) {
+      options.format = std::string(argv[++i]) == "raw"
+                         ? ImageFormat::Raw
+                         : ImageFormat::Png;
+    } else if (arg == "-i" && hasValue) {
+      options.font = static_cast<uint16_t>(std::stoul(argv[++i]));
+    } else if (arg == "-x" && hasValue) {
+      options.text = argv[++i];
+    } else {
+      options.socketPath = arg;
+    }
+  }
+  if (options.socketPath.empty()) {
+    std::cerr << "usage: petite_loadgen <socket path> [-c connections] "
+        "[-n requests] [-d depth] [-s pixel height] [-f raw|png] "
+        "[-i font index] [-x text]\n";
+    return 1;
+  }
+  options.depth = std::max(1u, options.depth);
+
+  std::vector<ConnectionResult> results(options.connections);
+  std::atomic<unsigned> failedConnections = 0;
+  const auto start = Clock::now();
+  {
+    std::vector<std::jthread> threads;
+    for (unsigned i = 0; i < options.connections; ++i) {
+      threads.emplace_back([&, i] {
+        try {
+          results[i] = runConnection(options);
+        } catch (const std::exception& e) {
+          std::cerr << "connection " << i << ": " << e.what() << "\n";
+          ++failedConnections;
+        }
+      });
+    }
+  }
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<double> latencies;
+  uint64_t errors = 0;
+  uint64_t bytes = 0;
+  for (const auto& r : results) {
+    latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+    errors += r.errors;
+    bytes += r.bytes;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  std::cout << latencies.size() << " requests in " << seconds * 1000 <<
+      " ms over " << options.connections << " connections (depth " <<
+      options.depth << ")\n";
+  std::cout << "throughput: " << static_cast<uint64_t>(latencies.size() /
+    seconds) << " requests/s, " << static_cast<uint64_t>(bytes / seconds /
+    (1 << 20)) << " MB/s\n";
+  std::cout << "latency: p50 " << percentile(latencies, 0.5) * 1000 <<
+      " ms, p99 " << percentile(latencies, 0.99) * 1000 << " ms, max " <<
+      (latencies.empty() ? 0 : latencies.back() * 1000) << " ms\n";
+  std::cout << "errors: " << errors << " responses, " << failedConnections <<
+      " connections\n";
+  return errors == 0 && failedConnections == 0 ? 0 : 1;
+}
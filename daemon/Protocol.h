@@ -0,0 +1,114 @@
+#pragma once
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Binary protocol between petite_daemon and its clients over a Unix domain
+// socket. Both ends run on the same machine, so the fields are in host byte
+// order. A client sends any number of requests on one connection without
+// waiting; responses carry the request id and may arrive in any order.
+//
+// Request:  RequestHeader, then textLength bytes of UTF-8 text
+// Response: ResponseHeader, then payloadLength bytes: the image on success,
+//           the error message otherwise
+
+constexpr uint32_t REQUEST_MAGIC = 0x51525450;   // "PTRQ"
+constexpr uint32_t RESPONSE_MAGIC = 0x53525450;  // "PTRS"
+// Longest text accepted in one request
+constexpr uint32_t MAX_TEXT_LENGTH = 64 * 1024;
+
+enum class ImageFormat : uint16_t {
+  // Width * height RGB bytes
+  Raw = 0,
+  Png = 1,
+};
+
+enum class ResponseStatus : uint16_t {
+  Ok = 0,
+  // Unknown font index, bad size or text the font can't render
+  BadRequest = 1,
+  Error = 2,
+};
+
+struct RequestHeader {
+  uint32_t magic = REQUEST_MAGIC;
+  // Chosen by the client, echoed in the response
+  uint32_t id = 0;
+  // Index of the font in the daemon's font list
+  uint16_t font = 0;
+  ImageFormat format = ImageFormat::Png;
+  uint32_t pixelHeight = 0;
+  uint32_t textLength = 0;
+};
+
+struct ResponseHeader {
+  uint32_t magic = RESPONSE_MAGIC;
+  uint32_t id = 0;
+  ResponseStatus status = ResponseStatus::Ok;
+  ImageFormat format = ImageFormat::Png;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t payloadLength = 0;
+};
+
+/**
+ * Read exactly size bytes.
+ * @param fd Socket
+ * @param data Destination
+ * @param size Number of bytes
+ * @return false if the peer closed the connection before the first byte
+ */
+inline bool readExactly(const int fd, void* data, const std::size_t size) {
+  auto* p = static_cast<uint8_t*>(data);
+  std::size_t done = 0;
+  while (done < size) {
+    const auto n = ::read(fd, p + done, size - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n == 0 && done == 0) return false;
+    if (n <= 0) throw std::runtime_error("connection lost while reading");
+    done += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+/**
+ * Write exactly size bytes.
+ * @param fd Socket
+ * @param data Source
+ * @param size Number of bytes
+ */
+inline void writeExactly(const int fd, const void* data,
+                         const std::size_t size) {
+  const auto* p = static_cast<const uint8_t*>(data);
+  std::size_t done = 0;
+  while (done < size) {
+    const auto n = ::write(fd, p + done, size - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) throw std::runtime_error("connection lost while writing");
+    done += static_cast<std::size_t>(n);
+  }
+}
+
+/**
+ * Make a Unix domain socket address.
+ * @param path Socket path
+ * @return Address
+ */
+inline sockaddr_un makeSocketAddress(const std::string& path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("socket path too long: " + path);
+  }
+  address.sun_family = AF_UNIX;
+  path.copy(address.sun_path, path.size());
+  return address;
+}
+
+#endif //PROTOCOL_H
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "CanvasPool.h"
+#include "FontParser.h"
+#include "ImageWriter.h"
+#include "MemoryBudget.h"
+#include "TextRenderer.h"
+#include "daemon/Protocol.h"
+
+// Long-running renderer: loads the fonts once and serves render requests
+// over a Unix domain socket.
+// Usage: petite_daemon <socket path> <font path>... [-t threads] [-b batch]
+//                      [-m cache megabytes]
+//
+// With -m the glyph caches of the fonts and the idle canvases share one
+// memory budget of that size.
+
+namespace {
+// Requests a worker takes from the queue at once by default
+constexpr unsigned DEFAULT_MAX_BATCH = 16;
+constexpr uint32_t MAX_PIXEL_HEIGHT = 4096;
+
+std::atomic<bool> stopRequested = false;
+
+sigset_t getStopSignals() {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  return signals;
+}
+
+/**
+ * Wait for SIGINT or SIGTERM, then wake the accept loop. The signals must be
+ * blocked on every thread, so none of them is interrupted in its place.
+ * @param stopFd Write end of the pipe polled by RenderDaemon::serve()
+ */
+void waitForStopSignal(const int stopFd) {
+  const auto signals = getStopSignals();
+  int signal = 0;
+  while (sigwait(&signals, &signal) != 0) {
+  }
+  stopRequested = true;
+  const char byte = 0;
+  while (::write(stopFd, &byte, 1) < 0 && errno == EINTR) {
+  }
+}
+
+struct Connection {
+  explicit Connection(const int fd_) : fd(fd_) {
+  }
+
+  ~Connection() { ::close(fd); }
+
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  int fd;
+  // Responses of one connection are written by several workers
+  std::mutex writeMutex;
+};
+
+struct Job {
+  RequestHeader header;
+  std::string text;
+  std::shared_ptr<Connection> connection;
+};
+
+class RenderDaemon {
+public:
+  RenderDaemon(std::vector<std::unique_ptr<FontParser>> fonts_,
+               const unsigned numThreads, const unsigned maxBatch_,
+               MemoryBudget* budget) :
+    fonts(std::move(fonts_)), maxBatch(std::max(1u, maxBatch_)),
+    canvases(std::max(1u, numThreads), budget) {
+    for (unsigned i = 0; i < std::max(1u, numThreads); ++i) {
+      workers.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  ~RenderDaemon() {
+    // Unblock the readers, then wait until every one of them is gone. The
+    // sockets stay writable, so the workers can still answer queued requests
+    {
+      std::unique_lock lock(connectionsMutex);
+      for (const auto& [fd, connection] : connections) {
+        ::shutdown(fd, SHUT_RD);
+      }
+      connectionsCv.wait(lock, [&] { return connections.empty(); });
+    }
+    {
+      std::lock_guard lock(queueMutex);
+      stopping = true;
+    }
+    queueCv.notify_all();
+    workers.clear();
+    std::cerr << "served " << served << " requests in " << batches <<
+        " batches\n";
+  }
+
+  RenderDaemon(const RenderDaemon&) = delete;
+  RenderDaemon& operator=(const RenderDaemon&) = delete;
+
+  /**
+   * Accept connections until the stop pipe becomes readable.
+   * @param listenFd Listening socket
+   * @param stopFd Read end of the pipe written by waitForStopSignal()
+   */
+  void serve(const int listenFd, const int stopFd) {
+    pollfd fds[] = {{listenFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+    while (true) {
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) continue;
+        throw std::runtime_error("failed to poll for connections");
+      }
+      if (fds[1].revents != 0) return;
+      if ((fds[0].revents & POLLIN) == 0) continue;
+      const int fd = ::accept(listenFd, nullptr, nullptr);
+      if (fd < 0) {
+        // The client may give up between poll() and accept()
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        throw std::runtime_error("failed to accept connection");
+      }
+      auto connection = std::make_shared<Connection>(fd);
+      {
+        std::lock_guard lock(connectionsMutex);
+        connections.emplace(fd, connection.get());
+      }
+      std::thread([this, connection] { readLoop(connection); }).detach();
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<FontParser>> fonts;
+  unsigned maxBatch;
+
+  std::mutex queueMutex;
+  std::condition_variable queueCv;
+  std::deque<Job> queue;
+  bool stopping = false;
+  uint64_t served = 0;
+  uint64_t batches = 0;
+
+  // Connections with a running reader
+  std::mutex connectionsMutex;
+  std::condition_variable connectionsCv;
+  std::unordered_map<int, Connection*> connections;
+
+  // Canvases shared by the workers, so requests don't allocate framebuffers
+  CanvasPool canvases;
+  std::vector<std::jthread> workers;
+
+  void readLoop(const std::shared_ptr<Connection>& connection) {
+    try {
+      RequestHeader header;
+      while (readExactly(connection->fd, &header, sizeof(header))) {
+        if (header.magic != REQUEST_MAGIC ||
+            header.textLength > MAX_TEXT_LENGTH) {
+          throw std::runtime_error("malformed request");
+        }
+        std::string text(header.textLength, '\0');
+        if (!readExactly(connection->fd, text.data(), text.size())) {
+          throw std::runtime_error("connection lost while reading");
+        }
+        {
+          std::lock_guard lock(queueMutex);
+          queue.push_back(Job{header, std::move(text), connection});
+        }
+        queueCv.notify_one();
+      }
+    } catch (const std::exception& e) {
+      if (!stopRequested) {
+        std::cerr << "connection closed: " << e.what() << "\n";
+      }
+    }
+    std::lock_guard lock(connectionsMutex);
+    connections.erase(connection->fd);
+    connectionsCv.notify_all();
+  }
+
+  void workerLoop() {
+    std::vector<Job> batch;
+    while (true) {
+      {
+        std::unique_lock lock(queueMutex);
+        queueCv.wait(lock, [&] { return stopping || !queue.empty(); });
+        // Drain the queue before stopping, every request gets its response
+        if (queue.empty()) return;
+        // Take everything queued up to the batch size, so one wake-up and
+        // one lock round trip serve many requests under load
+        const auto n = std::min<std::size_t>(queue.size(), maxBatch);
+        std::move(queue.begin(), queue.begin() + n, std::back_inserter(batch));
+        queue.erase(queue.begin(), queue.begin() + n);
+        served += n;
+        ++batches;
+      }
+      // Requests of the same font next to each other keep its tables and
+      // glyph data hot in the cache
+      std::stable_sort(batch.begin(), batch.end(),
+                       [](const Job& a, const Job& b) {
+                         return a.header.font < b.header.font;
+                       });
+      for (const auto& job : batch) process(job);
+      batch.clear();
+    }
+  }
+
+  void process(const Job& job) {
+    ResponseHeader response;
+    response.id = job.header.id;
+    response.format = job.header.format;
+    std::vector<uint8_t> payload;
+    try {
+      if (job.header.font >= fonts.size() || job.header.pixelHeight == 0 ||
+          job.header.pixelHeight > MAX_PIXEL_HEIGHT ||
+          (job.header.format != ImageFormat::Raw &&
+           job.header.format != ImageFormat::Png)) {
+        throw std::invalid_argument("invalid font, size or format");
+      }
+      const auto line = layoutText(*fonts[job.header.font], job.text,
+                                   static_cast<int>(job.header.pixelHeight));
+      const auto canvas = canvases.acquire(std::max(line.width, 1),
+                                           line.height);
+      rasterizeText(line, *canvas);
+      const auto image = canvas->getImageView();
+      response.width = image.width;
+      response.height = image.height;
+      if (job.header.format == ImageFormat::Png) {
+        // The workers already run in parallel, so encode on this thread
+        payload = encodePng(image, PngOptions{6, 1});
+      } else {
+        payload.assign(image.data, image.data +
+                                   static_cast<std::size_t>(image.width) *
+                                   image.height * image.channels);
+      }
+    } catch (const std::invalid_argument& e) {
+      response.status = ResponseStatus::BadRequest;
+      payload.assign(e.what(), e.what() + std::strlen(e.what()));
+    } catch (const std::exception& e) {
+      response.status = ResponseStatus::Error;
+      payload.assign(e.what(), e.what() + std::strlen(e.what()));
+    }
+    response.payloadLength = static_cast<uint32_t>(payload.size());
+
+    std::lock_guard lock(job.connection->writeMutex);
+    try {
+      writeExactly(job.connection->fd, &response, sizeof(response));
+      writeExactly(job.connection->fd, payload.data(), payload.size());
+    } catch (const std::exception&) {
+      // The client went away, its reader cleans up the connection
+    }
+  }
+};
+
+int listenOn(const std::string& path) {
+  const auto address = makeSocketAddress(path);
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) throw std::runtime_error("failed to create socket");
+  // Remove the socket file left by a previous run
+  ::unlink(path.c_str());
+  if (::bind(fd, reinterpret_cast<const sockaddr*>(&address),
+             sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+    ::close(fd);
+    throw std::runtime_error("failed to listen on " + path);
+  }
+  return fd;
+}
+}
+
+int main(const int argc, char** argv) {
+  std::string socketPath;
+  std::vector<std::string> fontPaths;
+  unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned maxBatch = DEFAULT_MAX_BATCH;
+  std::size_t budgetMegabytes = 0;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if ((arg == "-t" || arg == "-b") && i + 1 < argc) {
+      (arg == "-t" ? numThreads : maxBatch) = std::stoul(argv[++i]);
+    } else if (arg == "-m" && i + 1 < argc) {
+      budgetMegabytes = std::stoul(argv[++i]);
+    } else if (socketPath.empty()) {
+      socketPath = arg;
+    } else {
+      fontPaths.push_back(arg);
+    }
+  }
+  if (socketPath.empty() || fontPaths.empty()) {
+    std::cerr << "usage: petite_daemon <socket path> <font path>... "
+        "[-t threads] [-b batch] [-m cache megabytes]\n";
+    return 1;
+  }
+
+  // Outlives the fonts and the canvas pool charged to it
+  std::unique_ptr<MemoryBudget> budget;
+  if (budgetMegabytes > 0) {
+    budget = std::make_unique<MemoryBudget>(budgetMegabytes << 20);
+  }
+  std::vector<std::unique_ptr<FontParser>> fonts;
+  for (const auto& path : fontPaths) {
+    fonts.push_back(std::make_unique<FontParser>(path));
+    fonts.back()->setMemoryBudget(budget.get());
+  }
+
+  // Block the stop signals before any thread starts, so every thread
+  // inherits the mask and only waitForStopSignal() receives them
+  const auto stopSignals = getStopSignals();
+  ::pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+  // Writing to a client that went away must not kill the daemon
+  std::signal(SIGPIPE, SIG_IGN);
+
+  int stopPipe[2];
+  if (::pipe(stopPipe) != 0) {
+    std::cerr << "failed to create the stop pipe\n";
+    return 1;
+  }
+  // Stays blocked in sigwait() if serve() throws, so don't join it
+  std::thread(waitForStopSignal, stopPipe[1]).detach();
+
+  const int listenFd = listenOn(socketPath);
+  std::cerr << "listening on " << socketPath << " with " << fonts.size() <<
+      " fonts\n";
+  {
+    RenderDaemon daemon(std::move(fonts), numThreads, maxBatch,
+                        budget.get());
+    daemon.serve(listenFd, stopPipe[0]);
+  }
+  if (budget) {
+    std::cerr << "memory budget: " << budget->getStats().evictions <<
+        " evictions, peak " << (budget->getStats().peak >> 10) << " KB\n";
+  }
+  ::close(listenFd);
+  ::unlink(socketPath.c_str());
+}
@@ -1,26 +1,259 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 
+#include "CanvasPool.h"
 #include "FontParser.h"
 #include "FrameBufferCanvas.h"
-#include "utils/Unicode.h"
-
-int main() {
-  // Settings
-  FontParser reader("fonts/NotoSansJP-Regular.ttf");
-  const auto cps = utf8ToCodepoints("ほげ");
-  constexpr int height = 800;
-
-  // Get font metric data
-  const auto [ascent, descent] = reader.getFontMetric();
-  const float scale = static_cast<float>(height) / (ascent - descent);
-
-  // Get glyphs and the necessary total width
-  const auto [glyphs, width] = reader.getGlyphs(cps, scale);
-
-  // Initialize canvas and render glyphs
-  FrameBufferCanvas canvas{width, height};
-  canvas.setGlyphBaseline(ascent);
-  canvas.setScale(scale);
-  canvas.renderGlyphs(glyphs);
-  canvas.writePngFile("out.png");
+#include "ImageWriter.h"
+#include "TextRenderer.h"
+
+// Batch renderer: renders every job of a manifest and reports throughput.
+// Usage: tiny_truetype_renderer [manifest | -] [-t threads] [-l png level]
+//                               [-e scanline | strips]
+//
+// The manifest is read from stdin when no file is given. One job per line,
+// fields separated by tabs, the text takes the rest of the line:
+//   font path <TAB> pixel height <TAB> output path <TAB> text
+// The output format follows the extension: .png, .ppm or .raw (RGB bytes).
+// Empty lines and lines starting with '#' are skipped.
+// -e picks the rasterizer, both produce the same pixels.
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Job {
+  std::string fontPath;
+  int pixelHeight = 0;
+  std::string outputPath;
+  std::string text;
+  // Line in the manifest, for error messages
+  int line = 0;
+};
+
+// Seconds spent in each stage, summed over the threads
+struct StageTimes {
+  double parse = 0;
+  double decode = 0;
+  double raster = 0;
+  double encode = 0;
+
+  StageTimes& operator+=(const StageTimes& o) {
+    parse += o.parse;
+    decode += o.decode;
+    raster += o.raster;
+    encode += o.encode;
+    return *this;
+  }
+};
+
+struct JobStats {
+  StageTimes times;
+  uint64_t glyphs = 0;
+  uint64_t pixels = 0;
+  unsigned failed = 0;
+};
+
+double secondsSince(const Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::vector<Job> readManifest(std::istream& in) {
+  std::vector<Job> jobs;
+  std::string line;
+  for (int lineNumber = 1; std::getline(in, line); ++lineNumber) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    Job job;
+    job.line = lineNumber;
+    std::string size;
+    if (!std::getline(fields, job.fontPath, '\t') ||
+        !std::getline(fields, size, '\t') ||
+        !std::getline(fields, job.outputPath, '\t')) {
+      throw std::runtime_error("manifest line " + std::to_string(lineNumber) +
+                               ": expected font, size, output and text");
+    }
+    std::getline(fields, job.text);
+    job.pixelHeight = std::stoi(size);
+    if (job.pixelHeight <= 0) {
+      throw std::runtime_error("manifest line " + std::to_string(lineNumber) +
+                               ": invalid size " + size);
+    }
+    jobs.push_back(std::move(job));
+  }
+  return jobs;
+}
+
+bool hasExtension(const std::string& path, const std::string& extension) {
+  return path.size() >= extension.size() &&
+         path.compare(path.size() - extension.size(), extension.size(),
+                      extension) == 0;
+}
+
+void writeImage(const std::string& path, const ImageView& image,
+                const PngOptions& options) {
+  if (hasExtension(path, ".ppm")) {
+    writePnm(path.c_str(), image);
+  } else if (hasExtension(path, ".raw")) {
+    writeRaw(path.c_str(), image);
+  } else {
+    writePng(path.c_str(), image, options);
+  }
+}
+
+void printStage(const char* name, const double seconds, const double total,
+                const std::size_t jobs) {
+  std::cout << std::left << std::setw(8) << name << std::right <<
+      std::setw(12) << seconds * 1000 << " ms" << std::setw(12) <<
+      (jobs ? seconds * 1000 / jobs : 0) << " ms/job" << std::setw(8) <<
+      (total > 0 ? seconds / total * 100 : 0) << " %\n";
+}
+}
+
+int main(const int argc, char** argv) {
+  std::string manifestPath = "-";
+  unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+  PngOptions pngOptions;
+  auto engine = RasterEngine::Scanline;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-t" && i + 1 < argc) {
+      numThreads = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "-l" && i + 1 < argc) {
+      pngOptions.compressionLevel = std::stoi(argv[++i]);
+    } else if (arg == "-e" && i + 1 < argc) {
+      const std::string name = argv[++i];
+      if (name != "scanline" && name != "strips") {
+        std::cerr << "unknown rasterizer: " << name << "\n";
+        return 1;
+      }
+      engine = name == "strips"
+                 ? RasterEngine::SparseStrips
+                 : RasterEngine::Scanline;
+    } else {
+      manifestPath = arg;
+    }
+  }
+  if (manifestPath == "-" && ::isatty(STDIN_FILENO)) {
+    std::cerr << "usage: tiny_truetype_renderer [manifest | -] [-t threads] "
+        "[-l png level] [-e scanline | strips]\n"
+        "manifest lines: font<TAB>size<TAB>output<TAB>text\n";
+    return 1;
+  }
+
+  std::vector<Job> jobs;
+  try {
+    if (manifestPath == "-") {
+      jobs = readManifest(std::cin);
+    } else {
+      std::ifstream manifest(manifestPath);
+      if (!manifest) {
+        throw std::runtime_error("failed to open manifest: " + manifestPath);
+      }
+      jobs = readManifest(manifest);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  const auto start = Clock::now();
+  JobStats total;
+
+  // Parse every font once, the parsers are shared by all threads
+  std::map<std::string, std::unique_ptr<FontParser>> fonts;
+  for (const auto& job : jobs) {
+    if (fonts.contains(job.fontPath)) continue;
+    auto& font = fonts[job.fontPath];
+    try {
+      font = std::make_unique<FontParser>(job.fontPath);
+    } catch (const std::exception& e) {
+      std::cerr << job.fontPath << ": " << e.what() << "\n";
+    }
+  }
+  total.times.parse = secondsSince(start);
+
+  // Jobs render in parallel, so a single job may use every thread to encode
+  pngOptions.numThreads = jobs.size() < numThreads ? numThreads : 1;
+
+  std::atomic<std::size_t> nextJob = 0;
+  std::mutex totalMutex;
+  // Canvases go back to the pool after each job, so steady work reuses them
+  CanvasPool canvases(numThreads);
+  {
+    std::vector<std::jthread> threads;
+    for (unsigned t = 0; t < std::min<std::size_t>(numThreads, jobs.size());
+         ++t) {
+      threads.emplace_back([&] {
+        JobStats stats;
+        for (std::size_t i; (i = nextJob++) < jobs.size();) {
+          const auto& job = jobs[i];
+          try {
+            const auto& font = fonts.at(job.fontPath);
+            if (!font) throw std::runtime_error("font not loaded");
+
+            auto stageStart = Clock::now();
+            const auto line = layoutText(*font, job.text, job.pixelHeight);
+            stats.times.decode += secondsSince(stageStart);
+
+            stageStart = Clock::now();
+            const auto canvas = canvases.acquire(std::max(line.width, 1),
+                                                 line.height);
+            // Jobs already run in parallel, one thread per draw
+            canvas->setRasterEngine(engine);
+            rasterizeText(line, *canvas);
+            stats.times.raster += secondsSince(stageStart);
+
+            stageStart = Clock::now();
+            writeImage(job.outputPath, canvas->getImageView(), pngOptions);
+            stats.times.encode += secondsSince(stageStart);
+
+            stats.glyphs += line.glyphs.size();
+            stats.pixels += static_cast<uint64_t>(canvas->getWidth()) *
+                canvas->getHeight();
+          } catch (const std::exception& e) {
+            std::lock_guard lock(totalMutex);
+            std::cerr << "manifest line " << job.line << ": " << e.what() <<
+                "\n";
+            ++stats.failed;
+          }
+        }
+        std::lock_guard lock(totalMutex);
+        total.times += stats.times;
+        total.glyphs += stats.glyphs;
+        total.pixels += stats.pixels;
+        total.failed += stats.failed;
+      });
+    }
+  }
+  const double seconds = secondsSince(start);
+
+  const auto& t = total.times;
+  const double stageTotal = t.parse + t.decode + t.raster + t.encode;
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "rendered " << jobs.size() - total.failed << "/" << jobs.size()
+      << " jobs in " << seconds * 1000 << " ms with " << numThreads <<
+      " threads\n";
+  std::cout << "glyphs: " << total.glyphs << " (" << total.glyphs / seconds <<
+      " glyphs/s)\n";
+  std::cout << "pixels: " << total.pixels << " (" << total.pixels / seconds /
+      1e6 << " Mpixels/s)\n";
+  // Stages after parse overlap across threads, so they are thread time
+  printStage("parse", t.parse, stageTotal, jobs.size());
+  printStage("decode", t.decode, stageTotal, jobs.size());
+  printStage("raster", t.raster, stageTotal, jobs.size());
+  printStage("encode", t.encode, stageTotal, jobs.size());
+  return total.failed == 0 ? 0 : 1;
 }
@@ -0,0 +1,95 @@
+#pragma once
+#ifndef BYTEREADER_H
+#define BYTEREADER_H
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * Lightweight read cursor over big-endian font data.
+ * It only holds a pointer into the shared data and its own position, so any
+ * number of readers can walk the same font concurrently.
+ */
+class ByteReader {
+public:
+  ByteReader(const uint8_t* data_, const std::size_t size_) :
+    data(data_), size(size_) {
+  }
+
+  void skipBytes(const std::size_t bytes) { pos += bytes; }
+  void jumpTo(const std::size_t byteOffset) { pos = byteOffset; }
+  [[nodiscard]] std::size_t tell() const { return pos; }
+
+  /**
+   * Read data from the current position.
+   * @tparam T Target type
+   * @return Read value
+   */
+  template <class T>
+  T readBeOrThrow() {
+    static_assert(std::is_integral_v<T>, "T must be integral");
+    if (pos + sizeof(T) > size) throw std::runtime_error("unexpected EOF");
+
+    uint32_t acc = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+      acc = (acc << 8) | data[pos++];
+    }
+
+    if constexpr (std::is_signed_v<T>) {
+      const auto bits = static_cast<unsigned>(sizeof(T) * 8);
+      const uint32_t sign_mask = (static_cast<uint32_t>(1) << (bits - 1));
+      if (acc & sign_mask) {
+        const uint64_t two_pow = static_cast<uint64_t>(1) << bits;
+        const int64_t signed_val =
+            static_cast<int64_t>(acc) - static_cast<int64_t>(two_pow);
+        return static_cast<T>(signed_val);
+      }
+      return static_cast<T>(acc);
+    } else {
+      return static_cast<T>(acc);
+    }
+  }
+
+  uint8_t readUint8() { return readBeOrThrow<uint8_t>(); }
+  uint16_t readUint16() { return readBeOrThrow<uint16_t>(); }
+  uint32_t readUint32() { return readBeOrThrow<uint32_t>(); }
+  int8_t readInt8() { return readBeOrThrow<int8_t>(); }
+  int16_t readInt16() { return readBeOrThrow<int16_t>(); }
+  int32_t readInt32() { return readBeOrThrow<int32_t>(); }
+
+  float readF2Dot14() {
+    const auto raw = readBeOrThrow<int16_t>();
+    return static_cast<float>(raw) / static_cast<float>(1 << 14);
+  }
+
+  /**
+   * Read raw bytes without copying them.
+   * @param length Number of bytes
+   * @return View of the bytes
+   */
+  std::span<const uint8_t> readBytes(const std::size_t length) {
+    if (pos + length > size) throw std::runtime_error("unexpected EOF");
+    const auto bytes = std::span(data + pos, length);
+    pos += length;
+    return bytes;
+  }
+
+  /**
+   * Read raw bytes without copying them, stopping early at the end of data.
+   * @param maxLength Maximum number of bytes
+   * @return View of the bytes
+   */
+  std::span<const uint8_t> readAvailableBytes(const std::size_t maxLength) {
+    const auto length = pos >= size ? 0 : std::min(maxLength, size - pos);
+    return readBytes(length);
+  }
+
+private:
+  const uint8_t* data;
+  std::size_t size;
+  std::size_t pos = 0;
+};
+
+#endif //BYTEREADER_H
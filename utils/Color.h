@@ -0,0 +1,28 @@
+#pragma once
+#ifndef COLOR_H
+#define COLOR_H
+
+struct RGB {
+  unsigned char r, g, b;
+  RGB() = default;
+
+  constexpr RGB(const unsigned char r_, const unsigned char g_,
+                const unsigned char b_) : r(r_), g(g_), b(b_) {
+  }
+
+  constexpr explicit RGB(const unsigned char greyscale) : r(greyscale),
+    g(greyscale), b(greyscale) {
+  }
+
+  bool operator==(const RGB& a) const {
+    return r == a.r && g == a.g && b == a.b;
+  }
+};
+
+constexpr auto WHITE = RGB{255};
+constexpr auto BLACK = RGB{0};
+constexpr auto RED = RGB{255, 70, 70};
+constexpr auto GREEN = RGB{70, 255, 70};
+constexpr auto BLUE = RGB{70, 70, 255};
+
+#endif //COLOR_H
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef CPU_H
+#define CPU_H
+
+struct CpuFeatures {
+  bool sse2 = false;
+  bool ssse3 = false;
+  bool avx2 = false;
+};
+
+/**
+ * Detect the SIMD instruction sets supported by the running CPU.
+ * The result is computed once and cached.
+ * @return Supported features
+ */
+inline const CpuFeatures& getCpuFeatures() {
+  static const CpuFeatures features = [] {
+    CpuFeatures f;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    f.sse2 = __builtin_cpu_supports("sse2");
+    f.ssse3 = __builtin_cpu_supports("ssse3");
+    f.avx2 = __builtin_cpu_supports("avx2");
+#endif
+    return f;
+  }();
+  return features;
+}
+
+#endif //CPU_H
@@ -0,0 +1,141 @@
+#pragma once
+#ifndef ENDIAN_H
+#define ENDIAN_H
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PETITE_X86_SIMD 1
+#endif
+
+#include "Cpu.h"
+
+// Bulk decoders for arrays of big-endian integers, used for whole tables
+// such as loca, hmtx and cmap groups. The SIMD kernels byte-swap 16 or 32
+// bytes per step and leave the tail to the scalar loop.
+namespace endian_detail {
+inline void swap16Scalar(const uint8_t* src, uint16_t* dst,
+                         const std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    dst[i] = static_cast<uint16_t>(src[i * 2] << 8 | src[i * 2 + 1]);
+  }
+}
+
+inline void swap32Scalar(const uint8_t* src, uint32_t* dst,
+                         const std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto* p = src + i * 4;
+    dst[i] = static_cast<uint32_t>(p[0]) << 24 |
+             static_cast<uint32_t>(p[1]) << 16 |
+             static_cast<uint32_t>(p[2]) << 8 | p[3];
+  }
+}
+
+#ifdef PETITE_X86_SIMD
+__attribute__((target("ssse3"))) inline void swapSsse3(
+    const uint8_t* src, uint8_t* dst, const std::size_t bytes,
+    const __m128i mask) {
+  for (std::size_t i = 0; i + 16 <= bytes; i += 16) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_shuffle_epi8(v, mask));
+  }
+}
+
+__attribute__((target("avx2"))) inline void swapAvx2(
+    const uint8_t* src, uint8_t* dst, const std::size_t bytes,
+    const __m256i mask) {
+  for (std::size_t i = 0; i + 32 <= bytes; i += 32) {
+    const auto v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_shuffle_epi8(v, mask));
+  }
+}
+
+__attribute__((target("ssse3"))) inline void swap16Ssse3(
+    const uint8_t* src, uint16_t* dst, const std::size_t n) {
+  const auto mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13,
+                                  12, 15, 14);
+  const std::size_t vec = n / 8 * 8;
+  swapSsse3(src, reinterpret_cast<uint8_t*>(dst), vec * 2, mask);
+  swap16Scalar(src + vec * 2, dst + vec, n - vec);
+}
+
+__attribute__((target("ssse3"))) inline void swap32Ssse3(
+    const uint8_t* src, uint32_t* dst, const std::size_t n) {
+  const auto mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15,
+                                  14, 13, 12);
+  const std::size_t vec = n / 4 * 4;
+  swapSsse3(src, reinterpret_cast<uint8_t*>(dst), vec * 4, mask);
+  swap32Scalar(src + vec * 4, dst + vec, n - vec);
+}
+
+__attribute__((target("avx2"))) inline void swap16Avx2(
+    const uint8_t* src, uint16_t* dst, const std::size_t n) {
+  // vpshufb shuffles within each 128-bit lane, so the mask repeats
+  const auto mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13,
+                                     12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8,
+                                     11, 10, 13, 12, 15, 14);
+  const std::size_t vec = n / 16 * 16;
+  swapAvx2(src, reinterpret_cast<uint8_t*>(dst), vec * 2, mask);
+  swap16Scalar(src + vec * 2, dst + vec, n - vec);
+}
+
+__attribute__((target("avx2"))) inline void swap32Avx2(
+    const uint8_t* src, uint32_t* dst, const std::size_t n) {
+  const auto mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15,
+                                     14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11,
+                                     10, 9, 8, 15, 14, 13, 12);
+  const std::size_t vec = n / 8 * 8;
+  swapAvx2(src, reinterpret_cast<uint8_t*>(dst), vec * 4, mask);
+  swap32Scalar(src + vec * 4, dst + vec, n - vec);
+}
+#endif
+
+using Swap16Fn = void (*)(const uint8_t*, uint16_t*, std::size_t);
+using Swap32Fn = void (*)(const uint8_t*, uint32_t*, std::size_t);
+
+inline Swap16Fn selectSwap16() {
+#ifdef PETITE_X86_SIMD
+  if (getCpuFeatures().avx2) return swap16Avx2;
+  if (getCpuFeatures().ssse3) return swap16Ssse3;
+#endif
+  return swap16Scalar;
+}
+
+inline Swap32Fn selectSwap32() {
+#ifdef PETITE_X86_SIMD
+  if (getCpuFeatures().avx2) return swap32Avx2;
+  if (getCpuFeatures().ssse3) return swap32Ssse3;
+#endif
+  return swap32Scalar;
+}
+}
+
+/**
+ * Decode an array of big-endian 16-bit integers into native-endian values.
+ * @param src Source bytes, 2 * n bytes long
+ * @param dst Destination array of n values
+ * @param n Number of values
+ */
+inline void decodeBeArray(const uint8_t* src, uint16_t* dst,
+                          const std::size_t n) {
+  static const auto impl = endian_detail::selectSwap16();
+  impl(src, dst, n);
+}
+
+/**
+ * Decode an array of big-endian 32-bit integers into native-endian values.
+ * @param src Source bytes, 4 * n bytes long
+ * @param dst Destination array of n values
+ * @param n Number of values
+ */
+inline void decodeBeArray(const uint8_t* src, uint32_t* dst,
+                          const std::size_t n) {
+  static const auto impl = endian_detail::selectSwap32();
+  impl(src, dst, n);
+}
+
+#endif //ENDIAN_H
@@ -6,6 +6,7 @@
 #include <cmath>
 #include <iostream>
 #include <optional>
+#include <vector>
 
 #include "Debug.h"
 #include "glm/glm.hpp"
@@ -17,6 +18,36 @@ struct BoundingRect {
   int yMax = 0;
 };
 
+/**
+ * Rectangle in pixel space, right and bottom are exclusive.
+ */
+struct PixelRect {
+  int left = 0;
+  int top = 0;
+  int right = 0;
+  int bottom = 0;
+
+  [[nodiscard]] bool isEmpty() const { return left >= right || top >= bottom; }
+
+  [[nodiscard]] bool intersects(const PixelRect& o) const {
+    return !intersect(o).isEmpty();
+  }
+
+  [[nodiscard]] PixelRect intersect(const PixelRect& o) const {
+    return {std::max(left, o.left), std::max(top, o.top),
+            std::min(right, o.right), std::min(bottom, o.bottom)};
+  }
+
+  [[nodiscard]] PixelRect unite(const PixelRect& o) const {
+    if (isEmpty()) return o;
+    if (o.isEmpty()) return *this;
+    return {std::min(left, o.left), std::min(top, o.top),
+            std::max(right, o.right), std::max(bottom, o.bottom)};
+  }
+
+  bool operator==(const PixelRect& o) const = default;
+};
+
 constexpr auto eps = std::numeric_limits<float>::epsilon();
 
 inline std::ostream& operator<<(std::ostream& out, const BoundingRect& b) {
@@ -31,6 +62,32 @@ inline glm::vec2 transformVec2(const glm::mat3& M, const glm::vec2& v) {
   return {r.x, r.y};
 }
 
+/**
+ * Transform a bounding rectangle by the matrix.
+ * @param M 3x3 matrix for affine transformation
+ * @param rect Bounding rect
+ * @return Bounding rect that covers the four transformed corners
+ */
+inline BoundingRect transformBoundingRect(const glm::mat3& M,
+                                          const BoundingRect& rect) {
+  const glm::vec2 corners[] = {
+      transformVec2(M, glm::vec2(rect.xMin, rect.yMin)),
+      transformVec2(M, glm::vec2(rect.xMax, rect.yMin)),
+      transformVec2(M, glm::vec2(rect.xMin, rect.yMax)),
+      transformVec2(M, glm::vec2(rect.xMax, rect.yMax))};
+  float xMin = corners[0].x, xMax = corners[0].x;
+  float yMin = corners[0].y, yMax = corners[0].y;
+  for (const auto& c : corners) {
+    xMin = std::min(xMin, c.x);
+    xMax = std::max(xMax, c.x);
+    yMin = std::min(yMin, c.y);
+    yMax = std::max(yMax, c.y);
+  }
+  return {static_cast<int>(std::floor(xMin)), static_cast<int>(std::ceil(xMax)),
+          static_cast<int>(std::floor(yMin)),
+          static_cast<int>(std::ceil(yMax))};
+}
+
 /**
  * Linear interoperation for two points.
  * @param a Start point
@@ -60,6 +117,47 @@ quadBezierLerp(const glm::vec2& start, const glm::vec2& control,
   return lerp(lerp(start, control, t), lerp(control, end, t), t);
 }
 
+/**
+ * Number of uniform subdivisions needed to keep a quadratic Bézier curve within
+ * the tolerance of its chords. The maximum deviation of a chord from the curve
+ * is |p0 - 2p1 + p2| / (8n^2), so n is derived from that bound.
+ *
+ * @param start Start point(on the curve)
+ * @param control Control point (off the curve)
+ * @param end End point (on the curve)
+ * @param tolerance Maximum allowed distance between the curve and its chords
+ * @return Number of line segments (at least 1)
+ */
+inline int getQuadBezierSubdivisions(const glm::vec2& start,
+                                     const glm::vec2& control,
+                                     const glm::vec2& end,
+                                     const float tolerance) {
+  const float dd = glm::length(start - 2.0f * control + end);
+  const float n = std::sqrt(dd / (8.0f * tolerance));
+  return std::max(1, static_cast<int>(std::ceil(n)));
+}
+
+/**
+ * Flatten a quadratic Bézier curve into line segments within the tolerance.
+ * The start point is not appended, so consecutive curves can share the output.
+ *
+ * @param start Start point(on the curve)
+ * @param control Control point (off the curve)
+ * @param end End point (on the curve)
+ * @param tolerance Maximum allowed distance between the curve and its chords
+ * @param out Output polyline, the points after start are appended
+ */
+inline void flattenQuadBezier(const glm::vec2& start, const glm::vec2& control,
+                              const glm::vec2& end, const float tolerance,
+                              std::vector<glm::vec2>& out) {
+  const int n = getQuadBezierSubdivisions(start, control, end, tolerance);
+  for (int i = 1; i < n; ++i) {
+    const float t = static_cast<float>(i) / static_cast<float>(n);
+    out.emplace_back(quadBezierLerp(start, control, end, t));
+  }
+  out.emplace_back(end);
+}
+
 /**
  * Detect intersection point of the given two segments.
  * @param a1 Start point for segment 1
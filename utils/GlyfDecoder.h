@@ -0,0 +1,129 @@
+#pragma once
+#ifndef GLYFDECODER_H
+#define GLYFDECODER_H
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Flag bits of simple glyph points
+constexpr uint8_t ON_CURVE_POINT = 1 << 0;
+constexpr uint8_t X_SHORT_VECTOR = 1 << 1;
+constexpr uint8_t Y_SHORT_VECTOR = 1 << 2;
+constexpr uint8_t REPEAT_FLAG = 1 << 3;
+constexpr uint8_t X_IS_SAME_OR_POSITIVE = 1 << 4;
+constexpr uint8_t Y_IS_SAME_OR_POSITIVE = 1 << 5;
+
+struct SimpleGlyphPoints {
+  std::vector<uint8_t> flags;
+  std::vector<int32_t> xCoordinates;
+  std::vector<int32_t> yCoordinates;
+};
+
+/**
+ * In-place inclusive prefix sum, turning coordinate deltas into absolute
+ * positions. The SSE2 path adds shifted copies of 4 lanes and carries the
+ * running total between blocks.
+ * @param values Deltas, replaced by their running sums
+ * @param n Number of values
+ */
+inline void prefixSum(int32_t* values, const std::size_t n) {
+  std::size_t i = 0;
+#ifdef __SSE2__
+  auto carry = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi32(v, carry);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), v);
+    // Broadcast the last lane as the carry for the next block
+    carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+#endif
+  for (; i < n; ++i) {
+    if (i > 0) values[i] += values[i - 1];
+  }
+}
+
+/**
+ * Decode the flags and coordinates of a simple glyph.
+ * The flags are expanded into a flat buffer first, then the byte width of
+ * every point's x and y delta is summed in one pass to locate both delta
+ * streams, which are read side by side and turned into absolute positions
+ * with a prefix sum.
+ * https://learn.microsoft.com/en-us/typography/opentype/spec/glyf#simple-glyph-description
+ * @param data Bytes starting at the flags array
+ * @param size Number of available bytes
+ * @param n Number of points
+ * @param out Decoded points
+ * @return Number of bytes consumed
+ */
+inline std::size_t decodeSimpleGlyphPoints(const uint8_t* data,
+                                           const std::size_t size,
+                                           const uint16_t n,
+                                           SimpleGlyphPoints& out) {
+  const auto truncated = [] {
+    throw std::runtime_error("GlyfDecoder: truncated glyph data");
+  };
+
+  // Expand the REPEAT_FLAG runs
+  out.flags.resize(n);
+  std::size_t pos = 0;
+  for (std::size_t idx = 0; idx < n;) {
+    if (pos >= size) truncated();
+    const uint8_t f = data[pos++];
+    std::size_t count = 1;
+    if (f & REPEAT_FLAG) {
+      if (pos >= size) truncated();
+      count += data[pos++];
+    }
+    count = std::min(count, n - idx);
+    std::memset(out.flags.data() + idx, f, count);
+    idx += count;
+  }
+
+  // Byte widths of the deltas locate the start of the y stream
+  std::size_t xBytes = 0;
+  std::size_t yBytes = 0;
+  for (const auto f : out.flags) {
+    xBytes += f & X_SHORT_VECTOR ? 1 : f & X_IS_SAME_OR_POSITIVE ? 0 : 2;
+    yBytes += f & Y_SHORT_VECTOR ? 1 : f & Y_IS_SAME_OR_POSITIVE ? 0 : 2;
+  }
+  if (pos + xBytes + yBytes > size) truncated();
+
+  const auto readDelta = [](const uint8_t*& p, const uint8_t f,
+                            const uint8_t shortBit,
+                            const uint8_t sameOrPositiveBit) -> int32_t {
+    if (f & shortBit) {
+      const int32_t v = *p++;
+      return f & sameOrPositiveBit ? v : -v;
+    }
+    if (f & sameOrPositiveBit) return 0;
+    const auto v = static_cast<int16_t>(p[0] << 8 | p[1]);
+    p += 2;
+    return v;
+  };
+  out.xCoordinates.resize(n);
+  out.yCoordinates.resize(n);
+  const uint8_t* xp = data + pos;
+  const uint8_t* yp = xp + xBytes;
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto f = out.flags[i];
+    out.xCoordinates[i] = readDelta(xp, f, X_SHORT_VECTOR,
+                                    X_IS_SAME_OR_POSITIVE);
+    out.yCoordinates[i] = readDelta(yp, f, Y_SHORT_VECTOR,
+                                    Y_IS_SAME_OR_POSITIVE);
+  }
+  prefixSum(out.xCoordinates.data(), n);
+  prefixSum(out.yCoordinates.data(), n);
+
+  return pos + xBytes + yBytes;
+}
+
+#endif //GLYFDECODER_H
@@ -0,0 +1,118 @@
+#pragma once
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("failed to open file: " + path);
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to stat file: " + path);
+    }
+    length = static_cast<std::size_t>(st.st_size);
+    if (length > 0) {
+      void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("failed to map file: " + path);
+      }
+      mapping = static_cast<const uint8_t*>(p);
+    }
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+  }
+
+  ~MappedFile() {
+    if (mapping) ::munmap(const_cast<uint8_t*>(mapping), length);
+  }
+
+  MappedFile(MappedFile&& o) noexcept :
+    mapping(std::exchange(o.mapping, nullptr)),
+    length(std::exchange(o.length, 0)) {
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile& operator=(MappedFile&&) = delete;
+
+  [[nodiscard]] const uint8_t* data() const { return mapping; }
+  [[nodiscard]] std::size_t size() const { return length; }
+
+  /**
+   * Ask the kernel to start reading a range of the file before it is
+   * touched. Only a hint, failures are ignored.
+   * @param offset Start of the range in bytes
+   * @param bytes Length of the range
+   */
+  void willNeed(const std::size_t offset, const std::size_t bytes) const {
+    if (!mapping || offset >= length) return;
+    // madvise wants a page aligned address
+    const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const auto begin = offset / page * page;
+    const auto end = std::min(length, offset + bytes);
+    ::madvise(const_cast<uint8_t*>(mapping) + begin, end - begin,
+              MADV_WILLNEED);
+  }
+
+private:
+  const uint8_t* mapping = nullptr;
+  std::size_t length = 0;
+};
+
+/**
+ * Writable shared memory mapping of a newly created file of a fixed size.
+ * Everything written through data() ends up in the file.
+ */
+class MappedOutputFile {
+public:
+  MappedOutputFile(const std::string& path, const std::size_t size) :
+    length(size) {
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("failed to create file: " + path);
+    if (::ftruncate(fd, static_cast<off_t>(length)) != 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to resize file: " + path);
+    }
+    if (length > 0) {
+      void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("failed to map file: " + path);
+      }
+      mapping = static_cast<uint8_t*>(p);
+    }
+    ::close(fd);
+  }
+
+  ~MappedOutputFile() {
+    if (mapping) ::munmap(mapping, length);
+  }
+
+  MappedOutputFile(const MappedOutputFile&) = delete;
+  MappedOutputFile& operator=(const MappedOutputFile&) = delete;
+
+  [[nodiscard]] uint8_t* data() const { return mapping; }
+  [[nodiscard]] std::size_t size() const { return length; }
+
+private:
+  uint8_t* mapping = nullptr;
+  std::size_t length = 0;
+};
+
+#endif //MAPPEDFILE_H
@@ -0,0 +1,116 @@
+#pragma once
+#ifndef MEMORY_H
+#define MEMORY_H
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Memory accounting helpers. The numbers are estimates computed from sizes
+// and capacities only, so a report costs O(number of structures) and is
+// cheap enough to be scraped periodically.
+
+struct MemoryUsage {
+  std::size_t bytes = 0;
+  std::size_t allocations = 0;
+
+  MemoryUsage& operator+=(const MemoryUsage& o) {
+    bytes += o.bytes;
+    allocations += o.allocations;
+    return *this;
+  }
+};
+
+struct MemoryReport {
+  std::vector<std::pair<std::string, MemoryUsage>> entries;
+
+  void add(std::string name, const MemoryUsage usage) {
+    entries.emplace_back(std::move(name), usage);
+  }
+
+  [[nodiscard]] MemoryUsage total() const {
+    MemoryUsage sum;
+    for (const auto& [name, usage] : entries) sum += usage;
+    return sum;
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const MemoryReport& r) {
+  for (const auto& [name, usage] : r.entries) {
+    out << name << " " << usage.bytes << " bytes " << usage.allocations <<
+        " allocations\n";
+  }
+  const auto total = r.total();
+  out << "total " << total.bytes << " bytes " << total.allocations <<
+      " allocations\n";
+  return out;
+}
+
+/**
+ * Size of a heap block as glibc malloc hands it out: the request plus the
+ * chunk header, rounded up to 16 bytes.
+ * @param bytes Requested size
+ * @return Allocated size
+ */
+inline std::size_t allocationSize(const std::size_t bytes) {
+  return std::max<std::size_t>(32, (bytes + sizeof(std::size_t) + 15) & ~15);
+}
+
+template <class T>
+MemoryUsage getMemoryUsage(const std::vector<T>& v) {
+  if (v.capacity() == 0) return {};
+  return {allocationSize(v.capacity() * sizeof(T)), 1};
+}
+
+/**
+ * Estimate hash container memory: one node per element holding the value
+ * and the next pointer (plus the cached hash for non-trivial hashes), and
+ * the bucket array.
+ */
+template <class Value, bool CachedHash>
+MemoryUsage getHashtableMemoryUsage(const std::size_t size,
+                                    const std::size_t bucketCount) {
+  const std::size_t node = sizeof(void*) + sizeof(Value) +
+                           (CachedHash ? sizeof(std::size_t) : 0);
+  MemoryUsage usage{size * allocationSize(node), size};
+  // libstdc++ keeps a single bucket inline
+  if (bucketCount > 1) {
+    usage += MemoryUsage{allocationSize(bucketCount * sizeof(void*)), 1};
+  }
+  return usage;
+}
+
+template <class K, class V>
+MemoryUsage getMemoryUsage(const std::unordered_map<K, V>& m) {
+  using Value = typename std::unordered_map<K, V>::value_type;
+  return getHashtableMemoryUsage<Value, !std::is_integral_v<K>>(
+      m.size(), m.bucket_count());
+}
+
+template <class K>
+MemoryUsage getMemoryUsage(const std::unordered_set<K>& s) {
+  return getHashtableMemoryUsage<K, !std::is_integral_v<K>>(
+      s.size(), s.bucket_count());
+}
+
+template <class V>
+MemoryUsage getMemoryUsage(const std::map<std::string, V>& m) {
+  // Red-black tree nodes carry color and three pointers
+  constexpr std::size_t node = 4 * sizeof(void*) + sizeof(
+                                   typename std::map<std::string,
+                                     V>::value_type);
+  MemoryUsage usage{m.size() * allocationSize(node), m.size()};
+  for (const auto& [key, value] : m) {
+    // Keys longer than the small string buffer live on the heap
+    if (key.capacity() > 15) usage += {allocationSize(key.capacity() + 1), 1};
+  }
+  return usage;
+}
+
+#endif //MEMORY_H
@@ -1,67 +1,218 @@
 #pragma once
 #include <vector>
 #include <stdexcept>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
 #include <utility>
 
-inline std::pair<uint32_t, int> decodeUtf8Char(const char* s,
-                                               const int remaining) {
-  if (remaining <= 0) throw std::runtime_error("Empty input");
-  unsigned char c0 = static_cast<unsigned char>(s[0]);
-
-  // 1-byte (ASCII)
-  if (c0 < 0x80) return {c0, 1};
-
-  // 2-byte
-  if ((c0 & 0xE0) == 0xC0) {
-    if (remaining < 2) throw std::runtime_error("Truncated UTF-8 (2-byte)");
-    const unsigned char c1 = static_cast<unsigned char>(s[1]);
-    if ((c1 & 0xC0) != 0x80)
-      throw std::runtime_error(
-          "Invalid UTF-8 continuation byte");
-    uint32_t cp = ((c0 & 0x1F) << 6) | (c1 & 0x3F);
-    return {cp, 2};
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PETITE_X86_SIMD 1
+#endif
+
+#include "Cpu.h"
+
+// Streaming UTF-8 decoding. Text is mostly ASCII, so runs of ASCII bytes
+// are found 16 or 32 bytes at a time and only the other bytes go through the
+// full decoder.
+
+constexpr uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+enum class Utf8Errors {
+  // Throw std::invalid_argument on the first invalid sequence
+  Throw,
+  // Decode every invalid sequence as U+FFFD and go on
+  Replace,
+};
+
+namespace unicode_detail {
+inline std::size_t asciiPrefixScalar(const char* s, const std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, s + i, 8);
+    if (word & 0x8080808080808080ull) break;
   }
+  while (i < n && static_cast<unsigned char>(s[i]) < 0x80) ++i;
+  return i;
+}
 
-  // 3-byte
-  if ((c0 & 0xF0) == 0xE0) {
-    if (remaining < 3) throw std::runtime_error("Truncated UTF-8 (3-byte)");
-    const unsigned char c1 = static_cast<unsigned char>(s[1]);
-    const unsigned char c2 = static_cast<unsigned char>(s[2]);
-    if (((c1 & 0xC0) != 0x80) || ((c2 & 0xC0) != 0x80))
-      throw std::runtime_error("Invalid UTF-8 continuation byte");
-    uint32_t cp = ((c0 & 0x0F) << 12)
-                  | ((c1 & 0x3F) << 6)
-                  | (c2 & 0x3F);
-    return {cp, 3};
+#ifdef PETITE_X86_SIMD
+inline std::size_t asciiPrefixSse2(const char* s, const std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    // The sign bit of each byte is set for non-ASCII bytes
+    const int mask = _mm_movemask_epi8(v);
+    if (mask) return i + __builtin_ctz(mask);
   }
+  return i + asciiPrefixScalar(s + i, n - i);
+}
 
-  // 4-byte
-  if ((c0 & 0xF8) == 0xF0) {
-    if (remaining < 4) throw std::runtime_error("Truncated UTF-8 (4-byte)");
-    const unsigned char c1 = static_cast<unsigned char>(s[1]);
-    const unsigned char c2 = static_cast<unsigned char>(s[2]);
-    const unsigned char c3 = static_cast<unsigned char>(s[3]);
-    if (((c1 & 0xC0) != 0x80) || ((c2 & 0xC0) != 0x80) || ((c3 & 0xC0) != 0x80))
-      throw std::runtime_error("Invalid UTF-8 continuation byte");
-    uint32_t cp = ((c0 & 0x07) << 18)
-                  | ((c1 & 0x3F) << 12)
-                  | ((c2 & 0x3F) << 6)
-                  | (c3 & 0x3F);
-    return {cp, 4};
+__attribute__((target("avx2"))) inline std::size_t asciiPrefixAvx2(
+    const char* s, const std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const auto v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(s + i));
+    const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(v));
+    if (mask) return i + __builtin_ctz(mask);
   }
-  throw std::runtime_error("Invalid UTF-8");
+  return i + asciiPrefixSse2(s + i, n - i);
 }
+#endif
 
-inline std::vector<uint32_t> utf8ToCodepoints(const std::string& s) {
-  std::vector<uint32_t> out;
-  const char* data = s.data();
-  const int len = static_cast<int>(s.size());
-  int idx = 0;
-  while (idx < len) {
-    auto [cp, nbytes] = decodeUtf8Char(data + idx, len - idx);
-    out.emplace_back(cp);
-    idx += nbytes;
+inline std::size_t (*selectAsciiPrefix())(const char*, std::size_t) {
+#ifdef PETITE_X86_SIMD
+  if (getCpuFeatures().avx2) return asciiPrefixAvx2;
+  return asciiPrefixSse2;
+#else
+  return asciiPrefixScalar;
+#endif
+}
+
+/**
+ * Decode one multi-byte sequence strictly: overlong forms, surrogates and
+ * values above U+10FFFF are invalid.
+ * @param s Sequence starting with a non-ASCII byte
+ * @param n Bytes available
+ * @param valid Set to whether the sequence is valid
+ * @return Codepoint and length, or REPLACEMENT_CHARACTER and the length of
+ * the longest valid prefix (at least 1) if invalid
+ */
+inline std::pair<uint32_t, std::size_t> decodeSequence(
+    const unsigned char* s, const std::size_t n, bool& valid) {
+  const unsigned char lead = s[0];
+  std::size_t length;
+  uint32_t cp;
+  // Range of the second byte, narrower after some leads
+  unsigned char low = 0x80, high = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+    cp = lead & 0x1F;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    cp = lead & 0x0F;
+    if (lead == 0xE0) low = 0xA0;
+    if (lead == 0xED) high = 0x9F;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    cp = lead & 0x07;
+    if (lead == 0xF0) low = 0x90;
+    if (lead == 0xF4) high = 0x8F;
+  } else {
+    valid = false;
+    return {REPLACEMENT_CHARACTER, 1};
+  }
+  for (std::size_t i = 1; i < length; ++i) {
+    const bool inRange = i < n && s[i] >= (i == 1 ? low : 0x80) &&
+                         s[i] <= (i == 1 ? high : 0xBF);
+    if (!inRange) {
+      valid = false;
+      return {REPLACEMENT_CHARACTER, i};
+    }
+    cp = cp << 6 | (s[i] & 0x3F);
+  }
+  valid = true;
+  return {cp, length};
+}
+}
+
+/**
+ * Length of the run of ASCII bytes at the start of the data.
+ * @param s Data
+ * @param n Size of the data
+ * @return Number of leading bytes below 0x80
+ */
+inline std::size_t getAsciiPrefixLength(const char* s, const std::size_t n) {
+  static const auto kernel = unicode_detail::selectAsciiPrefix();
+  return kernel(s, n);
+}
+
+/**
+ * Pulls codepoints out of UTF-8 text one at a time, without allocating.
+ * ASCII runs are measured with getAsciiPrefixLength, so next() is a bounds
+ * check and a byte load for most text.
+ */
+class Utf8Decoder {
+public:
+  /**
+   * @param text_ UTF-8 encoded text, must outlive the decoder
+   * @param errors_ What to do with invalid sequences
+   */
+  explicit Utf8Decoder(const std::string_view text_,
+                       const Utf8Errors errors_ = Utf8Errors::Replace) :
+    text(text_), errors(errors_) {}
+
+  /**
+   * Decode the next codepoint.
+   * @param cp Set to the codepoint
+   * @return false at the end of the text
+   */
+  bool next(uint32_t& cp) {
+    if (pos < asciiEnd) {
+      cp = static_cast<unsigned char>(text[pos++]);
+      return true;
+    }
+    return nextSlow(cp);
   }
+
+  /**
+   * @return Byte offset of the next codepoint
+   */
+  [[nodiscard]] std::size_t getPosition() const { return pos; }
+
+private:
+  std::string_view text;
+  Utf8Errors errors;
+  std::size_t pos = 0;
+  // End of the ASCII run being decoded
+  std::size_t asciiEnd = 0;
+
+  bool nextSlow(uint32_t& cp) {
+    if (pos >= text.size()) return false;
+    const auto* s = reinterpret_cast<const unsigned char*>(text.data()) + pos;
+    const auto n = text.size() - pos;
+    if (s[0] < 0x80) {
+      asciiEnd = pos + getAsciiPrefixLength(text.data() + pos, n);
+      cp = s[0];
+      ++pos;
+      return true;
+    }
+    bool valid;
+    const auto [decoded, length] = unicode_detail::decodeSequence(s, n, valid);
+    if (!valid && errors == Utf8Errors::Throw) {
+      throw std::invalid_argument("Invalid UTF-8 at byte " + std::to_string(pos));
+    }
+    cp = decoded;
+    pos += length;
+    return true;
+  }
+};
+
+/**
+ * Decode UTF-8 text and call the callback with each codepoint, without
+ * allocating.
+ * @param text UTF-8 encoded text
+ * @param onCodepoint Called with each uint32_t codepoint in order
+ * @param errors What to do with invalid sequences
+ */
+template <class F>
+void forEachCodepoint(const std::string_view text, F&& onCodepoint,
+                      const Utf8Errors errors = Utf8Errors::Replace) {
+  Utf8Decoder decoder(text, errors);
+  for (uint32_t cp; decoder.next(cp);) onCodepoint(cp);
+}
+
+inline std::vector<uint32_t> utf8ToCodepoints(const std::string_view s,
+                                              const Utf8Errors errors =
+                                                  Utf8Errors::Throw) {
+  std::vector<uint32_t> out;
+  // Never more codepoints than bytes
+  out.reserve(s.size());
+  forEachCodepoint(s, [&](const uint32_t cp) { out.push_back(cp); }, errors);
   return out;
 }
@@ -0,0 +1,824 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FontParser.h"
+#include "FrameBufferCanvas.h"
+#include "GlyphRasterCache.h"
+#include "ImageWriter.h"
+
+// Differential check of the rasterizers against a slow reference.
+// Usage: petite_verify [font path...] [-s sizes] [-r samples] [-d max diff]
+//                      [-l max LOD diff] [-p max pixels] [-n glyph step]
+//                      [-o diff dir] [-t threads]
+//
+// Every glyph of the fonts (by default every .ttf and .otf in fonts/) is
+// drawn at each size (pixels per em, default 8,12,16,24,48,96) by every
+// rendering path and compared with a reference written independently of
+// the rasterizers: the outline is flattened into segments of 1/256 px and
+// each pixel is sampled r x r times (default 16).
+//
+// Anti-aliased paths fail a glyph when more than p pixels (default 0)
+// differ from the reference by more than d levels (default 96, the 4 x 4
+// supersampling of the engines can miss a feature thinner than a sample
+// row). Aliased paths fail a glyph when a pixel the reference covers fully
+// or not at all comes out wrong; pixels crossed by an edge may flip either
+// way. Paths that are meant to agree exactly, the scanline and sparse strip
+// engines, are also compared with each other pixel by pixel.
+//
+// Up to LOD_MAX_PIXELS_PER_EM, the simplified outlines of an outline cache
+// with level of detail enabled are drawn too and compared with the full
+// outline drawn by the same engine instead of the reference: a glyph fails
+// when more than p pixels differ by more than l levels (default LOD_MAX_DIFF,
+// what moving the edges by LOD_MAX_ERROR may cost). Since the supersampling
+// hides small moves, a glyph also fails when a point of either outline is
+// further than LOD_MAX_ERROR from the other, measured in pixel space to
+// well within 1% of the bound.
+//
+// A diff image of every failing glyph is written to the diff directory
+// (default verify_out/): reference, result, and the difference in red
+// (too much coverage) and blue (too little). Exits with 1 if any glyph
+// fails, so the harness can gate a build.
+
+namespace {
+// Largest distance of the reference's segments from the outline, in pixels
+constexpr float FLATNESS = 1.0f / 256;
+// Moving an edge by LOD_MAX_ERROR, half the spacing of the engines' sample
+// rows, flips at most one sample per row (or column, for a flat edge) of a
+// pixel. A pixel may hold two edges, like both sides of a thin stem, and
+// reading each image back rounds by a level.
+constexpr int LOD_MAX_DIFF = 2 * SUPERSAMPLE * 255 / (SUPERSAMPLE *
+                                                      SUPERSAMPLE) + 2;
+// Distance between the points the deviation of outlines is first measured
+// at, then at the ones that may be the furthest, and the flatness of the
+// outlines for it. Both are far below the 1% the bound is checked at
+constexpr float DEVIATION_COARSE_SPACING = 1.0f / 32;
+constexpr float DEVIATION_SPACING = 1.0f / 256;
+constexpr float DEVIATION_FLATNESS = 1.0f / 4096;
+
+struct Options {
+  std::vector<float> sizes{8, 12, 16, 24, 48, 96};
+  int samples = 16;
+  int maxDiff = 96;
+  int lodMaxDiff = LOD_MAX_DIFF;
+  int maxPixels = 0;
+  int glyphStep = 1;
+  std::string diffDir = "verify_out";
+  unsigned numThreads = std::max(2u, std::thread::hardware_concurrency());
+  // Diff images written at most
+  int maxImages = 200;
+};
+
+/**
+ * Coverage of every pixel of a glyph's box, 0 to 255.
+ */
+struct Coverage {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> data;
+};
+
+/**
+ * Where a glyph is drawn: the pen in pixels and the canvas around it.
+ */
+struct Placement {
+  float scale;
+  // Pen in font units, as the canvas takes it
+  int startX;
+  int baseline;
+  int width;
+  int height;
+};
+
+struct Segment {
+  glm::vec2 a;
+  glm::vec2 b;
+};
+
+// Rendering path under test
+struct Path {
+  std::string name;
+  bool antiAliased;
+  // Drawn from glyph runs, which use a bitmap strike when there is one
+  bool usesStrikes;
+  // Paths with the same group must produce the same pixels, 0 for none
+  int group;
+  // Draws simplified outlines up to LOD_MAX_PIXELS_PER_EM, compared with
+  // the first path of its group instead of the reference
+  bool levelOfDetail;
+  std::function<void(FrameBufferCanvas&, const FontParser&, uint16_t,
+                     const Glyph&, const Placement&)> draw;
+};
+
+struct PathStats {
+  uint64_t glyphs = 0;
+  uint64_t failed = 0;
+  uint64_t pixels = 0;
+  double sumDiff = 0;
+  int maxDiff = 0;
+  // Aliased pixels on an edge that differ from the reference's center
+  uint64_t mismatches = 0;
+  // Largest distance in pixels of a simplified outline from the full one
+  float maxDeviation = 0;
+  // Glyph with the largest difference, or the most wrong aliased pixels
+  std::string worst;
+  int worstScore = 0;
+};
+
+std::vector<float> parseSizes(const std::string& list) {
+  std::vector<float> sizes;
+  std::istringstream in(list);
+  for (std::string size; std::getline(in, size, ',');) {
+    const float s = std::stof(size);
+    if (s <= 0) throw std::runtime_error("invalid size: " + size);
+    sizes.push_back(s);
+  }
+  return sizes;
+}
+
+/**
+ * Flatten the outline of a glyph into segments in pixel space. Quadratic
+ * curves are split uniformly into enough pieces to stay within the
+ * flatness.
+ * @param glyph Glyph
+ * @param scale Font units to pixels
+ * @param pen Pen position in pixels
+ * @param flatness Largest distance of the segments from the outline
+ * @param contourStarts If not null, receives the index of the first segment
+ * of every contour
+ * @return Closed polylines as segments
+ */
+std::vector<Segment> flattenOutline(
+    const Glyph& glyph, const float scale, const glm::vec2 pen,
+    const float flatness = FLATNESS,
+    std::vector<std::size_t>* contourStarts = nullptr) {
+  std::vector<Segment> segments;
+  const auto toPixels = [&](const glm::vec2 p) {
+    return glm::vec2(pen.x + p.x * scale, pen.y - p.y * scale);
+  };
+  const auto line = [&](const glm::vec2 a, const glm::vec2 b) {
+    segments.push_back({toPixels(a), toPixels(b)});
+  };
+  const auto quad = [&](const glm::vec2 a, const glm::vec2 c,
+                        const glm::vec2 b) {
+    // A uniformly split quadratic deviates at most |a - 2c + b| / (8 n^2)
+    const auto d = (a - 2.0f * c + b) * scale;
+    const auto n = std::max(1, static_cast<int>(std::ceil(
+                              std::sqrt(std::hypot(d.x, d.y) /
+                                        (8 * flatness)))));
+    auto previous = a;
+    for (int i = 1; i <= n; ++i) {
+      const float t = static_cast<float>(i) / n;
+      const auto p = (1 - t) * (1 - t) * a + 2 * t * (1 - t) * c + t * t * b;
+      line(previous, p);
+      previous = p;
+    }
+  };
+
+  for (const auto& component : glyph.getComponents()) {
+    const auto points = component.getCoordinates();
+    int start = 0;
+    for (const auto end : component.getEndPtsOfContours()) {
+      if (contourStarts) contourStarts->push_back(segments.size());
+      const int n = end - start + 1;
+      const auto point = [&](const int i) { return points[start + i % n]; };
+      const auto onCurve = [&](const int i) {
+        return component.isOnCurve(static_cast<uint16_t>(start + i % n));
+      };
+      // Start on a point on the curve, or between the first two control
+      // points if there is none
+      int first = 0;
+      while (first < n && !onCurve(first)) ++first;
+      glm::vec2 current;
+      if (first == n) {
+        first = 0;
+        current = (point(0) + point(1)) / 2.0f;
+      } else {
+        current = point(first);
+      }
+      const auto origin = current;
+      std::optional<glm::vec2> control;
+      for (int i = 1; i <= n; ++i) {
+        const auto p = point(first + i);
+        if (onCurve(first + i)) {
+          if (control) {
+            quad(current, *control, p);
+          } else {
+            line(current, p);
+          }
+          current = p;
+          control.reset();
+        } else {
+          if (control) {
+            // Two control points in a row imply a point on the curve
+            const auto mid = (*control + p) / 2.0f;
+            quad(current, *control, mid);
+            current = mid;
+          }
+          control = p;
+        }
+      }
+      if (control) {
+        quad(current, *control, origin);
+      } else if (current != origin) {
+        line(current, origin);
+      }
+      start = end + 1;
+    }
+  }
+  return segments;
+}
+
+float getDistanceToSegment(const glm::vec2 p, const Segment& segment) {
+  const auto ab = segment.b - segment.a;
+  const float len2 = glm::dot(ab, ab);
+  const float t = len2 > 0
+                    ? std::clamp(glm::dot(p - segment.a, ab) / len2, 0.0f, 1.0f)
+                    : 0.0f;
+  return glm::length(p - (segment.a + ab * t));
+}
+
+/**
+ * Segments bucketed by the pixels their bounding boxes touch, so the ones
+ * near a point are found without going through all of them.
+ */
+class SegmentGrid {
+public:
+  SegmentGrid(const std::vector<Segment>& segments_, const int width_,
+              const int height_) :
+    segments(segments_), width(width_), height(height_),
+    cells(static_cast<std::size_t>(width_) * height_) {
+    for (std::size_t i = 0; i < segments.size(); ++i) {
+      const auto& [a, b] = segments[i];
+      const int x0 = clampX(std::min(a.x, b.x));
+      const int x1 = clampX(std::max(a.x, b.x));
+      const int y0 = clampY(std::min(a.y, b.y));
+      const int y1 = clampY(std::max(a.y, b.y));
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          cells[static_cast<std::size_t>(y) * width + x].push_back(i);
+        }
+      }
+    }
+  }
+
+  /**
+   * Get the distance from a point to the nearest segment. Every segment
+   * closer than a pixel touches one of the 3 x 3 pixels around the point.
+   * @param p Point in pixels
+   * @return Distance in pixels, or 1 if no segment is closer
+   */
+  [[nodiscard]] float getDistance(const glm::vec2 p) const {
+    float best = 1;
+    const int cx = clampX(p.x);
+    const int cy = clampY(p.y);
+    for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, height - 1);
+         ++y) {
+      for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, width - 1);
+           ++x) {
+        for (const auto i : cells[static_cast<std::size_t>(y) * width + x]) {
+          best = std::min(best, getDistanceToSegment(p, segments[i]));
+        }
+      }
+    }
+    return best;
+  }
+
+private:
+  const std::vector<Segment>& segments;
+  int width;
+  int height;
+  std::vector<std::vector<std::size_t>> cells;
+
+  [[nodiscard]] int clampX(const float x) const {
+    return std::clamp(static_cast<int>(std::floor(x)), 0, width - 1);
+  }
+
+  [[nodiscard]] int clampY(const float y) const {
+    return std::clamp(static_cast<int>(std::floor(y)), 0, height - 1);
+  }
+};
+
+/**
+ * Measure how far the points of one outline are from another, contour by
+ * contour, at points DEVIATION_SPACING apart. The distance changes no more
+ * than the point moves, so points DEVIATION_COARSE_SPACING apart are
+ * measured first and only the stretches around them that can be further
+ * than both the largest distance so far and the bound are measured again
+ * finely.
+ * @param segments Outline to walk, from flattenOutline
+ * @param contourStarts First segment of each of its contours
+ * @param other Grid of the outline to measure the distance to
+ * @param collapse Whether a contour may instead count with its distance
+ * from its center, for contours simplifying drops
+ * @param bound Distance to measure finely above
+ * @return Largest distance in pixels, at most 1
+ */
+float measureDistance(const std::vector<Segment>& segments,
+                      const std::vector<std::size_t>& contourStarts,
+                      const SegmentGrid& other, const bool collapse,
+                      const float bound) {
+  struct Sample {
+    glm::vec2 p;
+    glm::vec2 step;
+    float distance;
+  };
+  std::vector<Sample> samples;
+  float deviation = 0;
+  for (std::size_t c = 0; c < contourStarts.size(); ++c) {
+    const auto begin = segments.begin() + contourStarts[c];
+    const auto end = c + 1 < contourStarts.size()
+                       ? segments.begin() + contourStarts[c + 1]
+                       : segments.end();
+    float distance = 0;
+    samples.clear();
+    for (auto it = begin; it != end; ++it) {
+      const auto& [a, b] = *it;
+      const int n = std::max(1, static_cast<int>(std::ceil(
+                                  glm::length(b - a) /
+                                  DEVIATION_COARSE_SPACING)));
+      const auto step = (b - a) / static_cast<float>(n);
+      for (int k = 0; k < n; ++k) {
+        const auto p = a + step * static_cast<float>(k);
+        samples.push_back({p, step, other.getDistance(p)});
+        distance = std::max(distance, samples.back().distance);
+      }
+    }
+    for (const auto& [p, step, coarse] : samples) {
+      const float length = glm::length(step);
+      if (coarse + length <= std::max(distance, bound)) continue;
+      const int fine = static_cast<int>(std::ceil(length / DEVIATION_SPACING));
+      for (int f = 1; f < fine; ++f) {
+        distance = std::max(distance, other.getDistance(
+                                        p + step * (static_cast<float>(f) /
+                                                    fine)));
+      }
+    }
+    if (collapse && begin != end) {
+      auto lo = begin->a;
+      auto hi = lo;
+      for (auto it = begin; it != end; ++it) {
+        lo = glm::min(lo, it->a);
+        hi = glm::max(hi, it->a);
+      }
+      const auto center = (lo + hi) / 2.0f;
+      float radius = 0;
+      for (auto it = begin; it != end; ++it) {
+        radius = std::max(radius, glm::length(it->a - center));
+      }
+      distance = std::min(distance, radius);
+    }
+    deviation = std::max(deviation, distance);
+  }
+  return deviation;
+}
+
+/**
+ * Measure how far a simplified outline strays from the full one, both
+ * ways. Above the bound, the result underestimates the true distance by at
+ * most half of DEVIATION_SPACING and overestimates it by at most twice
+ * DEVIATION_FLATNESS. Below it, points are only DEVIATION_COARSE_SPACING
+ * apart.
+ * @param bound Distance the simplified outline should stay within
+ * @return Largest distance in pixels, at most 1
+ */
+float measureDeviation(const Glyph& full, const Glyph& simplified,
+                       const float scale, const glm::vec2 pen,
+                       const Placement& placement, const float bound) {
+  std::vector<std::size_t> fullStarts;
+  std::vector<std::size_t> simplifiedStarts;
+  const auto fullSegments = flattenOutline(full, scale, pen,
+                                           DEVIATION_FLATNESS, &fullStarts);
+  const auto simplifiedSegments = flattenOutline(
+      simplified, scale, pen, DEVIATION_FLATNESS, &simplifiedStarts);
+  const SegmentGrid fullGrid(fullSegments, placement.width, placement.height);
+  const SegmentGrid simplifiedGrid(simplifiedSegments, placement.width,
+                                   placement.height);
+  return std::max(measureDistance(fullSegments, fullStarts, simplifiedGrid,
+                                  true, bound),
+                  measureDistance(simplifiedSegments, simplifiedStarts,
+                                  fullGrid, false, bound));
+}
+
+/**
+ * Sample the non-zero coverage of segments on a samples x samples grid per
+ * pixel, with the samples centered in their cells.
+ */
+Coverage sampleCoverage(const std::vector<Segment>& segments, const int width,
+                        const int height, const int samples) {
+  Coverage coverage{width, height,
+                    std::vector<uint8_t>(static_cast<std::size_t>(width) *
+                                         height)};
+  std::vector<int> counts(width);
+  std::vector<std::pair<float, int>> crossings;
+  const int total = samples * samples;
+  for (int py = 0; py < height; ++py) {
+    std::fill(counts.begin(), counts.end(), 0);
+    for (int sub = 0; sub < samples; ++sub) {
+      const float y = py + (sub + 0.5f) / samples;
+      crossings.clear();
+      for (const auto& [a, b] : segments) {
+        // Half open in y, so a shared vertex is crossed once
+        if ((a.y <= y) == (b.y <= y)) continue;
+        const float x = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+        crossings.emplace_back(x, a.y < b.y ? 1 : -1);
+      }
+      std::ranges::sort(crossings);
+      int winding = 0;
+      std::size_t next = 0;
+      for (int sx = 0; sx < width * samples; ++sx) {
+        const float x = (sx + 0.5f) / samples;
+        for (; next < crossings.size() && crossings[next].first < x; ++next) {
+          winding += crossings[next].second;
+        }
+        if (winding != 0) ++counts[sx / samples];
+      }
+    }
+    for (int px = 0; px < width; ++px) {
+      coverage.data[static_cast<std::size_t>(py) * width + px] =
+          static_cast<uint8_t>((counts[px] * 255 + total / 2) / total);
+    }
+  }
+  return coverage;
+}
+
+/**
+ * Read the coverage back from white drawn on black. Blending happens in
+ * linear light, so the sRGB pixels are converted back.
+ */
+Coverage readCoverage(const FrameBufferCanvas& canvas) {
+  constexpr int LINEAR_MAX = (1 << LINEAR_BITS) - 1;
+  const auto& gamma = getGammaTables();
+  const auto image = canvas.getImageView();
+  Coverage coverage{image.width, image.height,
+                    std::vector<uint8_t>(static_cast<std::size_t>(
+                                           image.width) * image.height)};
+  for (std::size_t i = 0; i < coverage.data.size(); ++i) {
+    const int linear = gamma.toLinear[image.data[i * image.channels]];
+    coverage.data[i] = static_cast<uint8_t>(
+      (linear * 255 + LINEAR_MAX / 2) / LINEAR_MAX);
+  }
+  return coverage;
+}
+
+/**
+ * Write reference, result and their difference side by side.
+ */
+void writeDiffImage(const std::string& path, const Coverage& reference,
+                    const Coverage& result) {
+  const int w = reference.width;
+  const int h = reference.height;
+  const int width = 3 * w + 2;
+  std::vector<uint8_t> pixels(static_cast<std::size_t>(width) * h * 3, 64);
+  const auto put = [&](const int x, const int y, const uint8_t r,
+                       const uint8_t g, const uint8_t b) {
+    auto* p = pixels.data() + (static_cast<std::size_t>(y) * width + x) * 3;
+    p[0] = r;
+    p[1] = g;
+    p[2] = b;
+  };
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const auto i = static_cast<std::size_t>(y) * w + x;
+      const uint8_t ref = reference.data[i];
+      const uint8_t got = result.data[i];
+      put(x, y, ref, ref, ref);
+      put(w + 1 + x, y, got, got, got);
+      // Amplified so small differences show
+      const int d = std::clamp((got - ref) * 4, -255, 255);
+      put(2 * w + 2 + x, y, static_cast<uint8_t>(std::max(d, 0)), 0,
+          static_cast<uint8_t>(std::max(-d, 0)));
+    }
+  }
+  writePng(path.c_str(), ImageView{pixels.data(), width, h, 3});
+}
+
+std::vector<Path> makePaths(const unsigned numThreads) {
+  const auto outline = [](const RasterEngine engine, const bool antiAliased) {
+    return [=](FrameBufferCanvas& canvas, const FontParser&, uint16_t,
+               const Glyph& glyph, const Placement& p) {
+      canvas.setRasterEngine(engine);
+      if (antiAliased) {
+        canvas.renderGlyphComposited(glyph, WHITE, p.startX);
+      } else {
+        canvas.renderGlyphByNonZero(glyph, WHITE, p.startX);
+      }
+    };
+  };
+  const auto run = [](const RasterEngine engine, const unsigned threads) {
+    return [=](FrameBufferCanvas& canvas, const FontParser& font,
+               const uint16_t code, const Glyph&, const Placement& p) {
+      canvas.setRasterEngine(engine, threads);
+      const RunGlyph g{code, static_cast<float>(p.startX), 0};
+      canvas.renderGlyphRun(font, GlyphRun{std::span(&g, 1)});
+    };
+  };
+  return {
+      {"nonzero", false, false, 1, false,
+       outline(RasterEngine::Scanline, false)},
+      {"nonzero_strips", false, false, 1, false,
+       outline(RasterEngine::SparseStrips, false)},
+      {"composited", true, false, 2, false,
+       outline(RasterEngine::Scanline, true)},
+      {"composited_strips", true, false, 2, false,
+       outline(RasterEngine::SparseStrips, true)},
+      {"run", true, true, 2, false, run(RasterEngine::Scanline, 1)},
+      {"run_strips_x" + std::to_string(numThreads), true, true, 2, false,
+       run(RasterEngine::SparseStrips, numThreads)},
+      // The outline cache of the font given to it simplifies
+      {"lod", true, false, 2, true,
+       [](FrameBufferCanvas& canvas, const FontParser& font,
+          const uint16_t code, const Glyph&, const Placement& p) {
+         canvas.setRasterEngine(RasterEngine::Scanline);
+         canvas.renderGlyphComposited(*font.getCachedGlyph(code), WHITE,
+                                      p.startX);
+       }},
+      // Pens snap to a quarter pixel, so it gets its own reference
+      {"raster_cache", true, true, 0, false,
+       [](FrameBufferCanvas& canvas, const FontParser& font,
+          const uint16_t code, const Glyph&, const Placement& p) {
+         // A fresh cache, a warm one would hide rasterization errors
+         GlyphRasterCache cache(font, SIZE_MAX);
+         const RunGlyph g{code, static_cast<float>(p.startX), 0};
+         canvas.renderGlyphRun(font, GlyphRun{std::span(&g, 1)}, cache);
+       }},
+  };
+}
+
+class Verifier {
+public:
+  Verifier(const Options& options_, const std::vector<Path>& paths_) :
+    options(options_), paths(paths_), stats(paths_.size()) {
+  }
+
+  void verifyFont(const std::string& fontPath) {
+    const FontParser font(fontPath);
+    FontParser simplifyingFont(fontPath);
+    simplifyingFont.setLevelOfDetail(true);
+    const auto name = std::filesystem::path(fontPath).stem().string();
+    const auto numGlyphs = font.getNumOfGlyphs();
+    for (const auto size : options.sizes) {
+      const float scale = size / font.getUnitsPerEm();
+      const bool hasStrike = font.getEmbeddedBitmaps().findStrike(size);
+      for (uint32_t code = 0; code < numGlyphs; code += options.glyphStep) {
+        verifyGlyph(font, simplifyingFont, name, static_cast<uint16_t>(code),
+                    size, scale, hasStrike);
+      }
+    }
+  }
+
+  /**
+   * Print a summary per path.
+   * @return Whether every glyph passed
+   */
+  bool report() const {
+    bool passed = consistencyFailures == 0;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      const auto& s = stats[i];
+      passed = passed && s.failed == 0;
+      std::cout << paths[i].name << ": " << s.glyphs << " glyphs, " <<
+          s.failed << " failed";
+      if (paths[i].antiAliased) {
+        std::cout << ", mean diff " << (s.pixels ? s.sumDiff / s.pixels : 0)
+            << ", max diff " << s.maxDiff;
+        if (paths[i].levelOfDetail) {
+          std::cout << ", max deviation " << s.maxDeviation << " px";
+        }
+      } else {
+        std::cout << ", " << s.mismatches << " edge pixels flipped";
+      }
+      if (!s.worst.empty()) std::cout << ", worst " << s.worst;
+      std::cout << "\n";
+    }
+    std::cout << "consistency: " << consistencyFailures <<
+        " glyphs differ between paths that must agree\n";
+    if (imagesWritten > 0) {
+      std::cout << imagesWritten << " diff images in " << options.diffDir <<
+          "\n";
+    }
+    return passed;
+  }
+
+private:
+  const Options& options;
+  const std::vector<Path>& paths;
+  std::vector<PathStats> stats;
+  uint64_t consistencyFailures = 0;
+  int imagesWritten = 0;
+
+  void verifyGlyph(const FontParser& font,
+                   const FontParser& simplifyingFont,
+                   const std::string& fontName, const uint16_t code,
+                   const float size, const float scale,
+                   const bool hasStrike) {
+    const auto glyph = font.getGlyphByCode(code);
+    if (glyph.getComponents().empty()) return;
+    // Two pixels of margin around the glyph's box
+    const auto box = glyph.getBoundingRect();
+    const int pad = static_cast<int>(std::ceil(2 / scale));
+    const Placement placement{
+        scale, pad - box.xMin, box.yMax + pad,
+        static_cast<int>(std::ceil((box.xMax - box.xMin + 2 * pad) * scale)),
+        static_cast<int>(std::ceil((box.yMax - box.yMin + 2 * pad) * scale))};
+    const glm::vec2 pen(placement.startX * scale, placement.baseline * scale);
+    const auto segments = flattenOutline(glyph, scale, pen);
+    const auto reference = sampleCoverage(segments, placement.width,
+                                          placement.height, options.samples);
+    const auto centers = sampleCoverage(segments, placement.width,
+                                        placement.height, 1);
+    std::optional<Coverage> snappedReference;
+
+    std::vector<std::optional<Coverage>> groupResults(3);
+    std::ostringstream label;
+    label << fontName << " glyph " << code << " at " << size << "px";
+    FrameBufferCanvas canvas{placement.width, placement.height};
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      const auto& path = paths[i];
+      if (path.usesStrikes && hasStrike) continue;
+      if (path.levelOfDetail && size > LOD_MAX_PIXELS_PER_EM) continue;
+      canvas.reset(placement.width, placement.height);
+      canvas.setScale(scale);
+      canvas.setGlyphBaseline(placement.baseline);
+      path.draw(canvas, path.levelOfDetail ? simplifyingFont : font, code,
+                glyph, placement);
+      const auto result = readCoverage(canvas);
+
+      if (path.levelOfDetail) {
+        const auto& full = *groupResults[path.group];
+        const auto cached = simplifyingFont.getCachedGlyph(code);
+        const float deviation = measureDeviation(
+            glyph, cached->getLevelOfDetail(scale), scale, pen, placement,
+            LOD_MAX_ERROR);
+        auto& s = stats[i];
+        s.maxDeviation = std::max(s.maxDeviation, deviation);
+        bool failed = compare(s, path, full, centers, result, label.str(),
+                              options.lodMaxDiff);
+        if (deviation > LOD_MAX_ERROR + 2 * DEVIATION_FLATNESS) {
+          std::cout << label.str() << ": " << path.name << " strays " <<
+              deviation << " px from the full outline\n";
+          s.failed += failed ? 0 : 1;
+          failed = true;
+        }
+        if (failed) writeImage(fontName, code, size, path.name, full, result);
+        continue;
+      }
+      const Coverage* expected = &reference;
+      if (path.group == 0) {
+        // Snap the pen like the raster cache does
+        if (!snappedReference) {
+          const auto steps = std::floor(pen.x * SUBPIXEL_STEPS + 0.5f);
+          const glm::vec2 snapped(steps / SUBPIXEL_STEPS,
+                                  std::round(pen.y));
+          snappedReference = sampleCoverage(
+              flattenOutline(glyph, scale, snapped), placement.width,
+              placement.height, options.samples);
+        }
+        expected = &*snappedReference;
+      }
+      const bool failed = compare(stats[i], path, *expected, centers, result,
+                                  label.str(), options.maxDiff);
+      if (failed) {
+        writeImage(fontName, code, size, path.name, *expected, result);
+      }
+      if (path.group != 0) {
+        auto& first = groupResults[path.group];
+        if (!first) {
+          first = result;
+        } else if (first->data != result.data) {
+          ++consistencyFailures;
+          std::cout << label.str() << ": " << path.name <<
+              " differs from the other " <<
+              (path.antiAliased ? "anti-aliased" : "aliased") << " paths\n";
+          writeImage(fontName, code, size, path.name + "_vs_group", *first,
+                     result);
+        }
+      }
+    }
+  }
+
+  bool compare(PathStats& s, const Path& path, const Coverage& reference,
+               const Coverage& centers, const Coverage& result,
+               const std::string& label, const int maxDiff) const {
+    ++s.glyphs;
+    int over = 0;
+    int glyphMax = 0;
+    for (std::size_t i = 0; i < result.data.size(); ++i) {
+      const int got = result.data[i];
+      if (path.antiAliased) {
+        const int d = std::abs(got - reference.data[i]);
+        s.sumDiff += d;
+        glyphMax = std::max(glyphMax, d);
+        if (d > maxDiff) ++over;
+      } else if (got != centers.data[i]) {
+        // Only pixels without an edge in them have a certain answer
+        const auto ref = reference.data[i];
+        if (ref == 0 || ref == 255) {
+          ++over;
+        } else {
+          ++s.mismatches;
+        }
+      }
+    }
+    s.pixels += result.data.size();
+    s.maxDiff = std::max(s.maxDiff, glyphMax);
+    if (const int score = path.antiAliased ? glyphMax : over;
+        score > s.worstScore) {
+      s.worstScore = score;
+      s.worst = label;
+    }
+    if (over <= options.maxPixels) return false;
+    ++s.failed;
+    std::cout << label << ": " << path.name << " has " << over <<
+        " pixels off" << (path.antiAliased
+                            ? " by more than " + std::to_string(maxDiff)
+                            : "") << "\n";
+    return true;
+  }
+
+  void writeImage(const std::string& fontName, const uint16_t code,
+                  const float size, const std::string& pathName,
+                  const Coverage& reference, const Coverage& result) {
+    if (imagesWritten >= options.maxImages) return;
+    std::filesystem::create_directories(options.diffDir);
+    std::ostringstream path;
+    path << options.diffDir << "/" << fontName << "_" << code << "_" << size <<
+        "px_" << pathName << ".png";
+    writeDiffImage(path.str(), reference, result);
+    ++imagesWritten;
+  }
+};
+
+/**
+ * Find the fonts bundled with the repository.
+ */
+std::vector<std::string> findBundledFonts() {
+  std::vector<std::string> fonts;
+  if (!std::filesystem::is_directory("fonts")) return fonts;
+  for (const auto& entry : std::filesystem::directory_iterator("fonts")) {
+    const auto extension = entry.path().extension();
+    if (extension == ".ttf" || extension == ".otf") {
+      fonts.push_back(entry.path().string());
+    }
+  }
+  std::ranges::sort(fonts);
+  return fonts;
+}
+}
+
+int main(const int argc, char** argv) {
+  Options options;
+  std::vector<std::string> fontPaths;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "-s" && hasValue) {
+      options.sizes = parseSizes(argv[++i]);
+    } else if (arg == "-r" && hasValue) {
+      options.samples = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "-d" && hasValue) {
+      options.maxDiff = std::stoi(argv[++i]);
+    } else if (arg == "-l" && hasValue) {
+      options.lodMaxDiff = std::stoi(argv[++i]);
+    } else if (arg == "-p" && hasValue) {
+      options.maxPixels = std::stoi(argv[++i]);
+    } else if (arg == "-n" && hasValue) {
+      options.glyphStep = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "-o" && hasValue) {
+      options.diffDir = argv[++i];
+    } else if (arg == "-t" && hasValue) {
+      options.numThreads = std::max(1, std::stoi(argv[++i]));
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "usage: petite_verify [font path...] [-s sizes] "
+          "[-r samples] [-d max diff] [-l max LOD diff] [-p max pixels] "
+          "[-n glyph step] [-o diff dir] [-t threads]\n";
+      return 2;
+    } else {
+      fontPaths.push_back(arg);
+    }
+  }
+  if (fontPaths.empty()) fontPaths = findBundledFonts();
+  if (fontPaths.empty()) {
+    std::cerr << "no fonts given and none found in fonts/\n";
+    return 2;
+  }
+
+  try {
+    const auto paths = makePaths(options.numThreads);
+    Verifier verifier(options, paths);
+    for (const auto& path : fontPaths) verifier.verifyFont(path);
+    return verifier.report() ? 0 : 1;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 2;
+  }
+}
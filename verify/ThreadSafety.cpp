@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FontParser.h"
+#include "MemoryBudget.h"
+
+// Concurrency check of a FontParser shared between threads.
+// Usage: petite_verify_threads [font path] [-t threads] [-r rounds]
+//
+// Every thread (default 4) decodes every glyph of one FontParser, by turns
+// through getGlyphByCode, the outline cache and prefetched batches, and
+// compares it with a single-threaded decode by a parser of its own. The
+// outline cache is charged to a budget smaller than the font so that
+// evictions race with the lookups. Exits with 1 when a glyph differs or a
+// decode throws. Configure with -DPETITE_SANITIZER=thread to also have
+// ThreadSanitizer look for data races in the same run.
+
+namespace {
+
+constexpr std::size_t BUDGET_BYTES = 256 * 1024;
+constexpr uint16_t PREFETCH_BATCH = 64;
+
+bool isSameGlyph(const Glyph& a, const Glyph& b) {
+  const auto& ac = a.getComponents();
+  const auto& bc = b.getComponents();
+  if (ac.size() != bc.size()) return false;
+  for (std::size_t i = 0; i < ac.size(); ++i) {
+    if (!std::ranges::equal(ac[i].getCoordinates(), bc[i].getCoordinates()) ||
+        !std::ranges::equal(ac[i].getOnCurveFlags(),
+                            bc[i].getOnCurveFlags()) ||
+        !std::ranges::equal(ac[i].getEndPtsOfContours(),
+                            bc[i].getEndPtsOfContours())) {
+      return false;
+    }
+  }
+  return a.getMetric().advanceWidth == b.getMetric().advanceWidth;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string fontPath = "fonts/JetBrainsMono-Bold.ttf";
+  unsigned numThreads = 4;
+  int rounds = 3;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "-t" && hasValue) {
+      numThreads = static_cast<unsigned>(std::max(2, std::stoi(argv[++i])));
+    } else if (arg == "-r" && hasValue) {
+      rounds = std::max(1, std::stoi(argv[++i]));
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "usage: petite_verify_threads [font path] [-t threads] "
+          "[-r rounds]\n";
+      return 2;
+    } else {
+      fontPath = arg;
+    }
+  }
+
+  try {
+    std::vector<Glyph> expected;
+    {
+      const FontParser reference(fontPath);
+      for (uint16_t code = 0; code < reference.getNumOfGlyphs(); ++code) {
+        expected.emplace_back(reference.getGlyphByCode(code));
+      }
+    }
+    const auto numGlyphs = static_cast<uint16_t>(expected.size());
+
+    // Declared first, the parser's cache must detach before it goes
+    MemoryBudget budget(BUDGET_BYTES);
+    FontParser parser(fontPath);
+    parser.setMemoryBudget(&budget);
+
+    std::atomic<uint64_t> mismatches = 0;
+    std::atomic<uint64_t> errors = 0;
+    std::vector<std::jthread> threads;
+    for (unsigned t = 0; t < numThreads; ++t) {
+      threads.emplace_back([&, t] {
+        std::vector<uint16_t> batch;
+        for (int round = 0; round < rounds; ++round) {
+          const unsigned path = (t + static_cast<unsigned>(round)) % 3;
+          for (uint16_t i = 0; i < numGlyphs; ++i) {
+            // Start at different glyphs so threads hit different offsets
+            const auto code = static_cast<uint16_t>((i + t * 97) % numGlyphs);
+            try {
+              if (path == 2 && i % PREFETCH_BATCH == 0) {
+                batch.clear();
+                for (uint16_t j = 0; j < PREFETCH_BATCH; ++j) {
+                  batch.push_back(
+                      static_cast<uint16_t>((code + j) % numGlyphs));
+                }
+                parser.prefetchGlyphs(batch);
+              }
+              const bool same = path == 0
+                  ? isSameGlyph(parser.getGlyphByCode(code), expected[code])
+                  : isSameGlyph(*parser.getCachedGlyph(code), expected[code]);
+              if (!same) ++mismatches;
+            } catch (const std::exception& e) {
+              if (errors++ == 0) std::cerr << "glyph " << code << ": "
+                                           << e.what() << "\n";
+            }
+          }
+        }
+      });
+    }
+    threads.clear();
+
+    std::cout << fontPath << ": " << numThreads << " threads x " << rounds
+              << " rounds of " << numGlyphs << " glyphs, " << mismatches
+              << " differ, " << errors << " failed, "
+              << budget.getStats().evictions << " evictions\n";
+    return mismatches == 0 && errors == 0 ? 0 : 1;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 2;
+  }
+}